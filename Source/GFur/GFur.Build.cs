@@ -35,6 +35,11 @@ public class GFur : ModuleRules
 				// ... add private dependencies that you statically link with here ...	
 			}
 			);
+
+		if (Target.bBuildEditor)
+		{
+			PrivateDependencyModuleNames.Add("DerivedDataCache");
+		}
 		
 		
 		DynamicallyLoadedModuleNames.AddRange(
@@ -0,0 +1,245 @@
+// Copyright 2023 GiM s.r.o. All Rights Reserved.
+
+#include "FurBuildScheduler.h"
+#include "FurData.h"
+#include "FurComponent.h"
+#include "Engine/World.h"
+#include "HAL/IConsoleManager.h"
+
+static TAutoConsoleVariable<int32> CVarFurAsyncBuild(
+	TEXT("gfur.AsyncBuild"),
+	1,
+	TEXT("Build the fur of new components in the background, the fur is drawn once its build finished.\n")
+	TEXT(" 0: build on the game thread, limited by gfur.BuildScheduler.FrameBudgetMs\n")
+	TEXT(" 1: build on worker threads, limited by gfur.BuildScheduler.MaxConcurrentBuilds (default)"),
+	ECVF_Default);
+
+static TAutoConsoleVariable<float> CVarFurBuildFrameBudget(
+	TEXT("gfur.BuildScheduler.FrameBudgetMs"),
+	2.0f,
+	TEXT("Game thread time in milliseconds spent on fur builds per frame. At least one build is done every frame."),
+	ECVF_Default);
+
+static TAutoConsoleVariable<int32> CVarFurBuildMaxConcurrent(
+	TEXT("gfur.BuildScheduler.MaxConcurrentBuilds"),
+	2,
+	TEXT("Maximal number of fur builds running on worker threads at the same time."),
+	ECVF_Default);
+
+#if WITH_EDITORONLY_DATA
+static TAutoConsoleVariable<float> CVarFurEditDelay(
+	TEXT("gfur.BuildScheduler.EditDelayMs"),
+	200.0f,
+	TEXT("Milliseconds without further edits of the assets of a fur before it's rebuilt in the editor. Edits of a single frame are always merged."),
+	ECVF_Default);
+#endif // WITH_EDITORONLY_DATA
+
+FFurBuildScheduler& FFurBuildScheduler::Get()
+{
+	static FFurBuildScheduler Scheduler;
+	return Scheduler;
+}
+
+void FFurBuildScheduler::Startup()
+{
+	TickerHandle = FTSTicker::GetCoreTicker().AddTicker(FTickerDelegate::CreateRaw(this, &FFurBuildScheduler::Tick));
+}
+
+void FFurBuildScheduler::Shutdown()
+{
+	FTSTicker::GetCoreTicker().RemoveTicker(TickerHandle);
+	TickerHandle.Reset();
+
+	FScopeLock Lock(&CriticalSection);
+	Queue.Empty();
+#if WITH_EDITORONLY_DATA
+	PendingEdits.Empty();
+#endif // WITH_EDITORONLY_DATA
+	for (const UE::Tasks::FTask& Task : Running)
+		Task.Wait();
+	Running.Empty();
+}
+
+bool FFurBuildScheduler::JoinOrEnqueue(FFurData* InFurData, const UGFurComponent* InFurComponent, TUniqueFunction<void()>&& InBuild)
+{
+	FScopeLock Lock(&CriticalSection);
+
+	if (InFurData->bBuildRequested)
+	{
+		if (FRequest* Request = Queue.FindByPredicate([InFurData](const FRequest& Request) { return Request.FurData == InFurData; }))
+			Request->FurComponents.AddUnique(InFurComponent);
+		return false;
+	}
+
+	InFurData->bBuildRequested = true;
+	FRequest& Request = Queue.AddDefaulted_GetRef();
+	Request.FurData = InFurData;
+	Request.FurComponents.Add(InFurComponent);
+	Request.Build = MoveTemp(InBuild);
+	return true;
+}
+
+void FFurBuildScheduler::Cancel(FFurData* InFurData)
+{
+	FScopeLock Lock(&CriticalSection);
+
+	int32 Index = Queue.IndexOfByPredicate([InFurData](const FRequest& Request) { return Request.FurData == InFurData; });
+	if (Index != INDEX_NONE)
+	{
+		Queue.RemoveAt(Index);
+		InFurData->bBuildRequested = false;
+	}
+}
+
+void FFurBuildScheduler::Flush(const FFurData* InFurData)
+{
+#if WITH_EDITORONLY_DATA
+	FFurData* FurData = const_cast<FFurData*>(InFurData);
+	bool bEdited = false;
+#endif // WITH_EDITORONLY_DATA
+	TOptional<FRequest> Request;
+	{
+		FScopeLock Lock(&CriticalSection);
+
+		int32 Index = Queue.IndexOfByPredicate([InFurData](const FRequest& Request) { return Request.FurData == InFurData; });
+		if (Index != INDEX_NONE)
+		{
+			Request.Emplace(MoveTemp(Queue[Index]));
+			Queue.RemoveAt(Index);
+		}
+#if WITH_EDITORONLY_DATA
+		bEdited = PendingEdits.Remove(FurData) > 0;
+#endif // WITH_EDITORONLY_DATA
+	}
+
+	// the builds are taken out of the queues above, they run without blocking the scheduler
+	if (Request.IsSet())
+		Dispatch(Request.GetValue(), false);
+#if WITH_EDITORONLY_DATA
+	if (bEdited)
+	{
+		if (FurData->BuildTask.IsValid())
+			FurData->BuildTask.Wait();
+		FurData->ExecuteBuild(FurData->PrepareEditBuild());
+	}
+#endif // WITH_EDITORONLY_DATA
+}
+
+#if WITH_EDITORONLY_DATA
+void FFurBuildScheduler::EnqueueEdit(FFurData* InFurData)
+{
+	FScopeLock Lock(&CriticalSection);
+	PendingEdits.Add(InFurData, FPlatformTime::Seconds());
+}
+
+void FFurBuildScheduler::CancelEdit(FFurData* InFurData)
+{
+	FScopeLock Lock(&CriticalSection);
+	PendingEdits.Remove(InFurData);
+}
+#endif // WITH_EDITORONLY_DATA
+
+bool FFurBuildScheduler::Tick(float DeltaTime)
+{
+	const bool Async = CVarFurAsyncBuild.GetValueOnGameThread() != 0;
+#if WITH_EDITORONLY_DATA
+	DispatchEdits(Async);
+#endif // WITH_EDITORONLY_DATA
+
+	// The requests are taken from the queue under the lock and dispatched without it, builds on the game thread don't block the threads queueing and cancelling builds.
+	// Data is released on the game thread only, a taken request can't be released before it's dispatched.
+	const int32 MaxConcurrentBuilds = FMath::Max(CVarFurBuildMaxConcurrent.GetValueOnGameThread(), 1);
+	const double Budget = CVarFurBuildFrameBudget.GetValueOnGameThread() * 0.001;
+	const double StartTime = FPlatformTime::Seconds();
+	for (int32 BuildCount = 0; Async || BuildCount == 0 || FPlatformTime::Seconds() - StartTime < Budget; BuildCount++)
+	{
+		FRequest Request;
+		{
+			FScopeLock Lock(&CriticalSection);
+			if (BuildCount == 0)
+			{
+				Running.RemoveAll([](const UE::Tasks::FTask& Task) { return Task.IsCompleted(); });
+				for (FRequest& QueuedRequest : Queue)
+					QueuedRequest.Priority = CalcPriority(QueuedRequest);
+				Queue.StableSort([](const FRequest& A, const FRequest& B) { return A.Priority > B.Priority; });
+			}
+			if (Queue.Num() == 0 || (Async && Running.Num() >= MaxConcurrentBuilds))
+				break;
+			Request = MoveTemp(Queue[0]);
+			Queue.RemoveAt(0);
+		}
+		Dispatch(Request, Async);
+	}
+	return true;
+}
+
+void FFurBuildScheduler::Dispatch(FRequest& InRequest, bool InAsync)
+{
+	FFurData* FurData = InRequest.FurData;
+	if (InAsync)
+	{
+		FurData->BuildTask = UE::Tasks::Launch(UE_SOURCE_LOCATION, [FurData, Build = MoveTemp(InRequest.Build)]() { FurData->ExecuteBuild(Build); });
+		FScopeLock Lock(&CriticalSection);
+		Running.Add(FurData->BuildTask);
+	}
+	else
+	{
+		FurData->ExecuteBuild(InRequest.Build);
+	}
+}
+
+#if WITH_EDITORONLY_DATA
+void FFurBuildScheduler::DispatchEdits(bool InAsync)
+{
+	TArray<FFurData*, TInlineAllocator<8>> Edits;
+	{
+		FScopeLock Lock(&CriticalSection);
+		const double Time = FPlatformTime::Seconds();
+		const double Delay = CVarFurEditDelay.GetValueOnGameThread() * 0.001;
+		for (auto It = PendingEdits.CreateIterator(); It; ++It)
+		{
+			// the queued first build and a running build of the data finish before the rebuild starts
+			FFurData* FurData = It.Key();
+			if (Time - It.Value() < Delay || (FurData->BuildTask.IsValid() && !FurData->BuildTask.IsCompleted())
+				|| Queue.ContainsByPredicate([FurData](const FRequest& Request) { return Request.FurData == FurData; }))
+				continue;
+			It.RemoveCurrent();
+			Edits.Add(FurData);
+		}
+	}
+
+	// preparing an edit may regenerate the guide splines, it runs without the lock
+	for (FFurData* FurData : Edits)
+		DispatchEdit(FurData, InAsync);
+}
+
+void FFurBuildScheduler::DispatchEdit(FFurData* InFurData, bool InAsync)
+{
+	FRequest Request;
+	Request.FurData = InFurData;
+	Request.Build = InFurData->PrepareEditBuild();
+	Dispatch(Request, InAsync);
+}
+#endif // WITH_EDITORONLY_DATA
+
+float FFurBuildScheduler::CalcPriority(const FRequest& InRequest)
+{
+	// Projected size of the largest requesting component, bounds radius over the distance to the closest view of the last frame.
+	// Without any view the requests keep their order.
+	float Priority = 0.0f;
+	for (const auto& FurComponent : InRequest.FurComponents)
+	{
+		const UGFurComponent* Component = FurComponent.Get();
+		if (Component == nullptr || !Component->IsRegistered())
+			continue;
+		const UWorld* World = Component->GetWorld();
+		if (World == nullptr)
+			continue;
+		for (const FVector& ViewLocation : World->ViewLocationsRenderedLastFrame)
+		{
+			float Distance = FVector::Distance(ViewLocation, Component->Bounds.Origin);
+			Priority = FMath::Max(Priority, float(Component->Bounds.SphereRadius / FMath::Max(Distance, 1.0f)));
+		}
+	}
+	return Priority;
+}
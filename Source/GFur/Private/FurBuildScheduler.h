@@ -0,0 +1,67 @@
+// Copyright 2023 GiM s.r.o. All Rights Reserved.
+
+#pragma once
+
+#include "Containers/Ticker.h"
+#include "Tasks/Task.h"
+#include "UObject/WeakObjectPtrTemplates.h"
+
+class FFurData;
+class UGFurComponent;
+
+/**
+* Fur Build Scheduler. Queues the builds of new fur data and dispatches them once per frame, the most visible first.
+* Background builds are limited in number, builds on the game thread are limited by a time budget.
+* Requests for the same fur data share a single build and a request whose data was released before it started is dropped.
+* In the editor the rebuilds of edited assets are merged per fur data and dispatched once the edits settle, the previous fur is drawn meanwhile.
+*/
+class FFurBuildScheduler
+{
+public:
+	static FFurBuildScheduler& Get();
+
+	void Startup();
+	void Shutdown();
+
+	/**
+	* Queues the build of the data requested by the component unless it has been requested already, then the component joins the queued build.
+	* Returns whether the build was queued. Threads creating the same data race here, only one of them queues its build.
+	*/
+	bool JoinOrEnqueue(FFurData* InFurData, const UGFurComponent* InFurComponent, TUniqueFunction<void()>&& InBuild);
+	/** Drops the queued build of released data, builds already running finish */
+	void Cancel(FFurData* InFurData);
+	/** Runs the queued build and the pending edit rebuild of the data on the calling thread */
+	void Flush(const FFurData* InFurData);
+#if WITH_EDITORONLY_DATA
+	/** Schedules the rebuild of edited data, see FFurData::RequestEditBuild. Every edit postpones it by gfur.BuildScheduler.EditDelayMs. */
+	void EnqueueEdit(FFurData* InFurData);
+	/** Drops the pending edit rebuild of data whose assets are unbound */
+	void CancelEdit(FFurData* InFurData);
+#endif // WITH_EDITORONLY_DATA
+
+private:
+	struct FRequest
+	{
+		FFurData* FurData;
+		TArray<TWeakObjectPtr<const UGFurComponent>, TInlineAllocator<2>> FurComponents;
+		TUniqueFunction<void()> Build;
+		float Priority = 0.0f;
+	};
+
+	FCriticalSection CriticalSection;
+	TArray<FRequest> Queue;
+	TArray<UE::Tasks::FTask> Running;
+	FTSTicker::FDelegateHandle TickerHandle;
+#if WITH_EDITORONLY_DATA
+	// time of the last edit of the data with a pending rebuild
+	TMap<FFurData*, double> PendingEdits;
+#endif // WITH_EDITORONLY_DATA
+
+	bool Tick(float DeltaTime);
+	void Dispatch(FRequest& InRequest, bool InAsync);
+#if WITH_EDITORONLY_DATA
+	void DispatchEdits(bool InAsync);
+	void DispatchEdit(FFurData* InFurData, bool InAsync);
+#endif // WITH_EDITORONLY_DATA
+	static float CalcPriority(const FRequest& InRequest);
+};
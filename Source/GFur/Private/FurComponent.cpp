@@ -26,18 +26,27 @@
 #include "ShaderParameterUtils.h"
 #include "FurSkinData.h"
 #include "FurStaticData.h"
+#include "FurMemoryBudget.h"
+#include "Misc/App.h"
 #include "SkeletalRenderPublic.h"
 
+#if WITH_EDITOR
+#include "Interfaces/ITargetPlatform.h"
+#endif
+
 #if RHI_RAYTRACING
 #include "RayTracingDefinitions.h"
 #include "RayTracingInstance.h"
 #endif
 
+// Mesh draw commands select the elements of a batch with a 64 bit mask
+static constexpr int32 MaxLayersPerBatch = 64;
+
 /** Scene proxy */
 class FFurSceneProxy : public FPrimitiveSceneProxy
 {
 public:
-	FFurSceneProxy(UGFurComponent* InComponent, const TArray<FFurData*>& InFurData, const TArray<FFurLod>& InFurLods, const TArray<UMaterialInstanceDynamic*>& InFurMaterials, const TArray<UMaterialInterface*>& InOverrideMaterials, const TArray<FFurMorphObject*>& InMorphObjects, bool InCastShadows, bool InPhysics, ERHIFeatureLevel::Type InFeatureLevel)
+	FFurSceneProxy(UGFurComponent* InComponent, const TArray<FFurData*>& InFurData, const TArray<int32>& InLayerCounts, const TArray<FFurLod>& InFurLods, const TArray<UMaterialInstanceDynamic*>& InFurMaterials, const TArray<UMaterialInterface*>& InOverrideMaterials, const TArray<FFurMorphObject*>& InMorphObjects, bool InCastShadows, bool InPhysics, ERHIFeatureLevel::Type InFeatureLevel)
 		: FPrimitiveSceneProxy(InComponent)
 		, FurComponent(InComponent)
 		, FurData(InFurData)
@@ -45,6 +54,11 @@ public:
 		, FurMaterials(InFurMaterials)
 		, FurMorphObjects(InMorphObjects)
 		, CastShadows(InCastShadows)
+		, Physics(InPhysics)
+		, ProxyFeatureLevel(InFeatureLevel)
+		, FurLengthScale(FFurData::CalcFurLengthScale(InComponent))
+		, FurShellBias(InComponent->ShellBias)
+		, FurNoiseStrength(InComponent->NoiseStrength / FurLengthScale)
 	{
 		bAlwaysHasVelocity = true;
 
@@ -55,62 +69,133 @@ public:
 				FurMaterials[i] = DynamicMaterial;
 		}
 
+		LodVertexFactories.SetNum(InFurData.Num());
+		LodBuilt.Init(false, InFurData.Num());
+
+		// LODs sharing progressive layers draw only a part of the stored layers
 		for (int i = 0; i < InFurData.Num(); i++)
+			LayerCounts.Add(FMath::Min(InLayerCounts[i], InFurData[i]->GetFurLayerCount()));
+		CurrentLayerCount = LastLayerCount = LayerCounts[0];
+	}
+
+	virtual ~FFurSceneProxy()
+	{
+		for (auto& VertexFactories : LodVertexFactories)
 		{
-			bool LodPhysics = i > 0 ? InFurLods[i - 1].PhysicsEnabled : true;
-			InFurData[i]->CreateVertexFactories(VertexFactories, InMorphObjects[i] ? InMorphObjects[i]->GetVertexBuffer() : NULL, InPhysics && LodPhysics, InFeatureLevel);
+			for (auto* VertexFactory : VertexFactories)
+			{
+				VertexFactory->ReleaseResource();
+				delete VertexFactory;
+			}
 		}
+		for (auto* MorphObject : FurMorphObjects)
+			delete MorphObject;
+#if RHI_RAYTRACING
+		RayTracingGeometry.ReleaseResource();
+#endif
+	}
 
 #if RHI_RAYTRACING
-		if (IsRayTracingEnabled())
+	void InitRayTracingGeometry(FRHICommandListBase& RHICmdList)
+	{
+		// Ray tracing reads positions straight from the fur vertex buffer, shells referencing the grow mesh
+		// or derived in the vertex shader have none
+		if (!IsRayTracingEnabled() || FurData[0]->UsesGrowMeshFetch() || FurData[0]->UsesProceduralShells())
+			return;
+
+		const auto& Sections = FurData[0]->GetSections();
+		FRayTracingGeometryInitializer Initializer;
+		Initializer.IndexBuffer = FurData[0]->GetIndexBuffer().IndexBufferRHI;
+		Initializer.TotalPrimitiveCount = 0;
+		Initializer.GeometryType = RTGT_Triangles;
+		Initializer.bFastBuild = true;
+		Initializer.bAllowUpdate = true;
+		// The index buffer holds a single layer, every layer is a segment reading the vertex buffer at the layer's offset
+		const int32 LayerCount = LayerCounts[0];
+		for (int sectionIdx = 0; sectionIdx < Sections.Num(); sectionIdx++)
 		{
-			ENQUEUE_RENDER_COMMAND(UpdateDataCommand)([&, this](FRHICommandListImmediate& RHICmdList) {
-				const auto& Sections = FurData[0]->GetSections();
-				FRayTracingGeometryInitializer Initializer;
-				Initializer.IndexBuffer = FurData[0]->GetIndexBuffer().IndexBufferRHI;
-				Initializer.TotalPrimitiveCount = 0;
-				Initializer.GeometryType = RTGT_Triangles;
-				Initializer.bFastBuild = true;
-				Initializer.bAllowUpdate = true;
-				for (int sectionIdx = 0; sectionIdx < Sections.Num(); sectionIdx++)
-				{
-					const FFurData::FSection& Section = Sections[sectionIdx];
-					Initializer.TotalPrimitiveCount += Section.NumTriangles;
-
-					FRayTracingGeometrySegment Segment;
-					Segment.VertexBuffer = FurData[0]->GetVertexBuffer().VertexBufferRHI;
-					Segment.VertexBufferStride = FurData[0]->GetVertexBuffer().GetVertexSize();
-					Segment.FirstPrimitive = Section.BaseIndex / 3;
-					Segment.NumPrimitives = Section.NumTriangles;
-					if (Section.MaxVertexIndex < 0) {
-						Segment.MaxVertices = 0;
-					}
-					else {
-						Segment.MaxVertices = Section.MaxVertexIndex;
-					}	
-					Initializer.Segments.Add(Segment);
-				}
-
-				RayTracingGeometry.InitResource(RHICmdList);
-				RayTracingGeometry.InitRHI(RHICmdList);				
-				RayTracingGeometry.SetInitializer(Initializer);
-			});
+			const FFurData::FSection& Section = Sections[sectionIdx];
+			for (int32 LayerSlot = 0; LayerSlot < LayerCount; LayerSlot++)
+			{
+				Initializer.TotalPrimitiveCount += Section.NumTriangles;
+
+				FRayTracingGeometrySegment Segment;
+				Segment.VertexBuffer = FurData[0]->GetVertexBuffer().VertexBufferRHI;
+				Segment.VertexBufferStride = FurData[0]->GetVertexBuffer().GetVertexSize();
+				Segment.VertexBufferOffset = (Section.BaseVertexIndex + LayerSlot * Section.LayerVertexCount) * Segment.VertexBufferStride;
+				Segment.FirstPrimitive = Section.BaseIndex / 3;
+				Segment.NumPrimitives = Section.NumTriangles;
+				Segment.MaxVertices = Section.NumIndexedVertices;
+				Initializer.Segments.Add(Segment);
+			}
 		}
+
+		RayTracingGeometry.InitResource(RHICmdList);
+		RayTracingGeometry.InitRHI(RHICmdList);				
+		RayTracingGeometry.SetInitializer(Initializer);
+	}
 #endif
+
+	virtual void CreateRenderThreadResources(FRHICommandListBase& RHICmdList) override
+	{
+		InitBuiltLods_RenderThread(RHICmdList);
 	}
 
-	virtual ~FFurSceneProxy()
+	/** Creates the vertex factories of the LODs whose fur data finished building in the background since the last call */
+	void InitBuiltLods_RenderThread(FRHICommandListBase& RHICmdList)
 	{
-		for (auto* VertexFactory : VertexFactories)
+		for (int i = 0; i < FurData.Num(); i++)
 		{
-			VertexFactory->ReleaseResource();
-			delete VertexFactory;
-		}
-		for (auto* MorphObject : FurMorphObjects)
-			delete MorphObject;
+			if (LodBuilt[i] || !FurData[i]->IsBuilt_RenderThread())
+				continue;
+
+			bool LodPhysics = i > 0 ? FurLods[i - 1].PhysicsEnabled : true;
+			if (!FurData[i]->CreateVertexFactories(LodVertexFactories[i], FurMorphObjects[i] ? FurMorphObjects[i]->GetVertexBuffer() : NULL, Physics && LodPhysics, ProxyFeatureLevel))
+				continue;
+			for (auto* VertexFactory : LodVertexFactories[i])
+			{
+				VertexFactory->SetFurLengthScale(FurLengthScale);
+				VertexFactory->SetFurShellShape(FurShellBias, FurNoiseStrength);
+			}
+			LodBuilt[i] = true;
+
 #if RHI_RAYTRACING
-		RayTracingGeometry.ReleaseResource();
+			if (i == 0)
+				InitRayTracingGeometry(RHICmdList);
 #endif
+		}
+	}
+
+	/** Built LOD closest to the requested one, coarser LODs are preferred. INDEX_NONE while nothing has been built yet. */
+	int GetBuiltLodLevel(int InLodLevel) const
+	{
+		for (int i = InLodLevel; i < FurData.Num(); i++)
+		{
+			if (LodBuilt[i])
+				return i;
+		}
+		for (int i = InLodLevel - 1; i >= 0; i--)
+		{
+			if (LodBuilt[i])
+				return i;
+		}
+		return INDEX_NONE;
+	}
+
+	/**
+	* Layers drawn by a LOD at a screen radius. A LOD sharing progressive layers with the previous one blends from its own layer count
+	* at the screen size of the next LOD to the layer count of the previous one at its own screen size.
+	*/
+	int32 CalcLayerCount(int InLodLevel, float InScreenRadius) const
+	{
+		const int32 LayerCount = LayerCounts[InLodLevel];
+		if (InLodLevel == 0 || InScreenRadius <= 0.0f || !FurData[InLodLevel]->UsesProgressiveLayers() || FurData[InLodLevel] != FurData[InLodLevel - 1])
+			return LayerCount;
+
+		const float MinScreenRadius = (InLodLevel + 1 < FurData.Num() ? FurLods[InLodLevel].ScreenSize : FurComponent->MinScreenSize) * 0.5f;
+		const float MaxScreenRadius = FurLods[InLodLevel - 1].ScreenSize * 0.5f;
+		const float Alpha = FMath::Clamp((InScreenRadius - MinScreenRadius) / FMath::Max(MaxScreenRadius - MinScreenRadius, UE_SMALL_NUMBER), 0.0f, 1.0f);
+		return FMath::RoundToInt(FMath::Lerp(float(LayerCount), float(LayerCounts[InLodLevel - 1]), Alpha));
 	}
 
 	virtual void GetDynamicMeshElements(const TArray<const FSceneView*>& Views,
@@ -127,6 +212,7 @@ public:
 		Collector.RegisterOneFrameMaterialProxy(WireframeMaterialInstance);
 
 		int NewLodLevel = 0x7fffffff;
+		float MaxScreenRadiusSquared = 0.0f;
 		if (FurComponent->LODFromParent)
 		{
 			const USkinnedMeshComponent* const MasterComp = FurComponent->GetMasterPoseComponent().Get();
@@ -150,6 +236,7 @@ public:
 					static const auto* SkeletalMeshLODRadiusScale = IConsoleManager::Get().FindTConsoleVariableDataFloat(TEXT("r.SkeletalMeshLODRadiusScale"));
 					float LODScale = FMath::Clamp(SkeletalMeshLODRadiusScale->GetValueOnRenderThread(), 0.25f, 1.0f);
 					const float ScreenRadiusSquared = ComputeBoundsScreenRadiusSquared(FurComponent->Bounds.Origin, FurComponent->Bounds.SphereRadius, *View) * LODScale * LODScale;
+					MaxScreenRadiusSquared = FMath::Max(MaxScreenRadiusSquared, ScreenRadiusSquared);
 
 					if (FMath::Square(FurComponent->MinScreenSize * 0.5f) < ScreenRadiusSquared)
 					{
@@ -187,29 +274,30 @@ public:
 		{
 			LastFurLodLevel = CurrentFurLodLevel;
 			LastMeshLodLevel = CurrentMeshLodLevel;
-			LastSectionOffset = SectionOffset;
+			LastLayerCount = CurrentLayerCount;
 			LastFrameNumber = ViewFamily.FrameNumber;
 		}
 
-		NewLodLevel = FMath::Min(NewLodLevel, FurData.Num() - 1);
-		if (NewLodLevel != CurrentFurLodLevel)
+		// LODs still building in the background are replaced by the closest built one
+		NewLodLevel = GetBuiltLodLevel(FMath::Min(NewLodLevel, FurData.Num() - 1));
+		if (NewLodLevel != INDEX_NONE && NewLodLevel != CurrentFurLodLevel)
 		{
 			CurrentFurLodLevel = NewLodLevel;
 			CurrentMeshLodLevel = FurData[CurrentFurLodLevel]->GetLod();
-			SectionOffset = 0;
-			for (int i = 0; i < NewLodLevel; i++)
-				SectionOffset += FurData[i]->GetSections_RenderThread().Num();
 		}
+		if (NewLodLevel != INDEX_NONE)
+			CurrentLayerCount = CalcLayerCount(NewLodLevel, FMath::Sqrt(MaxScreenRadiusSquared));
 		/*	if (FirstFrame)
 		{
 			LastFurLodLevel = CurrentFurLodLevel;
 			LastMeshLodLevel = CurrentMeshLodLevel;
-			LastSectionOffset = SectionOffset;
 		}*/
 
-		if (LastFurLodLevel < FurData.Num())
+		if (LastFurLodLevel < FurData.Num() && LodBuilt[LastFurLodLevel])
 		{
 			const auto& Sections = FurData[LastFurLodLevel]->GetSections_RenderThread();
+			FFurData::FLayerSlots LayerSlots;
+			FurData[LastFurLodLevel]->GetDrawLayerSlots(LayerSlots, LastLayerCount);
 			for (int sectionIdx = 0; sectionIdx < Sections.Num(); sectionIdx++)
 			{
 				const FFurData::FSection& section = Sections[sectionIdx];
@@ -236,22 +324,37 @@ public:
 							MaterialProxy = material->GetRenderProxy();
 						}
 
-						FMeshBatch& Mesh = Collector.AllocateMesh();
-						FMeshBatchElement& BatchElement = Mesh.Elements[0];
-						BatchElement.IndexBuffer = FurData[LastFurLodLevel]->GetIndexBuffer_RenderThread();
-						Mesh.bWireframe = Wireframe;
-						Mesh.VertexFactory = GetVertexFactory(sectionIdx, false);
-						Mesh.MaterialRenderProxy = MaterialProxy;
-						BatchElement.PrimitiveUniformBuffer = GetUniformBuffer();
-						BatchElement.FirstIndex = section.BaseIndex;
-						BatchElement.NumPrimitives = section.NumTriangles;
-						BatchElement.MinVertexIndex = section.MinVertexIndex;
-						BatchElement.MaxVertexIndex = section.MaxVertexIndex;
-						Mesh.ReverseCulling = IsLocalToWorldDeterminantNegative();
-						Mesh.Type = PT_TriangleList;
-						Mesh.DepthPriorityGroup = SDPG_World;
-						Mesh.bCanApplyViewModeOverrides = true;
-						Collector.AddMesh(ViewIndex, Mesh);
+						// The index buffer holds a single layer, a batch draws the layers of the section as one element per layer in the slot order.
+						// Sections with more layers than MaxLayersPerBatch are split into several batches.
+						// Stored layers are drawn with a base vertex offset, procedural shells store one layer and the vertex shader derives each layer from the element's UserIndex.
+						const bool bProceduralShells = FurData[LastFurLodLevel]->UsesProceduralShells();
+						for (int32 FirstSlot = 0; FirstSlot < LayerSlots.Num(); FirstSlot += MaxLayersPerBatch)
+						{
+							const int32 NumSlots = FMath::Min(LayerSlots.Num() - FirstSlot, MaxLayersPerBatch);
+							FMeshBatch& Mesh = Collector.AllocateMesh();
+							Mesh.bWireframe = Wireframe;
+							Mesh.VertexFactory = GetVertexFactory(sectionIdx, false);
+							Mesh.MaterialRenderProxy = MaterialProxy;
+							Mesh.ReverseCulling = IsLocalToWorldDeterminantNegative();
+							Mesh.Type = PT_TriangleList;
+							Mesh.DepthPriorityGroup = SDPG_World;
+							Mesh.bCanApplyViewModeOverrides = true;
+							Mesh.Elements.Empty(NumSlots);
+							for (int32 LayerSlot : MakeArrayView(LayerSlots).Slice(FirstSlot, NumSlots))
+							{
+								FMeshBatchElement& BatchElement = Mesh.Elements.AddDefaulted_GetRef();
+								BatchElement.IndexBuffer = FurData[LastFurLodLevel]->GetIndexBuffer_RenderThread();
+								BatchElement.PrimitiveUniformBuffer = GetUniformBuffer();
+								BatchElement.FirstIndex = section.BaseIndex;
+								BatchElement.NumPrimitives = section.NumTriangles;
+								BatchElement.BaseVertexIndex = section.BaseVertexIndex + (bProceduralShells ? 0 : LayerSlot * section.LayerVertexCount);
+								BatchElement.MinVertexIndex = 0;
+								BatchElement.MaxVertexIndex = section.NumIndexedVertices - 1;
+								BatchElement.UserIndex = FurData[LastFurLodLevel]->GetSlotLayerOffset(LayerSlot);
+							}
+							check(Mesh.Elements.Num() <= MaxLayersPerBatch);
+							Collector.AddMesh(ViewIndex, Mesh);
+						}
 					}
 				}
 			}
@@ -322,8 +425,12 @@ public:
 			RayTracingInstance.Geometry = &RayTracingGeometry;
 			RayTracingInstance.InstanceTransforms.Add(GetLocalToWorld());
 
-			for (int sectionIdx = 0; sectionIdx < Sections.Num(); sectionIdx++)
+			// one segment per layer of every section, see the geometry initializer
+			const int32 LayerCount = LayerCounts[0];
+			for (int SegmentIdx = 0; SegmentIdx < Sections.Num() * LayerCount; SegmentIdx++)
 			{
+				const int sectionIdx = SegmentIdx / LayerCount;
+				const int32 LayerSlot = SegmentIdx % LayerCount;
 				const FFurData::FSection& Section = Sections[sectionIdx];
 				check(RayTracingGeometry.Initializer.IndexBuffer.IsValid());
 
@@ -332,8 +439,8 @@ public:
 
 				FMeshBatch MeshBatch;
 
-				MeshBatch.VertexFactory = GetVertexFactory(sectionIdx, false);
-				MeshBatch.SegmentIndex = sectionIdx;
+				MeshBatch.VertexFactory = LodVertexFactories[0][sectionIdx];
+				MeshBatch.SegmentIndex = SegmentIdx;
 				MeshBatch.MaterialRenderProxy = MaterialProxy;
 				MeshBatch.ReverseCulling = IsLocalToWorldDeterminantNegative();
 				MeshBatch.Type = PT_TriangleList;
@@ -344,8 +451,9 @@ public:
 				BatchElement.IndexBuffer = FurData[0]->GetIndexBuffer_RenderThread();
 				BatchElement.FirstIndex = Section.BaseIndex;
 				BatchElement.NumPrimitives = Section.NumTriangles;
-				BatchElement.MinVertexIndex = Section.MinVertexIndex;
-				BatchElement.MaxVertexIndex = Section.MaxVertexIndex;
+				BatchElement.BaseVertexIndex = Section.BaseVertexIndex + LayerSlot * Section.LayerVertexCount;
+				BatchElement.MinVertexIndex = 0;
+				BatchElement.MaxVertexIndex = Section.NumIndexedVertices - 1;
 
 				RayTracingInstance.Materials.Add(MeshBatch);
 			}
@@ -365,7 +473,8 @@ public:
 	uint32 GetAllocatedSize(void) const { return (FPrimitiveSceneProxy::GetAllocatedSize()); }
 
 	FFurData* GetFurData(bool Current) { return FurData[FMath::Min(Current ? CurrentFurLodLevel : LastFurLodLevel, FurData.Num() - 1)]; }
-	FFurVertexFactory* GetVertexFactory(int sectionIdx, bool Current) const { return VertexFactories[(Current ? SectionOffset : LastSectionOffset) + sectionIdx]; }
+	FFurVertexFactory* GetVertexFactory(int sectionIdx, bool Current) const { return LodVertexFactories[Current ? CurrentFurLodLevel : LastFurLodLevel][sectionIdx]; }
+	bool IsLodBuilt(bool Current) const { return LodBuilt[Current ? CurrentFurLodLevel : LastFurLodLevel]; }
 	FFurMorphObject* GetMorphObject(bool Current) const { return FurMorphObjects[Current ? CurrentFurLodLevel : LastFurLodLevel]; }
 
 	int GetCurrentFurLodLevel() const { return CurrentFurLodLevel; }
@@ -380,18 +489,28 @@ public:
 private:
 	UGFurComponent* FurComponent;
 	TArray<FFurData*> FurData;
+	// Layers drawn by the LODs, fewer than stored when they share progressive layers
+	TArray<int32> LayerCounts;
 	TArray<FFurLod> FurLods;
 	TArray<class UMaterialInstanceDynamic*> FurMaterials;
-	TArray<FFurVertexFactory*> VertexFactories;
+	TArray<TArray<FFurVertexFactory*>> LodVertexFactories;
+	TArray<bool> LodBuilt;
 	TArray<FFurMorphObject*> FurMorphObjects;
 	mutable int CurrentFurLodLevel = 0;
 	mutable int CurrentMeshLodLevel = 0;
-	mutable int SectionOffset = 0;
 	mutable int LastFurLodLevel = 0;
 	mutable int LastMeshLodLevel = 0;
-	mutable int LastSectionOffset = 0;
+	mutable int32 CurrentLayerCount = 0;
+	mutable int32 LastLayerCount = 0;
 	mutable int LastFrameNumber = 0;
 	bool CastShadows;
+	bool Physics;
+	ERHIFeatureLevel::Type ProxyFeatureLevel;
+	// the fur data is shared by components differing only in the fur length, the vertex factories apply it
+	float FurLengthScale;
+	// and so are the shell bias and the noise strength of the linear shells, see FFurData::UsesLinearShells
+	float FurShellBias;
+	float FurNoiseStrength;
 
 #if RHI_RAYTRACING
 	FRayTracingGeometry RayTracingGeometry;
@@ -410,6 +529,11 @@ UGFurComponent::UGFurComponent(const FObjectInitializer& ObjectInitializer)
 	FurLength = 1.0f;
 	MinFurLength = 0.0f;
 	RemoveFacesWithoutSplines = false;
+	ReferenceGrowMeshVertices = false;
+	CompactVertexFormat = false;
+	ProceduralShells = false;
+	ProgressiveLayers = false;
+	CookFurData = false;
 	PhysicsEnabled = true;
 	ForceDistribution = 2.0f;
 	Stiffness = 5.0f;
@@ -421,6 +545,7 @@ UGFurComponent::UGFurComponent(const FObjectInitializer& ObjectInitializer)
 	HairLengthForceUniformity = 0.75f;
 	MaxPhysicsOffsetLength = FLT_MAX;
 	NoiseStrength = 0.0f;
+	NoiseSeed = 0;
 	CastShadow = false;
 	PrimaryComponentTick.bCanEverTick = true;
 	DisableMorphTargets = false;
@@ -433,6 +558,15 @@ UGFurComponent::UGFurComponent(const FObjectInitializer& ObjectInitializer)
 	SetCollisionProfileName(UCollisionProfile::NoCollision_ProfileName);
 }
 
+bool UGFurComponent::ShouldGenerateFur() const
+{
+	// dedicated servers, -nullrhi and commandlets never draw the fur
+	if (!FApp::CanEverRender())
+		return false;
+	const UWorld* World = GetWorld();
+	return World == nullptr || !World->IsNetMode(NM_DedicatedServer);
+}
+
 void UGFurComponent::RegenerateFur()
 {
 	if (IsRenderStateCreated())
@@ -444,14 +578,225 @@ void UGFurComponent::RegenerateFur()
 
 const TArray<int32>& UGFurComponent::GetFurSplineMap() const
 {
+	FurData[0]->WaitForBuild();
 	return FurData[0]->GetSplineMap();
 }
 
 const TArray<FVector>& UGFurComponent::GetVertexNormals() const
 {
+	FurData[0]->WaitForBuild();
 	return FurData[0]->GetVertexNormals();
 }
 
+// Loaded payloads by their package and the registry key of the cook, components without their own payload load the one cooked by the package.
+// The cook hashes the asset pointers, the keys are unique within a package only.
+static FCriticalSection CookedFurPayloadsLock;
+static TMap<TTuple<FName, FSHAHash>, TWeakPtr<FByteBulkData, ESPMode::ThreadSafe>> CookedFurPayloads;
+
+static void RegisterCookedFurPayloads(FName InPackageName, const TArray<FSHAHash>& InKeys, const TArray<TSharedPtr<FByteBulkData, ESPMode::ThreadSafe>>& InPayloads)
+{
+	FScopeLock Lock(&CookedFurPayloadsLock);
+	for (auto It = CookedFurPayloads.CreateIterator(); It; ++It)
+	{
+		if (!It.Value().IsValid())
+			It.RemoveCurrent();
+	}
+	for (int32 i = 0; i < InPayloads.Num(); i++)
+	{
+		if (InPayloads[i]->GetBulkDataSize() > 0)
+			CookedFurPayloads.Add(MakeTuple(InPackageName, InKeys[i]), InPayloads[i]);
+	}
+}
+
+#if WITH_EDITOR
+// The first component of a package cooking a key stores the payload, the package is serialized more than once while saving
+static TMap<TTuple<FName, const ITargetPlatform*, FSHAHash>, TWeakObjectPtr<const UGFurComponent>> CookedFurPayloadOwners;
+
+static bool ClaimCookedFurPayload(const UGFurComponent* InFurComponent, const ITargetPlatform* InTargetPlatform, const FSHAHash& InKey)
+{
+	FScopeLock Lock(&CookedFurPayloadsLock);
+	TWeakObjectPtr<const UGFurComponent>& Owner = CookedFurPayloadOwners.FindOrAdd(MakeTuple(InFurComponent->GetPackage()->GetFName(), InTargetPlatform, InKey));
+	if (!Owner.IsValid())
+		Owner = InFurComponent;
+	return Owner.Get() == InFurComponent;
+}
+#endif // WITH_EDITOR
+
+void UGFurComponent::Serialize(FArchive& Ar)
+{
+	Super::Serialize(Ar);
+
+	// cooked packages only, editor packages keep generating the fur
+	if (!Ar.IsFilterEditorOnly())
+		return;
+
+	int32 NumPayloads = 0;
+#if WITH_EDITOR
+	TArray<TArray<uint8>> Payloads;
+	if (Ar.IsSaving())
+		CookedFurKeys.Reset();
+	// server only targets never draw the fur. Blueprint templates are cooked too, the components spawned from them load the payloads of the template.
+	if (Ar.IsSaving() && Ar.IsCooking() && CookFurData && !HasAnyFlags(RF_ClassDefaultObject) && !Ar.CookingTarget()->IsServerOnly())
+		CookFurPayloads(Payloads, CookedFurKeys, Ar.CookingTarget());
+	if (Ar.IsSaving())
+	{
+		CookedFurData.Reset();
+		for (const TArray<uint8>& Payload : Payloads)
+		{
+			auto BulkData = MakeShared<FByteBulkData, ESPMode::ThreadSafe>();
+			BulkData->SetBulkDataFlags(BULKDATA_Force_NOT_InlinePayload);
+			BulkData->Lock(LOCK_READ_WRITE);
+			FMemory::Memcpy(BulkData->Realloc(Payload.Num()), Payload.GetData(), Payload.Num());
+			BulkData->Unlock();
+			CookedFurData.Add(BulkData);
+		}
+	}
+#endif // WITH_EDITOR
+
+	NumPayloads = CookedFurData.Num();
+	Ar << NumPayloads;
+	if (Ar.IsLoading())
+	{
+		CookedFurData.Reset();
+		CookedFurKeys.Reset();
+		if (NumPayloads < 0)
+		{
+			Ar.SetError();
+			return;
+		}
+		CookedFurKeys.SetNum(NumPayloads);
+		for (int32 i = 0; i < NumPayloads; i++)
+			CookedFurData.Add(MakeShared<FByteBulkData, ESPMode::ThreadSafe>());
+	}
+	for (int32 i = 0; i < CookedFurData.Num(); i++)
+	{
+		Ar << CookedFurKeys[i];
+		CookedFurData[i]->Serialize(Ar, this);
+	}
+	if (Ar.IsLoading())
+	{
+		CookedFurPackage = GetPackage()->GetFName();
+		RegisterCookedFurPayloads(CookedFurPackage, CookedFurKeys, CookedFurData);
+	}
+
+#if WITH_EDITOR
+	if (Ar.IsSaving())
+	{
+		CookedFurData.Reset();
+		CookedFurKeys.Reset();
+	}
+#endif // WITH_EDITOR
+}
+
+TSharedPtr<FByteBulkData, ESPMode::ThreadSafe> UGFurComponent::GetCookedFurData(int32 InFurDataIndex, const UGFurComponent*& OutCookedComponent) const
+{
+	OutCookedComponent = this;
+	// the payloads were cooked with the full layer counts
+	if (BudgetDemotion > 0)
+		return TSharedPtr<FByteBulkData, ESPMode::ThreadSafe>();
+	if (CookedFurData.Num() > 0)
+		return FindCookedFurData(InFurDataIndex);
+
+	// components spawned from a Blueprint have no payloads of their own, the template has them when its LODs match
+	const UGFurComponent* Template = Cast<UGFurComponent>(GetArchetype());
+	if (Template == nullptr || Template == this || Template->LayerCount != LayerCount || Template->LODs.Num() != LODs.Num())
+		return TSharedPtr<FByteBulkData, ESPMode::ThreadSafe>();
+	for (int32 i = 0; i < LODs.Num(); i++)
+	{
+		if (Template->LODs[i].LayerCount != LODs[i].LayerCount || Template->LODs[i].Lod != LODs[i].Lod)
+			return TSharedPtr<FByteBulkData, ESPMode::ThreadSafe>();
+	}
+	OutCookedComponent = Template;
+	return Template->FindCookedFurData(InFurDataIndex);
+}
+
+TSharedPtr<FByteBulkData, ESPMode::ThreadSafe> UGFurComponent::FindCookedFurData(int32 InFurDataIndex) const
+{
+	if (!CookedFurData.IsValidIndex(InFurDataIndex))
+		return TSharedPtr<FByteBulkData, ESPMode::ThreadSafe>();
+	if (CookedFurData[InFurDataIndex]->GetBulkDataSize() > 0)
+		return CookedFurData[InFurDataIndex];
+
+	FScopeLock Lock(&CookedFurPayloadsLock);
+	const TWeakPtr<FByteBulkData, ESPMode::ThreadSafe>* Payload = CookedFurPayloads.Find(MakeTuple(CookedFurPackage, CookedFurKeys[InFurDataIndex]));
+	return Payload ? Payload->Pin() : TSharedPtr<FByteBulkData, ESPMode::ThreadSafe>();
+}
+
+int32 UGFurComponent::GetBudgetFurLod(int32 InFurLod) const
+{
+	return FMath::Max(InFurLod, FMath::Min(BudgetDemotion, LODs.Num()));
+}
+
+int32 UGFurComponent::GetBudgetLayerCount(int32 InFurLod) const
+{
+	const int32 FurLodLayerCount = InFurLod > 0 ? LODs[InFurLod - 1].LayerCount : LayerCount;
+	return FMath::Max(FurLodLayerCount >> BudgetDemotion, 1);
+}
+
+void UGFurComponent::GetFurDataLayerCounts(TArray<int32>& OutLayerCounts, const TArray<int32>& InDrawLayerCounts, const TArray<int32>& InMeshLods) const
+{
+	OutLayerCounts = InDrawLayerCounts;
+	if (!ProgressiveLayers)
+		return;
+	for (int32 FurLod = 0; FurLod < InMeshLods.Num(); FurLod++)
+	{
+		for (int32 OtherFurLod = 0; OtherFurLod < InMeshLods.Num(); OtherFurLod++)
+		{
+			if (InMeshLods[OtherFurLod] == InMeshLods[FurLod])
+				OutLayerCounts[FurLod] = FMath::Max(OutLayerCounts[FurLod], InDrawLayerCounts[OtherFurLod]);
+		}
+	}
+}
+
+#if WITH_EDITOR
+void UGFurComponent::CookFurPayloads(TArray<TArray<uint8>>& OutPayloads, TArray<FSHAHash>& OutKeys, const ITargetPlatform* InTargetPlatform)
+{
+	// same fur data as CreateSceneProxy, the build is usually a DDC hit
+	TArray<FFurData*> CookFurArray;
+	const bool bSkin = SkeletalGrowMesh && SkeletalGrowMesh->GetResourceForRendering();
+	int32 NumLods = 0;
+	if (bSkin)
+		NumLods = SkeletalGrowMesh->GetResourceForRendering()->LODRenderData.Num();
+	else if (StaticGrowMesh && StaticGrowMesh->GetRenderData())
+		NumLods = StaticGrowMesh->GetRenderData()->LODResources.Num();
+	if (NumLods == 0)
+		return;
+
+	TArray<int32> MeshLods, LayerCounts, DataLayerCounts;
+	MeshLods.Add(0);
+	LayerCounts.Add(FMath::Max(LayerCount, 1));
+	for (FFurLod& lod : LODs)
+	{
+		MeshLods.Add(FMath::Min(NumLods - 1, lod.Lod));
+		LayerCounts.Add(FMath::Max(lod.LayerCount, 1));
+	}
+	GetFurDataLayerCounts(DataLayerCounts, LayerCounts, MeshLods);
+	for (int32 FurLod = 0; FurLod < MeshLods.Num(); FurLod++)
+	{
+		if (bSkin)
+			CookFurArray.Add(FFurSkinData::CreateFurData(DataLayerCounts[FurLod], MeshLods[FurLod], this));
+		else
+			CookFurArray.Add(FFurStaticData::CreateFurData(DataLayerCounts[FurLod], MeshLods[FurLod], this));
+	}
+
+	for (int32 FurLod = 0; FurLod < CookFurArray.Num(); FurLod++)
+	{
+		// LODs sharing progressive layers and components of the package with the same fur load the payload cooked first, theirs stay empty
+		TArray<uint8>& Payload = OutPayloads.AddDefaulted_GetRef();
+		OutKeys.Add(CookFurArray[FurLod]->GetRegistryKey());
+		if (CookFurArray.Find(CookFurArray[FurLod]) < FurLod || !ClaimCookedFurPayload(this, InTargetPlatform, OutKeys.Last()))
+			continue;
+		CookFurArray[FurLod]->WaitForBuild();
+		CookFurArray[FurLod]->SaveCookedData(Payload, GetPathName());
+	}
+
+	if (bSkin)
+		FFurSkinData::DestroyFurData(CookFurArray);
+	else
+		FFurStaticData::DestroyFurData(CookFurArray);
+}
+#endif // WITH_EDITOR
+
 UMaterialInterface* UGFurComponent::GetMaterial(int32 MaterialIndex) const
 {
 	if (MaterialIndex < OverrideMaterials.Num() && OverrideMaterials[MaterialIndex])
@@ -694,44 +1039,67 @@ FPrimitiveSceneProxy* UGFurComponent::CreateSceneProxy()
 			//Deprecated 5.0
 			//bool UseMorphTargets = !DisableMorphTargets && MasterPoseComponent.IsValid() && MasterPoseComponent->SkeletalMesh->GetMorphTargets().Num() > 0;
 
+			TArray<int32> MeshLods, LayerCounts, DataLayerCounts;
+			for (int32 FurLod = 0; FurLod <= LODs.Num(); FurLod++)
 			{
-				auto Data = FFurSkinData::CreateFurData(FMath::Max(LayerCount, 1), 0, this);
-				FurArray.Add(Data);
-				MorphObjects.Add(UseMorphTargets ? new FFurMorphObject(Data) : NULL);
-				if (UseMorphTargets)
-					CreateMorphRemapTable(0);
+				const int32 BudgetFurLod = GetBudgetFurLod(FurLod);
+				MeshLods.Add(BudgetFurLod > 0 ? FMath::Min(NumLods - 1, LODs[BudgetFurLod - 1].Lod) : 0);
+				LayerCounts.Add(GetBudgetLayerCount(BudgetFurLod));
 			}
-			for (FFurLod& lod : LODs)
+			GetFurDataLayerCounts(DataLayerCounts, LayerCounts, MeshLods);
+
+			for (int32 FurLod = 0; FurLod <= LODs.Num(); FurLod++)
 			{
-				auto Data = FFurSkinData::CreateFurData(FMath::Max(lod.LayerCount, 1), FMath::Min(NumLods - 1, lod.Lod), this);
-				if (!lod.DisableMorphTargets && UseMorphTargets)
-					CreateMorphRemapTable(FMath::Min(NumLods - 1, lod.Lod));
+				const int32 BudgetFurLod = GetBudgetFurLod(FurLod);
+				const FFurLod* lod = BudgetFurLod > 0 ? &LODs[BudgetFurLod - 1] : nullptr;
+				const int32 MeshLod = MeshLods[FurLod];
+				const bool LodMorphTargets = UseMorphTargets && (lod == nullptr || !lod->DisableMorphTargets);
+				const UGFurComponent* CookedComponent;
+				auto CookedData = GetCookedFurData(FurLod, CookedComponent);
+				auto Data = FFurSkinData::CreateFurData(DataLayerCounts[FurLod], MeshLod, this, CookedData, CookedComponent);
+				if (LodMorphTargets)
+					CreateMorphRemapTable(MeshLod);
 				FurArray.Add(Data);
-				MorphObjects.Add(!lod.DisableMorphTargets && UseMorphTargets ? new FFurMorphObject(Data) : NULL);
+				MorphObjects.Add(LodMorphTargets ? new FFurMorphObject(Data) : NULL);
 			}
 
 			FurData = FurArray;
 
-			return new FFurSceneProxy(this, FurData, LODs, FurMaterials, OverrideMaterials, MorphObjects, CastShadow, PhysicsEnabled, GetWorld()->GetFeatureLevel());
+			return new FFurSceneProxy(this, FurData, LayerCounts, LODs, FurMaterials, OverrideMaterials, MorphObjects, CastShadow, PhysicsEnabled, GetWorld()->GetFeatureLevel());
 		}
 		else if (StaticGrowMesh && StaticGrowMesh->GetRenderData())
 		{
-			FurArray.Add(FFurStaticData::CreateFurData(FMath::Max(LayerCount, 1), 0, this));
-			MorphObjects.Add(NULL);
-			for (FFurLod& lod : LODs)
+			TArray<int32> MeshLods, LayerCounts, DataLayerCounts;
+			for (int32 FurLod = 0; FurLod <= LODs.Num(); FurLod++)
+			{
+				const int32 BudgetFurLod = GetBudgetFurLod(FurLod);
+				MeshLods.Add(BudgetFurLod > 0 ? FMath::Min(StaticGrowMesh->GetRenderData()->LODResources.Num() - 1, LODs[BudgetFurLod - 1].Lod) : 0);
+				LayerCounts.Add(GetBudgetLayerCount(BudgetFurLod));
+			}
+			GetFurDataLayerCounts(DataLayerCounts, LayerCounts, MeshLods);
+
+			for (int32 FurLod = 0; FurLod <= LODs.Num(); FurLod++)
 			{
-				FurArray.Add(FFurStaticData::CreateFurData(FMath::Max(lod.LayerCount, 1), FMath::Min(StaticGrowMesh->GetRenderData()->LODResources.Num() - 1, lod.Lod), this));
+				const UGFurComponent* CookedComponent;
+				auto CookedData = GetCookedFurData(FurLod, CookedComponent);
+				FurArray.Add(FFurStaticData::CreateFurData(DataLayerCounts[FurLod], MeshLods[FurLod], this, CookedData, CookedComponent));
 				MorphObjects.Add(NULL);
 			}
 
 			FurData = FurArray;
-			return new FFurSceneProxy(this, FurData, LODs, FurMaterials, OverrideMaterials, MorphObjects, CastShadow, PhysicsEnabled, GetWorld()->GetFeatureLevel());
+			return new FFurSceneProxy(this, FurData, LayerCounts, LODs, FurMaterials, OverrideMaterials, MorphObjects, CastShadow, PhysicsEnabled, GetWorld()->GetFeatureLevel());
 		}
 	}
 	return nullptr;
 }
 
 
+bool UGFurComponent::ShouldCreateRenderState() const
+{
+	// without a render state there are no materials, no fur data and no physics
+	return Super::ShouldCreateRenderState() && ShouldGenerateFur();
+}
+
 void UGFurComponent::CreateRenderState_Concurrent(FRegisterComponentContext* Context)
 {
 //	ERHIFeatureLevel::Type FeatureLevel = GetWorld()->FeatureLevel;
@@ -753,6 +1121,9 @@ void UGFurComponent::CreateRenderState_Concurrent(FRegisterComponentContext* Con
 
 	Super::CreateRenderState_Concurrent(Context);
 
+	if (FurData.Num())
+		FFurMemoryBudget::Get().Register(this);
+
 	updateFur();
 }
 
@@ -769,6 +1140,8 @@ void UGFurComponent::DestroyRenderState_Concurrent()
 {
 	Super::DestroyRenderState_Concurrent();
 
+	FFurMemoryBudget::Get().Unregister(this);
+
 //	ERHIFeatureLevel::Type FeatureLevel = GetWorld()->FeatureLevel;
 //	if (FeatureLevel >= ERHIFeatureLevel::ES3_1)
 	{
@@ -785,6 +1158,12 @@ void UGFurComponent::DestroyRenderState_Concurrent()
 }
 
 
+void UGFurComponent::RegisterComponentTickFunctions(bool bRegister)
+{
+	// the tick only feeds the physics of the drawn fur
+	Super::RegisterComponentTickFunctions(bRegister && ShouldGenerateFur());
+}
+
 void UGFurComponent::TickComponent(float DeltaTime, enum ELevelTick TickType, FActorComponentTickFunction *ThisTickFunction)
 {
 	LastDeltaTime = DeltaTime;
@@ -836,7 +1215,7 @@ void UGFurComponent::updateFur()
 	bool LodPhysicsEnabled = PhysicsEnabled && (FurLodLevel == 0 || LODs[FurLodLevel - 1].PhysicsEnabled);
 
 	float DeltaTime = fminf(LastDeltaTime, 1.0f);
-	float ReferenceFurLength = FMath::Max(0.00001f, Scene->GetFurData(true)->GetCurrentMaxFurLength() * ReferenceHairBias + Scene->GetFurData(true)->GetCurrentMinFurLength() * (1.0f - ReferenceHairBias));
+	float ReferenceFurLength = FMath::Max(0.00001f, (Scene->GetFurData(true)->GetCurrentMaxFurLength() * ReferenceHairBias + Scene->GetFurData(true)->GetCurrentMinFurLength() * (1.0f - ReferenceHairBias)) * FFurData::CalcFurLengthScale(this));
 	//	float ForceFactor = 1.0f / (powf(ReferenceFurLength, FurForcePower) * fmaxf(FurStiffness, 0.000001f));
 	float ForceFactor = 1.0f / powf(ReferenceFurLength, ForceDistribution);
 	float DampingClamped = fmaxf(Damping, 0.000001f);
@@ -1099,6 +1478,9 @@ void UGFurComponent::UpdateFur_RenderThread(FRHICommandListImmediate& RHICmdList
 	FFurSceneProxy* FurProxy = (FFurSceneProxy*)SceneProxy;
 
 	if (FurProxy)
+		FurProxy->InitBuiltLods_RenderThread(RHICmdList);
+
+	if (FurProxy && FurProxy->IsLodBuilt(true))
 	{
 		ERHIFeatureLevel::Type SceneFeatureLevel = GetWorld()->GetFeatureLevel();
 
@@ -4,119 +4,321 @@
 
 
 #include "FurComponent.h"
+#include "FurBuildScheduler.h"
+#include "DataDrivenShaderPlatformInfo.h"
+#include "StaticMeshResources.h"
+#include "HAL/IConsoleManager.h"
+#include "Math/RandomStream.h"
+#include "UObject/Package.h"
+#include "Serialization/MemoryReader.h"
+#include "Serialization/MemoryWriter.h"
+#include "UObject/ObjectKey.h"
+#if WITH_EDITOR
+#include "DerivedDataCacheInterface.h"
+#endif // WITH_EDITOR
+
+// Change when the generated fur or the layout of its derived data changes
+#define FURDATA_DERIVEDDATA_VER TEXT("2C7F0E93B4A1463D8F5E9A10D6B3C842")
+
+static TAutoConsoleVariable<int32> CVarFurParallelBuild(
+	TEXT("gfur.ParallelBuild"),
+	1,
+	TEXT("Generate fur shell vertices on worker threads.\n")
+	TEXT(" 0: single threaded\n")
+	TEXT(" 1: parallel for large builds (default)"),
+	ECVF_Default);
+
+static TAutoConsoleVariable<int32> CVarFurParallelBuildMinVertices(
+	TEXT("gfur.ParallelBuild.MinVertices"),
+	16384,
+	TEXT("Minimal number of generated shell vertices for the build to be split across worker threads."),
+	ECVF_Default);
+
+static TAutoConsoleVariable<int32> CVarFurOptimizeTriangleOrder(
+	TEXT("gfur.OptimizeTriangleOrder"),
+	1,
+	TEXT("Reorder the shell triangles of every section when the fur is built.\n")
+	TEXT(" 0: keep the grow mesh order\n")
+	TEXT(" 1: post-transform vertex cache order (default)\n")
+	TEXT(" 2: vertex cache order with the clusters sorted to reduce overdraw"),
+	ECVF_Default);
+
+static TAutoConsoleVariable<int32> CVarFurOptimizeTriangleOrderCacheSize(
+	TEXT("gfur.OptimizeTriangleOrder.CacheSize"),
+	16,
+	TEXT("Number of vertices of the simulated post-transform vertex cache."),
+	ECVF_Default);
+
+static TAutoConsoleVariable<int32> CVarFurDerivedDataCache(
+	TEXT("gfur.DerivedDataCache"),
+	1,
+	TEXT("Store the fur generated in the editor in the derived data cache and reuse it for unchanged grow meshes, splines and fur parameters."),
+	ECVF_Default);
+
+static TAutoConsoleVariable<int32> CVarFurRetentionCacheSize(
+	TEXT("gfur.RetentionCacheSizeMB"),
+	64,
+	TEXT("Budget in megabytes of the fur kept after its last component was destroyed, the least recently released fur is deleted first.\n")
+	TEXT("New components with the same fur revive it without a build. 0 deletes released fur right away."),
+	ECVF_Default);
+
+static TAutoConsoleVariable<int32> CVarFurRetentionCacheMaxEntries(
+	TEXT("gfur.RetentionCacheMaxEntries"),
+	32,
+	TEXT("Maximal number of released fur data kept by gfur.RetentionCacheSizeMB. Retained fur keeps its grow mesh, guide meshes and splines loaded."),
+	ECVF_Default);
+
+DEFINE_LOG_CATEGORY_STATIC(LogGFur, Log, All);
+
+// intermediates of the grow mesh LODs and splines, alive while fur data holds them
+static TMap<FSHAHash, TWeakPtr<FFurBuildIntermediates, ESPMode::ThreadSafe>> FurIntermediates;
+static FCriticalSection FurIntermediatesCS;
 
 /** Fur Vertex Buffer */
-FFurVertexBuffer::~FFurVertexBuffer()
+void FFurVertexBuffer::InitRHI(FRHICommandListBase& RHICmdList)
 {
-	delete[]VertexData;
+	UploadData(RHICmdList, VertexData.Get(UploadCopy));
 }
 
-void FFurVertexBuffer::InitRHI(FRHICommandListBase& RHICmdList)
+void FFurVertexBuffer::UploadData(FRHICommandListBase& RHICmdList, FVertexArray& InData)
+{
+	// The generated vertices are the initial data of the buffer, the RHI discards them after the upload in cooked builds
+	FRHIResourceCreateInfo CreateInfo(L"FurVertexBuffer", &InData);
+	VertexBufferRHI = RHICmdList.CreateVertexBuffer(InData.GetResourceDataSize(), BUF_Static, CreateInfo);
+}
+
+void FFurVertexBuffer::UploadRanges(FRHICommandListImmediate& RHICmdList, const FVertexArray& InData, const TArray<FFurDirtyRange>& InRanges)
 {
-	FRHIResourceCreateInfo CreateInfo(L"FurVertexBuffer");
+	// The dirty ranges are packed into an upload buffer and copied into place, the vertex buffer itself is kept
+	uint32 StagingSize = 0;
+	for (const FFurDirtyRange& Range : InRanges)
+		StagingSize += Range.Size;
 
+	FRHIResourceCreateInfo CreateInfo(L"FurVertexBufferDirtyRanges");
+	FBufferRHIRef StagingBufferRHI = RHICmdList.CreateBuffer(StagingSize, BUF_SourceCopy | BUF_Dynamic, 0, ERHIAccess::CopySrc, CreateInfo);
+	uint8* StagingData = (uint8*)RHICmdList.LockBuffer(StagingBufferRHI, 0, StagingSize, RLM_WriteOnly);
+	for (const FFurDirtyRange& Range : InRanges)
+	{
+		FMemory::Memcpy(StagingData, InData.GetData() + Range.Offset, Range.Size);
+		StagingData += Range.Size;
+	}
+	RHICmdList.UnlockBuffer(StagingBufferRHI);
 
-	//VertexBufferRHI = RHICreateVertexBuffer(Size, BUF_Static, CreateInfo); DEPRECATED
-	VertexBufferRHI = RHICmdList.CreateVertexBuffer(Size, BUF_Static, CreateInfo);
+	RHICmdList.Transition(FRHITransitionInfo(VertexBufferRHI, ERHIAccess::Unknown, ERHIAccess::CopyDest));
+	uint32 StagingOffset = 0;
+	for (const FFurDirtyRange& Range : InRanges)
+	{
+		RHICmdList.CopyBufferRegion(VertexBufferRHI, Range.Offset, StagingBufferRHI, StagingOffset, Range.Size);
+		StagingOffset += Range.Size;
+	}
+	RHICmdList.Transition(FRHITransitionInfo(VertexBufferRHI, ERHIAccess::CopyDest, ERHIAccess::VertexOrIndexBuffer | ERHIAccess::SRVMask));
+}
 
-	// Copy the vertex data into the vertex buffer.
-	//void* VertexBufferData = RHILockBuffer(VertexBufferRHI, 0, Size, RLM_WriteOnly); DEPRECATED 
-	void* VertexBufferData = RHICmdList.LockBuffer(VertexBufferRHI, 0, Size, RLM_WriteOnly);
+void FFurVertexBuffer::BuildDirtyRanges(TArray<FFurDirtyRange>& OutRanges)
+{
+	// vertices close to each other are uploaded together, the copies have a fixed cost
+	static const uint32 MergeGap = 16;
 
-	FMemory::Memcpy(VertexBufferData, VertexData, Size);
+	OutRanges.Reset();
+	if (!bPartialUpdate || DirtyVertices.Num() == 0)
+		return;
 
-	//RHIUnlockBuffer(VertexBufferRHI); DEPRECATED
-	RHICmdList.UnlockBuffer(VertexBufferRHI);
+	DirtyVertices.Sort();
+	uint32 First = DirtyVertices[0];
+	uint32 Last = First;
+	for (uint32 VertexIndex : DirtyVertices)
+	{
+		if (VertexIndex > Last + MergeGap)
+		{
+			OutRanges.Add({ First * VertexSize, (Last - First + 1) * VertexSize });
+			First = VertexIndex;
+		}
+		Last = VertexIndex;
+	}
+	OutRanges.Add({ First * VertexSize, (Last - First + 1) * VertexSize });
+	DirtyVertices.Reset();
+}
 
-#if !WITH_EDITORONLY_DATA
-	delete[]VertexData;
-	VertexData = NULL;
-#endif // WITH_EDITORONLY_DATA
+void* FFurVertexBuffer::Lock(uint32 InVertexCount, uint32 InVertexSize, bool InPreserve)
+{
+	if (InVertexCount == 0)
+		InVertexCount = 1;
+	VertexSize = InVertexSize;
+	Size = InVertexCount * InVertexSize;
+	FVertexArray& Data = VertexData.Acquire(InPreserve);
+	Data.SetNumUninitialized(Size, EAllowShrinking::No);
+	bPartialUpdate = InPreserve;
+	DirtyVertices.Reset();
+	return Data.GetData();
 }
 
 void FFurVertexBuffer::Unlock()
 {
-	if (IsInitialized())
-	{
-		ENQUEUE_RENDER_COMMAND(UpdateDataCommand)([this](FRHICommandListImmediate& RHICmdList) {
-			
-			check(VertexBufferRHI.IsValid());
+	// Comb updates mark the vertices they touched, a full rebuild uploads everything
+	TArray<FFurDirtyRange> DirtyRanges;
+	BuildDirtyRanges(DirtyRanges);
 
-			if (Size != VertexBufferRHI->GetSize() || VertexBufferRHI->GetUsage() == BUF_Static)
-			{
-				FRHIResourceCreateInfo CreateInfo(L"FurVertexBuffer");
-				//VertexBufferRHI = RHICreateVertexBuffer(Size, BUF_Dynamic, CreateInfo); DEPRECATED
-				VertexBufferRHI = RHICmdList.CreateVertexBuffer(Size, BUF_Dynamic, CreateInfo);
+	// The next build writes the other staging copy, this one is released once the rendering thread copied it
+	const int32 Copy = VertexData.Submit(DirtyRanges);
+	ENQUEUE_RENDER_COMMAND(UpdateDataCommand)([this, Copy, DirtyRanges = MoveTemp(DirtyRanges)](FRHICommandListImmediate& RHICmdList) {
+		FVertexArray& Data = VertexData.Get(Copy);
+		if (!IsInitialized())
+		{
+			UploadCopy = Copy;
+			InitResource(RHICmdList);
+		}
+		else if (DirtyRanges.Num() && VertexBufferRHI.IsValid() && VertexBufferRHI->GetSize() == (uint32)Data.Num())
+		{
+			UploadRanges(RHICmdList, Data, DirtyRanges);
+		}
+		else
+		{
+			UploadData(RHICmdList, Data);
+		}
+		VertexData.Release(Copy);
+	});
+}
 
-			}
+/** Index Buffer */
+void FFurIndexBuffer::InitRHI(FRHICommandListBase& RHICmdList)
+{
+	CreateBuffer(RHICmdList, Indices.Get(UploadCopy));
+}
+
+void FFurIndexBuffer::CreateBuffer(FRHICommandListBase& RHICmdList, FIndexArray& InIndices)
+{
+	if (InIndices.Num() == 0)
+		InIndices.Add(0);
+
+	// Sections are rebased to their lowest vertex, so 16 bit indices cover most fur
+	int32 MaxIndex = 0;
+	for (int32 Index : InIndices)
+		MaxIndex = FMath::Max(MaxIndex, Index);
 
-			// Copy the vertex data into the vertex buffer.
-			//void* VertexBufferData = RHILockBuffer(VertexBufferRHI, 0, Size, RLM_WriteOnly);
-			void* VertexBufferData = RHICmdList.LockBuffer(VertexBufferRHI, 0, Size, RLM_WriteOnly);
+	if (MaxIndex < MAX_uint16)
+	{
+		TResourceArray<uint16, INDEXBUFFER_ALIGNMENT> Indices16;
+		Indices16.SetNumUninitialized(InIndices.Num());
+		for (int32 i = 0; i < InIndices.Num(); i++)
+			Indices16[i] = (uint16)InIndices[i];
+		InIndices.Discard();
 
-			FMemory::Memcpy(VertexBufferData, VertexData, Size);
-			RHICmdList.UnlockBuffer(VertexBufferRHI);
-		});
+		FRHIResourceCreateInfo CreateInfo(L"FurIndexBuffer", &Indices16);
+		IndexBufferRHI = RHICmdList.CreateIndexBuffer(sizeof(uint16), Indices16.GetResourceDataSize(), BUF_Static, CreateInfo);
 	}
 	else
 	{
-		BeginInitResource(this);
+		// The indices are the initial data of the buffer, the RHI discards them after the upload in cooked builds
+		FRHIResourceCreateInfo CreateInfo(L"FurIndexBuffer", &InIndices);
+		IndexBufferRHI = RHICmdList.CreateIndexBuffer(sizeof(int32), InIndices.GetResourceDataSize(), BUF_Static, CreateInfo);
 	}
 }
 
-/** Index Buffer */
-void FFurIndexBuffer::InitRHI(FRHICommandListBase& RHICmdList)
+FFurIndexBuffer::FIndexArray& FFurIndexBuffer::Lock()
 {
-	if (Indices.Num() == 0)
-		Indices.Add(0);
+	return Indices.Acquire(false);
+}
 
-	FRHIResourceCreateInfo CreateInfo(L"FurVertexBuffer");
-	IndexBufferRHI = RHICmdList.CreateIndexBuffer(sizeof(int32), Indices.Num() * sizeof(int32), BUF_Static, CreateInfo);
-	// Write the indices to the index buffer.
-	void* Buffer = RHICmdList.LockBuffer(IndexBufferRHI, 0, Indices.Num() * sizeof(int32), RLM_WriteOnly);
-	FMemory::Memcpy(Buffer, Indices.GetData(), Indices.Num() * sizeof(int32));
-	RHICmdList.UnlockBuffer(IndexBufferRHI);
+void FFurIndexBuffer::Unlock()
+{
+	const int32 Copy = Indices.Submit();
+	ENQUEUE_RENDER_COMMAND(UpdateDataCommand)([this, Copy](FRHICommandListImmediate& RHICmdList) {
+		if (IsInitialized())
+		{
+			CreateBuffer(RHICmdList, Indices.Get(Copy));
+		}
+		else
+		{
+			UploadCopy = Copy;
+			InitResource(RHICmdList);
+		}
+		Indices.Release(Copy);
+	});
+}
 
-#if !WITH_EDITORONLY_DATA
-	Indices.SetNum(0, true);
-#endif // WITH_EDITORONLY_DATA
+/** Profile Buffer */
+void FFurProfileBuffer::InitRHI(FRHICommandListBase& RHICmdList)
+{
+	CreateBuffer(RHICmdList, Profiles.Get(UploadCopy), UploadStride);
 }
 
-TArray<int32>& FFurIndexBuffer::Lock()
+void FFurProfileBuffer::ReleaseRHI()
 {
-	return Indices;
+	ShaderResourceViewRHI.SafeRelease();
+	FVertexBuffer::ReleaseRHI();
 }
 
-void FFurIndexBuffer::Unlock()
+void FFurProfileBuffer::CreateBuffer(FRHICommandListBase& RHICmdList, FProfileArray& InProfiles, uint32 InStride)
 {
-	if (IsInitialized())
-	{
-		ENQUEUE_RENDER_COMMAND(UpdateDataCommand)([this](FRHICommandListImmediate& RHICmdList) {
-			check(IndexBufferRHI.IsValid());
-			if (Indices.Num() == 0)
-				Indices.Add(0);
-			uint32 Size = Indices.Num() * sizeof(int32);
-			if (Size != IndexBufferRHI->GetSize() || IndexBufferRHI->GetUsage() == BUF_Static)
-			{
-				FRHIResourceCreateInfo CreateInfo(L"FurVertexBuffer");
-				IndexBufferRHI = RHICmdList.CreateIndexBuffer(sizeof(int32), Size, BUF_Dynamic, CreateInfo);
-			}
+	if (InProfiles.Num() == 0)
+		InProfiles.Add(FVector4f(0.0f, 0.0f, 0.0f, 0.0f));
+	FRHIResourceCreateInfo CreateInfo(L"FurProfileBuffer", &InProfiles);
+	VertexBufferRHI = RHICmdList.CreateVertexBuffer(InProfiles.GetResourceDataSize(), BUF_Static | BUF_ShaderResource, CreateInfo);
+
+	ShaderResourceViewRHI = RHICmdList.CreateShaderResourceView(VertexBufferRHI, sizeof(FVector4f), PF_A32B32G32R32F);
+	Stride = InStride;
+}
+
+FVector4f* FFurProfileBuffer::Lock(uint32 InVertexCount, uint32 InStride, bool InPreserve)
+{
+	PendingStride = InStride;
+	FProfileArray& Data = Profiles.Acquire(InPreserve);
+	Data.SetNumUninitialized(FMath::Max(InVertexCount, 1u) * InStride);
+	return Data.GetData();
+}
+
+void FFurProfileBuffer::Unlock()
+{
+	const int32 Copy = Profiles.Submit();
+	ENQUEUE_RENDER_COMMAND(UpdateDataCommand)([this, Copy, NewStride = PendingStride](FRHICommandListImmediate& RHICmdList) {
+		if (IsInitialized())
+		{
+			CreateBuffer(RHICmdList, Profiles.Get(Copy), NewStride);
+		}
+		else
+		{
+			UploadCopy = Copy;
+			UploadStride = NewStride;
+			InitResource(RHICmdList);
+		}
+		Profiles.Release(Copy);
+	});
+}
 
-			void* Buffer = RHICmdList.LockBuffer(IndexBufferRHI, 0, Indices.Num() * sizeof(int32), RLM_WriteOnly);
-			FMemory::Memcpy(Buffer, Indices.GetData(), Indices.Num() * sizeof(int32));
-			RHICmdList.UnlockBuffer(IndexBufferRHI);
-		});
+/** Layer Shader Data */
+FRHIShaderResourceView* FFurLayerShaderData::GetProfilesSRV() const
+{
+	// the shaders always declare the profile buffer, shells stored per layer bind a dummy
+	FRHIShaderResourceView* ProfilesSRV = Profiles ? Profiles->GetSRV() : nullptr;
+	return ProfilesSRV ? ProfilesSRV : GNullColorVertexBuffer.VertexBufferSRV.GetReference();
+}
+
+/** Grow Mesh Fetch Data */
+void FFurGrowMeshFetchData::Set(const FStaticMeshVertexBuffers& InVertexBuffers)
+{
+	Positions = InVertexBuffers.PositionVertexBuffer.GetSRV();
+	Tangents = InVertexBuffers.StaticMeshVertexBuffer.GetTangentsSRV();
+	TexCoords = InVertexBuffers.StaticMeshVertexBuffer.GetTexCoordsSRV();
+	NumTexCoords = InVertexBuffers.StaticMeshVertexBuffer.GetNumTexCoords();
+	if (InVertexBuffers.ColorVertexBuffer.GetNumVertices() > 0)
+	{
+		Colors = InVertexBuffers.ColorVertexBuffer.GetColorComponentsSRV();
+		ColorIndexMask = ~0u;
 	}
 	else
 	{
-		BeginInitResource(this);
+		Colors = GNullColorVertexBuffer.VertexBufferSRV;
+		ColorIndexMask = 0;
 	}
+	check(Positions && Tangents && TexCoords && Colors);
 }
 
 /** Fur Data */
 const int32 FFurData::MinimalFurLayerCount = 1;
 const int32 FFurData::MaximalFurLayerCount = 128;
 const float FFurData::MinimalFurLength = 0.001f;
+const uint32 FFurData::ParallelBuildChunkSize = 1024;
+const int32 FFurData::BuiltDataVersion = 2;
 
 FFurData::FFurData()
 {
@@ -133,6 +335,7 @@ FFurData::~FFurData()
 
 	VertexBuffer.ReleaseResource();
 	IndexBuffer.ReleaseResource();
+	ProfileBuffer.ReleaseResource();
 
 #if WITH_EDITORONLY_DATA
 	if (FurSplinesAssigned)
@@ -140,38 +343,273 @@ FFurData::~FFurData()
 #endif // WITH_EDITORONLY_DATA
 }
 
+void FFurData::LaunchBuild(const UGFurComponent* InFurComponent, TUniqueFunction<void()>&& InBuild)
+{
+	// joins the queued build when the data is shared
+	FFurBuildScheduler::Get().JoinOrEnqueue(this, InFurComponent, MoveTemp(InBuild));
+}
+
+void FFurData::ExecuteBuild(const TUniqueFunction<void()>& InBuild)
+{
+	InBuild();
+	BuiltSize = CalcBuiltSize();
+	CurrentMinFurLength_GameThread = CurrentMinFurLength;
+	CurrentMaxFurLength_GameThread = CurrentMaxFurLength;
+	MaxVertexBoneDistance_GameThread = MaxVertexBoneDistance;
+	bHasBuilt = true;
+
+	// The build submits its buffers with render commands, the flag is handed over after them so the proxies never see a partial build
+	ENQUEUE_RENDER_COMMAND(FurDataBuiltCommand)([this](FRHICommandListImmediate& RHICmdList) {
+		bBuilt_RenderThread = true;
+	});
+}
+
+uint64 FFurData::CalcBuiltSize() const
+{
+	uint64 Size = uint64(VertexCountPerLayer) * GetVertexLayerCount() * VertexBuffer.GetVertexSize();
+	for (const FSection& Section : TempSections)
+		Size += uint64(Section.NumTriangles) * 3 * sizeof(int32);
+	if (bProceduralShells)
+		Size += uint64(VertexCountPerLayer) * ProfileBuffer.GetStagingStride() * sizeof(FVector4f);
+	return Size;
+}
+
+uint64 FFurData::GetRetentionBudget()
+{
+	return uint64(FMath::Max(CVarFurRetentionCacheSize.GetValueOnAnyThread(), 0)) * 1024 * 1024;
+}
+
+int32 FFurData::GetRetentionMaxEntries()
+{
+	return FMath::Max(CVarFurRetentionCacheMaxEntries.GetValueOnAnyThread(), 0);
+}
+
+void FFurData::WaitForBuild() const
+{
+	FFurBuildScheduler::Get().Flush(this);
+	if (BuildTask.IsValid())
+		BuildTask.Wait();
+}
+
 void FFurData::Set(int InFurLayerCount, int InLod, class UGFurComponent* InFurComponent)
 {
 	FurSplinesAssigned = InFurComponent->FurSplines;
+	ReferencedAssets.Reset();
+	if (FurSplinesAssigned)
+		ReferencedAssets.Emplace(FurSplinesAssigned);
 #if WITH_EDITORONLY_DATA
 	if (FurSplinesAssigned)
 		FurSplinesAssigned->AddToRoot();
 #endif // WITH_EDITORONLY_DATA
 	Lod = InLod;
 	FurLayerCount = FMath::Clamp(InFurLayerCount, MinimalFurLayerCount, MaximalFurLayerCount);
-	FurLength = InFurComponent->FurLength;
-	ShellBias = InFurComponent->ShellBias;
+	// lengths relative to the fur length, it's applied by the vertex factories
+	const float FurLengthScale = CalcFurLengthScale(InFurComponent);
+	FurLength = 1.0f;
+	// linear shells store the unit noise, the vertex factories scale it by the noise strength of the component
+	bLinearShells = UsesLinearShells(InFurComponent);
+	ShellBias = bLinearShells ? 0.0f : InFurComponent->ShellBias;
 	HairLengthForceUniformity = InFurComponent->HairLengthForceUniformity;
-	MinFurLength = FMath::Max(InFurComponent->MinFurLength, MinimalFurLength);
-	NoiseStrength = InFurComponent->NoiseStrength;
+	MinFurLength = FMath::Max(InFurComponent->MinFurLength, MinimalFurLength) / FurLengthScale;
+	NoiseStrength = bLinearShells ? 1.0f : InFurComponent->NoiseStrength / FurLengthScale;
+	NoiseSeed = InFurComponent->NoiseSeed;
 	RemoveFacesWithoutSplines = InFurComponent->RemoveFacesWithoutSplines;
+	ReferenceGrowMeshVertices = InFurComponent->ReferenceGrowMeshVertices;
+	CompactVertexFormat = InFurComponent->CompactVertexFormat;
+	ProceduralShells = InFurComponent->ProceduralShells;
+	ProgressiveLayers = InFurComponent->ProgressiveLayers;
+	InitLayerSlots();
 
 	FurSplinesUsed = FurSplinesAssigned;
-	CurrentMinFurLength = InFurComponent->FurLength;
-	CurrentMaxFurLength = InFurComponent->FurLength;
+	CurrentMinFurLength = FurLength;
+	CurrentMaxFurLength = FurLength;
+	CurrentMinFurLength_GameThread = FurLength;
+	CurrentMaxFurLength_GameThread = FurLength;
+}
+
+float FFurData::CalcFurLengthScale(const UGFurComponent* InFurComponent)
+{
+	return FMath::Max(InFurComponent->FurLength, MinimalFurLength);
+}
+
+bool FFurData::UsesLinearShells(const UGFurComponent* InFurComponent)
+{
+	return InFurComponent->FurSplines == nullptr && InFurComponent->StaticGuideMeshes.Num() == 0 && InFurComponent->SkeletalGuideMeshes.Num() == 0;
+}
+
+void FFurData::InitLayerSlots()
+{
+	SlotLayerOffsets.Reset(FurLayerCount);
+	if (!ProgressiveLayers || FurLayerCount == 1)
+	{
+		for (int32 LayerSlot = 0; LayerSlot < FurLayerCount; LayerSlot++)
+			SlotLayerOffsets.Add(LayerSlot);
+		return;
+	}
+
+	const uint32 Bits = FMath::CeilLogTwo(uint32(FurLayerCount));
+	for (uint32 Index = 0; Index < (1u << Bits); Index++)
+	{
+		const int32 LayerOffset = int32(ReverseBits(Index) >> (32 - Bits));
+		if (LayerOffset < FurLayerCount)
+			SlotLayerOffsets.Add(LayerOffset);
+	}
+	check(SlotLayerOffsets.Num() == FurLayerCount);
+}
+
+void FFurData::GetDrawLayerSlots(FLayerSlots& OutLayerSlots, int32 InLayerCount) const
+{
+	const int32 LayerCount = ProgressiveLayers ? FMath::Clamp(InLayerCount, 1, FurLayerCount) : FurLayerCount;
+	OutLayerSlots.Reset();
+	for (int32 LayerSlot = 0; LayerSlot < LayerCount; LayerSlot++)
+		OutLayerSlots.Add(LayerSlot);
+	// drawn from the tip down like the layers without the permutation
+	if (ProgressiveLayers)
+		OutLayerSlots.Sort([this](int32 A, int32 B) { return SlotLayerOffsets[A] < SlotLayerOffsets[B]; });
+}
+
+void FFurData::HashParameters(FSHA1& InOutHash, int InFurLayerCount, int InLod, const UGFurComponent* InFurComponent)
+{
+	auto HashValue = [&InOutHash](const auto& Value) { InOutHash.Update((const uint8*)&Value, sizeof(Value)); };
+	HashValue(InLod);
+	HashValue(FMath::Clamp(InFurLayerCount, MinimalFurLayerCount, MaximalFurLayerCount));
+	// the fur length is a shader parameter, the lengths relative to it shape the fur
+	const float FurLengthScale = CalcFurLengthScale(InFurComponent);
+	// so are the shell bias and the noise strength of the linear shells
+	const bool bLinearShells = UsesLinearShells(InFurComponent);
+	HashValue(bLinearShells ? 0.0f : InFurComponent->ShellBias);
+	HashValue(InFurComponent->HairLengthForceUniformity);
+	// the minimal length only clamps the splines
+	HashValue(InFurComponent->FurSplines ? FMath::Max(InFurComponent->MinFurLength, MinimalFurLength) / FurLengthScale : 0.0f);
+	HashValue(bLinearShells ? 0.0f : InFurComponent->NoiseStrength / FurLengthScale);
+	HashValue(InFurComponent->NoiseSeed);
+	HashValue(InFurComponent->RemoveFacesWithoutSplines);
+	HashValue(InFurComponent->ReferenceGrowMeshVertices);
+	HashValue(InFurComponent->CompactVertexFormat);
+	HashValue(InFurComponent->ProceduralShells);
+	HashValue(InFurComponent->ProgressiveLayers);
+
+	const UFurSplines* Splines = InFurComponent->FurSplines;
+	HashAsset(InOutHash, Splines, 0, [Splines](FSHA1& InOutContentHash) {
+		InOutContentHash.Update((const uint8*)&Splines->ControlPointCount, sizeof(Splines->ControlPointCount));
+		InOutContentHash.Update((const uint8*)&Splines->Threshold, sizeof(Splines->Threshold));
+		InOutContentHash.Update((const uint8*)Splines->Vertices.GetData(), Splines->Vertices.Num() * sizeof(FVector));
+		return true;
+	});
+}
+
+#if !WITH_EDITOR
+// content hashes of the assets, computed once per asset and LOD
+static TMap<TPair<FObjectKey, int32>, FSHAHash> FurAssetHashes;
+static FRWLock FurAssetHashesLock;
+// the hashes of unloaded assets are pruned whenever the map doubles
+static int32 FurAssetHashesPruneCount = 64;
+#endif // !WITH_EDITOR
+
+void FFurData::HashAsset(FSHA1& InOutHash, const UObject* InAsset, int32 InLod, TFunctionRef<bool(FSHA1&)> InHashContent)
+{
+	if (InAsset == nullptr)
+	{
+		const int32 None = INDEX_NONE;
+		InOutHash.Update((const uint8*)&None, sizeof(None));
+		return;
+	}
+
+#if WITH_EDITOR
+	InOutHash.Update((const uint8*)&InAsset, sizeof(InAsset));
+	InOutHash.Update((const uint8*)&InLod, sizeof(InLod));
+#else
+	const TPair<FObjectKey, int32> AssetKey(FObjectKey(InAsset), InLod);
+	FSHAHash ContentHash;
+	bool bFound = false;
+	{
+		FReadScopeLock Lock(FurAssetHashesLock);
+		if (const FSHAHash* Found = FurAssetHashes.Find(AssetKey))
+		{
+			ContentHash = *Found;
+			bFound = true;
+		}
+	}
+	if (!bFound)
+	{
+		FSHA1 Content;
+		if (!InHashContent(Content))
+		{
+			// the CPU copy was discarded, the asset is shared only with itself
+			Content.Reset();
+			Content.Update((const uint8*)&InAsset, sizeof(InAsset));
+		}
+		Content.Update((const uint8*)&InLod, sizeof(InLod));
+		Content.Final();
+		Content.GetHash(ContentHash.Hash);
+
+		FWriteScopeLock Lock(FurAssetHashesLock);
+		if (FurAssetHashes.Num() >= FurAssetHashesPruneCount)
+		{
+			for (auto It = FurAssetHashes.CreateIterator(); It; ++It)
+			{
+				if (It->Key.Key.ResolveObjectPtr() == nullptr)
+					It.RemoveCurrent();
+			}
+			FurAssetHashesPruneCount = FMath::Max(FurAssetHashes.Num() * 2, 64);
+		}
+		FurAssetHashes.Add(AssetKey, ContentHash);
+	}
+	InOutHash.Update(ContentHash.Hash, sizeof(ContentHash.Hash));
+#endif // WITH_EDITOR
+}
+
+bool FFurData::HashGrowMeshVertices(FSHA1& InOutHash, const FStaticMeshVertexBuffers& InVertexBuffers)
+{
+	const uint32 NumVertices = InVertexBuffers.PositionVertexBuffer.GetNumVertices();
+	FStaticMeshVertexBuffer& Vertices = const_cast<FStaticMeshVertexBuffer&>(InVertexBuffers.StaticMeshVertexBuffer);
+	if (NumVertices == 0 || InVertexBuffers.PositionVertexBuffer.GetVertexData() == nullptr || Vertices.GetTangentData() == nullptr)
+		return false;
+
+	InOutHash.Update((const uint8*)&NumVertices, sizeof(NumVertices));
+	InOutHash.Update((const uint8*)InVertexBuffers.PositionVertexBuffer.GetVertexData(), NumVertices * InVertexBuffers.PositionVertexBuffer.GetStride());
+
+	const uint32 NumTexCoords = Vertices.GetNumTexCoords();
+	InOutHash.Update((const uint8*)&NumTexCoords, sizeof(NumTexCoords));
+	InOutHash.Update((const uint8*)Vertices.GetTangentData(), Vertices.GetTangentSize());
+	InOutHash.Update((const uint8*)Vertices.GetTexCoordData(), Vertices.GetTexCoordSize());
+
+	FColorVertexBuffer& Colors = const_cast<FColorVertexBuffer&>(InVertexBuffers.ColorVertexBuffer);
+	if (Colors.GetNumVertices() > 0 && Colors.GetVertexData())
+		InOutHash.Update((const uint8*)Colors.GetVertexData(), Colors.GetNumVertices() * Colors.GetStride());
+	return true;
+}
+
+bool FFurData::CanReferenceGrowMeshVertices() const
+{
+	return ReferenceGrowMeshVertices && RHISupportsManualVertexFetch(GMaxRHIShaderPlatform);
 }
 
-bool FFurData::Compare(int InFurLayerCount, int InLod, class UGFurComponent* InFurComponent)
+bool FFurData::CanUseProceduralShells() const
 {
-	return FurSplinesAssigned == InFurComponent->FurSplines
-		&& Lod == InLod
-		&& FurLayerCount == FMath::Clamp(InFurLayerCount, MinimalFurLayerCount, MaximalFurLayerCount)
-		&& FurLength == InFurComponent->FurLength
-		&& ShellBias == InFurComponent->ShellBias
-		&& HairLengthForceUniformity == InFurComponent->HairLengthForceUniformity
-		&& MinFurLength == FMath::Max(InFurComponent->MinFurLength, MinimalFurLength)
-		&& NoiseStrength == InFurComponent->NoiseStrength
-		&& RemoveFacesWithoutSplines == InFurComponent->RemoveFacesWithoutSplines;
+	return ProceduralShells && RHISupportsManualVertexFetch(GMaxRHIShaderPlatform);
+}
+
+uint32 FFurData::GetProceduralProfileStride() const
+{
+	return 1 + (FurSplinesUsed ? FurSplinesUsed->ControlPointCount : 0);
+}
+
+FFurLayerShaderData FFurData::GetLayerShaderData() const
+{
+	FFurLayerShaderData Data;
+	Data.CompactVertexFormat = bUseCompactVertexFormat ? 1 : 0;
+	Data.FurLayerCount = FurLayerCount;
+	Data.ShellBias = ShellBias;
+	Data.LinearShells = bLinearShells ? 1 : 0;
+	if (bProceduralShells)
+	{
+		Data.ProceduralShells = 1;
+		Data.NoiseStrength = NoiseStrength;
+		Data.NoiseSeed = uint32(NoiseSeed);
+		Data.Profiles = &ProfileBuffer;
+	}
+	return Data;
 }
 
 bool FFurData::Similar(int InLod, class UGFurComponent* InFurComponent)
@@ -179,11 +617,137 @@ bool FFurData::Similar(int InLod, class UGFurComponent* InFurComponent)
 	return Lod == InLod && FurSplinesAssigned == InFurComponent->FurSplines && RemoveFacesWithoutSplines == InFurComponent->RemoveFacesWithoutSplines;
 }
 
-void FFurData::GenerateSplineMap(const FPositionVertexBuffer& InPositions)
+void FFurData::AcquireIntermediates(const UObject* InGrowMesh, TFunctionRef<void(TArray<FVector>&)> InUnpackNormals)
 {
-	SplineMap.Reset();
+	FSHA1 Hash;
+	auto HashValue = [&Hash](const auto& Value) { Hash.Update((const uint8*)&Value, sizeof(Value)); };
+	HashValue(InGrowMesh);
+	HashValue(Lod);
+	HashValue(FurSplinesUsed);
+	HashValue(FurSplinesUsed ? FurSplinesUsed->Threshold : 0.0f);
+	// the spline map ignores the spline direction with a minimal fur length
+	HashValue(MinFurLength > 0.0f);
+	Hash.Final();
+	FSHAHash Key;
+	Hash.GetHash(Key.Hash);
+
+	{
+		FScopeLock Lock(&FurIntermediatesCS);
+		Intermediates = FurIntermediates.FindRef(Key).Pin();
+		if (!Intermediates.IsValid())
+		{
+			for (auto It = FurIntermediates.CreateIterator(); It; ++It)
+			{
+				if (!It.Value().IsValid())
+					It.RemoveCurrent();
+			}
+			Intermediates = MakeShared<FFurBuildIntermediates, ESPMode::ThreadSafe>();
+			Intermediates->Key = Key;
+			FurIntermediates.Add(Key, Intermediates);
+		}
+	}
+
+	FScopeLock Lock(&Intermediates->CriticalSection);
+	if (!Intermediates->bNormalsBuilt)
+	{
+		InUnpackNormals(Intermediates->Normals);
+		Intermediates->bNormalsBuilt = true;
+	}
+	Normals = Intermediates->Normals;
+}
+
+void FFurData::InvalidateIntermediates()
+{
+	if (!Intermediates.IsValid())
+		return;
+
+	// other fur data of the edited asset may have registered fresh intermediates already
+	FScopeLock Lock(&FurIntermediatesCS);
+	if (FurIntermediates.FindRef(Intermediates->Key).Pin() == Intermediates)
+		FurIntermediates.Remove(Intermediates->Key);
+	Intermediates.Reset();
+}
+
+#if WITH_EDITORONLY_DATA
+void FFurData::RequestEditBuild(BuildType InBuild, bool InRegenerateSplines)
+{
+	check(IsInGameThread());
+	if (EvictIfReleased())
+		return;
+	if (!PendingEditBuild.Build.IsSet() || PendingEditBuild.Build.GetValue() < InBuild)
+		PendingEditBuild.Build = InBuild;
+	PendingEditBuild.bRegenerateSplines |= InRegenerateSplines;
+	PendingEditBuild.CombedVertices.Reset();
+	FFurBuildScheduler::Get().EnqueueEdit(this);
+}
+
+void FFurData::RequestEditBuild(const TArray<uint32>& InCombedVertices)
+{
+	check(IsInGameThread());
+	if (EvictIfReleased())
+		return;
+	if (!PendingEditBuild.Build.IsSet())
+		PendingEditBuild.CombedVertices.Append(InCombedVertices);
+	FFurBuildScheduler::Get().EnqueueEdit(this);
+}
+#endif // WITH_EDITORONLY_DATA
+
+void FFurData::GenerateSplineMap(const FPositionVertexBuffer& InPositions, TFunctionRef<void(TArray<float>&)> InCalcVertexDistances)
+{
+	check(Intermediates.IsValid());
+	const uint32 SourceVertexCount = InPositions.GetNumVertices();
+	{
+		FScopeLock Lock(&Intermediates->CriticalSection);
+		if (!Intermediates->bSplinesBuilt)
+		{
+			BuildSplineIntermediates(*Intermediates, InPositions);
+
+			TArray<float> VertexDistSquared;
+			InCalcVertexDistances(VertexDistSquared);
+			for (uint32 i = 0; i < SourceVertexCount; i++)
+			{
+				Intermediates->MaxVertexDistSquared = FMath::Max(Intermediates->MaxVertexDistSquared, VertexDistSquared[i]);
+				if (Intermediates->SplineMap.Num() && Intermediates->SplineMap[i] >= 0)
+					Intermediates->MaxSplineVertexDistSquared = FMath::Max(Intermediates->MaxSplineVertexDistSquared, VertexDistSquared[i]);
+			}
+			Intermediates->bSplinesBuilt = true;
+		}
+	}
+
+	SplineMap = Intermediates->SplineMap;
 	VertexRemap.Reset();
 	if (FurSplinesUsed)
+	{
+		CurrentMinFurLength = FMath::Sqrt(Intermediates->MinSplineLengthSquared) * FurLength;
+		if (CurrentMinFurLength < MinFurLength)
+			CurrentMinFurLength = MinFurLength;
+		CurrentMaxFurLength = FMath::Sqrt(Intermediates->MaxSplineLengthSquared) * FurLength;
+
+		if (RemoveFacesWithoutSplines)
+		{
+			VertexRemap.AddUninitialized(SourceVertexCount);
+			VertexCountPerLayer = Intermediates->SplineVertexCount;
+		}
+		else
+		{
+			VertexCountPerLayer = SourceVertexCount;
+		}
+	}
+	else
+	{
+		VertexCountPerLayer = SourceVertexCount;
+	}
+
+	// only the vertices that get fur count
+	MaxVertexBoneDistance = FMath::Sqrt(FurSplinesUsed && RemoveFacesWithoutSplines ? Intermediates->MaxSplineVertexDistSquared : Intermediates->MaxVertexDistSquared);
+}
+
+void FFurData::BuildSplineIntermediates(FFurBuildIntermediates& OutIntermediates, const FPositionVertexBuffer& InPositions) const
+{
+	TArray<int32>& SplineMap = OutIntermediates.SplineMap;
+	const TArray<FVector>& Normals = OutIntermediates.Normals;
+	SplineMap.Reset();
+	if (FurSplinesUsed)
 	{
 		uint32 SourceVertexCount = InPositions.GetNumVertices();
 		int32 SplineCount = FurSplinesUsed->SplineCount();
@@ -299,28 +863,537 @@ void FFurData::GenerateSplineMap(const FPositionVertexBuffer& InPositions)
 				ValidVertexCount++;
 			}
 		}
-		CurrentMinFurLength = FMath::Sqrt(MinLenSquared) * FurLength;
-		if (CurrentMinFurLength < MinFurLength)
-			CurrentMinFurLength = MinFurLength;
-		CurrentMaxFurLength = FMath::Sqrt(MaxLenSquared) * FurLength;
+		OutIntermediates.SplineVertexCount = ValidVertexCount;
+		OutIntermediates.MinSplineLengthSquared = MinLenSquared;
+		OutIntermediates.MaxSplineLengthSquared = MaxLenSquared;
+		CalcSplineLengths(OutIntermediates.SplineLengths);
+	}
+}
 
-		if (RemoveFacesWithoutSplines)
+void FFurData::RebaseSectionIndices(FFurIndexBuffer::FIndexArray& InOutIndices, FSection& InOutSection, uint32 InEndIndex) const
+{
+	// Relative indices let most sections use 16 bit indices. Procedural shells keep absolute indices,
+	// their profiles are looked up by the vertex id, which doesn't include the base vertex on every platform.
+	int32 MinIndex = MAX_int32;
+	int32 MaxIndex = -1;
+	for (uint32 i = InOutSection.BaseIndex; i < InEndIndex; i++)
+	{
+		MinIndex = FMath::Min(MinIndex, InOutIndices[i]);
+		MaxIndex = FMath::Max(MaxIndex, InOutIndices[i]);
+	}
+	if (MaxIndex < 0)
+	{
+		InOutSection.BaseVertexIndex = InOutSection.MinVertexIndex;
+		InOutSection.NumIndexedVertices = 0;
+		return;
+	}
+	if (bProceduralShells)
+		MinIndex = 0;
+
+	InOutSection.BaseVertexIndex = MinIndex;
+	InOutSection.NumIndexedVertices = MaxIndex - MinIndex + 1;
+	if (MinIndex > 0)
+	{
+		for (uint32 i = InOutSection.BaseIndex; i < InEndIndex; i++)
+			InOutIndices[i] -= MinIndex;
+	}
+}
+
+void FFurData::GatherSectionIndices(TArray<uint32>& OutIndices, const TArray<uint32>& InSourceIndices, uint32 InFirstIndex, uint32 InNumTriangles) const
+{
+	OutIndices.Reset(InNumTriangles * 3);
+	if (FurSplinesUsed && RemoveFacesWithoutSplines)
+	{
+		for (uint32 t = 0; t < InNumTriangles; ++t)
 		{
-			VertexRemap.AddUninitialized(SourceVertexCount);
-			VertexCountPerLayer = ValidVertexCount;
+			uint32 Idx0 = InSourceIndices[InFirstIndex + t * 3];
+			uint32 Idx1 = InSourceIndices[InFirstIndex + t * 3 + 1];
+			uint32 Idx2 = InSourceIndices[InFirstIndex + t * 3 + 2];
+			if (SplineMap[Idx0] >= 0 && SplineMap[Idx1] >= 0 && SplineMap[Idx2] >= 0)
+			{
+				OutIndices.Add(Idx0);
+				OutIndices.Add(Idx1);
+				OutIndices.Add(Idx2);
+			}
 		}
-		else
+	}
+	else
+	{
+		OutIndices.Append(InSourceIndices.GetData() + InFirstIndex, InNumTriangles * 3);
+	}
+}
+
+/** FIFO post-transform vertex cache simulation */
+static uint32 CountVertexCacheMisses(const TArray<uint32>& InIndices, int32 InCacheSize)
+{
+	TArray<uint32, TInlineAllocator<64>> Cache;
+	Cache.Init(MAX_uint32, InCacheSize);
+	int32 Head = 0;
+	uint32 Misses = 0;
+	for (uint32 VertexIndex : InIndices)
+	{
+		if (!Cache.Contains(VertexIndex))
 		{
-			VertexCountPerLayer = SourceVertexCount;
+			Cache[Head] = VertexIndex;
+			Head = (Head + 1) % InCacheSize;
+			Misses++;
+		}
+	}
+	return Misses;
+}
+
+void FFurData::OptimizeTriangleOrder(TArray<uint32>& InOutIndices, const FPositionVertexBuffer& InPositions, FFurTriangleOrderStats& InOutStats) const
+{
+	const int32 Mode = CVarFurOptimizeTriangleOrder.GetValueOnAnyThread();
+	const int32 CacheSize = FMath::Clamp(CVarFurOptimizeTriangleOrderCacheSize.GetValueOnAnyThread(), 4, 64);
+	const int32 NumTriangles = InOutIndices.Num() / 3;
+	const uint32 MissesBefore = CountVertexCacheMisses(InOutIndices, CacheSize);
+	InOutStats.NumTriangles += NumTriangles;
+	InOutStats.CacheMissesBefore += MissesBefore;
+	if (Mode <= 0 || NumTriangles < 2)
+	{
+		InOutStats.CacheMissesAfter += MissesBefore;
+		return;
+	}
+
+	// Tipsify, Sander et al. 2007: fan around the vertex most likely to still be in the cache, jump to a recent dead end vertex when stuck
+	uint32 MinVertex = MAX_uint32;
+	uint32 MaxVertex = 0;
+	for (uint32 VertexIndex : InOutIndices)
+	{
+		MinVertex = FMath::Min(MinVertex, VertexIndex);
+		MaxVertex = FMath::Max(MaxVertex, VertexIndex);
+	}
+	const int32 NumVertices = MaxVertex - MinVertex + 1;
+
+	// triangles of every vertex
+	TArray<int32> AdjacencyOffsets;
+	AdjacencyOffsets.SetNumZeroed(NumVertices + 1);
+	for (uint32 VertexIndex : InOutIndices)
+		AdjacencyOffsets[VertexIndex - MinVertex + 1]++;
+	for (int32 i = 0; i < NumVertices; i++)
+		AdjacencyOffsets[i + 1] += AdjacencyOffsets[i];
+	TArray<int32> LiveTriangles;
+	LiveTriangles.SetNumUninitialized(NumVertices);
+	TArray<int32> Adjacency;
+	Adjacency.SetNumUninitialized(InOutIndices.Num());
+	for (int32 i = 0; i < NumVertices; i++)
+		LiveTriangles[i] = 0;
+	for (int32 i = 0; i < InOutIndices.Num(); i++)
+	{
+		int32 Vertex = InOutIndices[i] - MinVertex;
+		Adjacency[AdjacencyOffsets[Vertex] + LiveTriangles[Vertex]++] = i / 3;
+	}
+
+	TArray<int32> CacheTime;
+	CacheTime.SetNumZeroed(NumVertices);
+	TBitArray<> Emitted(false, NumTriangles);
+	TArray<int32> DeadEnds;
+	TArray<int32> Candidates;
+	TArray<uint32> Output;
+	Output.Reserve(InOutIndices.Num());
+	// output triangle where a cluster of the overdraw pass starts
+	TArray<int32> ClusterStarts;
+	ClusterStarts.Add(0);
+
+	int32 Time = CacheSize + 1;
+	int32 Cursor = 0;
+	while (LiveTriangles[Cursor] == 0)
+		Cursor++;
+	int32 Fanning = Cursor;
+	while (Fanning >= 0)
+	{
+		Candidates.Reset();
+		for (int32 a = AdjacencyOffsets[Fanning]; a < AdjacencyOffsets[Fanning + 1]; a++)
+		{
+			int32 Triangle = Adjacency[a];
+			if (Emitted[Triangle])
+				continue;
+			Emitted[Triangle] = true;
+			for (int32 k = 0; k < 3; k++)
+			{
+				uint32 VertexIndex = InOutIndices[Triangle * 3 + k];
+				int32 Vertex = VertexIndex - MinVertex;
+				Output.Add(VertexIndex);
+				DeadEnds.Add(Vertex);
+				Candidates.Add(Vertex);
+				LiveTriangles[Vertex]--;
+				if (Time - CacheTime[Vertex] > CacheSize)
+					CacheTime[Vertex] = Time++;
+			}
+		}
+
+		// prefer the vertex that stays in the cache while its remaining triangles are emitted
+		int32 Next = -1;
+		int32 BestPriority = -1;
+		for (int32 Vertex : Candidates)
+		{
+			if (LiveTriangles[Vertex] <= 0)
+				continue;
+			int32 Priority = 0;
+			if (Time - CacheTime[Vertex] + 2 * LiveTriangles[Vertex] <= CacheSize)
+				Priority = Time - CacheTime[Vertex];
+			if (Priority > BestPriority)
+			{
+				BestPriority = Priority;
+				Next = Vertex;
+			}
+		}
+		if (Next == -1)
+		{
+			while (DeadEnds.Num() && Next == -1)
+			{
+				int32 Vertex = DeadEnds.Pop(EAllowShrinking::No);
+				if (LiveTriangles[Vertex] > 0)
+					Next = Vertex;
+			}
+			while (Next == -1 && Cursor < NumVertices)
+			{
+				if (LiveTriangles[Cursor] > 0)
+					Next = Cursor;
+				else
+					Cursor++;
+			}
+			if (Next != -1)
+				ClusterStarts.Add(Output.Num() / 3);
+		}
+		Fanning = Next;
+	}
+	check(Output.Num() == InOutIndices.Num());
+
+	if (Mode >= 2 && ClusterStarts.Num() > 1)
+	{
+		// Draw the clusters facing away from the center of the section first, they occlude the inner ones (Sander et al. 2007)
+		struct FCluster
+		{
+			int32 FirstTriangle;
+			int32 NumTriangles;
+			float SortKey;
+		};
+		TArray<FCluster> Clusters;
+		TArray<FVector3f> Centroids;
+		TArray<FVector3f> ClusterNormals;
+		FVector3f MeshCentroid = FVector3f::ZeroVector;
+		float MeshArea = 0.0f;
+		for (int32 c = 0; c < ClusterStarts.Num(); c++)
+		{
+			FCluster& Cluster = Clusters.AddDefaulted_GetRef();
+			Cluster.FirstTriangle = ClusterStarts[c];
+			Cluster.NumTriangles = (c + 1 < ClusterStarts.Num() ? ClusterStarts[c + 1] : NumTriangles) - Cluster.FirstTriangle;
+
+			FVector3f Centroid = FVector3f::ZeroVector;
+			FVector3f Normal = FVector3f::ZeroVector;
+			float Area = 0.0f;
+			for (int32 t = Cluster.FirstTriangle; t < Cluster.FirstTriangle + Cluster.NumTriangles; t++)
+			{
+				const FVector3f& P0 = InPositions.VertexPosition(Output[t * 3]);
+				const FVector3f& P1 = InPositions.VertexPosition(Output[t * 3 + 1]);
+				const FVector3f& P2 = InPositions.VertexPosition(Output[t * 3 + 2]);
+				FVector3f FaceNormal = FVector3f::CrossProduct(P2 - P0, P1 - P0);
+				float FaceArea = FaceNormal.Size();
+				Centroid += (P0 + P1 + P2) * (FaceArea / 3.0f);
+				Normal += FaceNormal;
+				Area += FaceArea;
+			}
+			MeshCentroid += Centroid;
+			MeshArea += Area;
+			Centroids.Add(Area > 0.0f ? Centroid / Area : InPositions.VertexPosition(Output[Cluster.FirstTriangle * 3]));
+			ClusterNormals.Add(Normal.GetSafeNormal());
 		}
+		if (MeshArea > 0.0f)
+			MeshCentroid /= MeshArea;
+		for (int32 c = 0; c < Clusters.Num(); c++)
+			Clusters[c].SortKey = FVector3f::DotProduct(Centroids[c] - MeshCentroid, ClusterNormals[c]);
+		Clusters.StableSort([](const FCluster& A, const FCluster& B) { return A.SortKey > B.SortKey; });
+
+		TArray<uint32> Sorted;
+		Sorted.Reserve(Output.Num());
+		for (const FCluster& Cluster : Clusters)
+			Sorted.Append(Output.GetData() + Cluster.FirstTriangle * 3, Cluster.NumTriangles * 3);
+		Output = MoveTemp(Sorted);
+	}
+
+	const uint32 MissesAfter = CountVertexCacheMisses(Output, CacheSize);
+	// the overdraw order trades some cache efficiency, the plain vertex cache order never keeps a worse order
+	if (MissesAfter < MissesBefore || Mode >= 2)
+	{
+		InOutIndices = MoveTemp(Output);
+		InOutStats.CacheMissesAfter += MissesAfter;
+	}
+	else
+	{
+		InOutStats.CacheMissesAfter += MissesBefore;
+	}
+}
+
+void FFurData::ReportTriangleOrder(const FFurTriangleOrderStats& InStats) const
+{
+	if (InStats.NumTriangles == 0)
+		return;
+	// every layer is drawn with the same index order, the ratio applies to each of them
+	UE_LOG(LogGFur, Verbose, TEXT("gFur LOD %d: %u triangles per layer, %d layers, ACMR %.3f -> %.3f"),
+		Lod, InStats.NumTriangles, FurLayerCount,
+		InStats.CacheMissesBefore / float(InStats.NumTriangles), InStats.CacheMissesAfter / float(InStats.NumTriangles));
+}
+
+#if WITH_EDITOR
+FString FFurData::BuildDerivedDataKey(FSHA1& InOutGrowMeshHash) const
+{
+	if (CVarFurDerivedDataCache.GetValueOnAnyThread() == 0)
+		return FString();
+
+	auto HashValue = [&InOutGrowMeshHash](const auto& Value) { InOutGrowMeshHash.Update((const uint8*)&Value, sizeof(Value)); };
+	HashValue(Lod);
+	HashValue(FurLayerCount);
+	HashValue(FurLength);
+	HashValue(ShellBias);
+	HashValue(HairLengthForceUniformity);
+	HashValue(MinFurLength);
+	HashValue(NoiseStrength);
+	HashValue(NoiseSeed);
+	HashValue(RemoveFacesWithoutSplines);
+	HashValue(ReferenceGrowMeshVertices);
+	HashValue(CompactVertexFormat);
+	HashValue(ProceduralShells);
+	HashValue(ProgressiveLayers);
+	// the vertex format and the triangle order don't depend on the parameters alone
+	HashValue(bUseHighPrecisionTangentBasis);
+	HashValue(bUseFullPrecisionUVs);
+	HashValue(bUseCompactVertexFormat);
+	HashValue(bGrowMeshFetch);
+	HashValue(bProceduralShells);
+	HashValue(bLinearShells);
+	HashValue(CVarFurOptimizeTriangleOrder.GetValueOnAnyThread());
+	HashValue(CVarFurOptimizeTriangleOrderCacheSize.GetValueOnAnyThread());
+
+	// generated splines are hashed by their content as well, guide mesh changes then don't need their own key
+	if (FurSplinesUsed)
+	{
+		HashValue(FurSplinesUsed->ControlPointCount);
+		HashValue(FurSplinesUsed->Threshold);
+		InOutGrowMeshHash.Update((const uint8*)FurSplinesUsed->Vertices.GetData(), FurSplinesUsed->Vertices.Num() * sizeof(FVector));
 	}
 	else
 	{
-		VertexCountPerLayer = InPositions.GetNumVertices();
+		HashValue(INDEX_NONE);
+	}
+
+	InOutGrowMeshHash.Final();
+	FSHAHash Hash;
+	InOutGrowMeshHash.GetHash(Hash.Hash);
+	return FDerivedDataCacheInterface::BuildCacheKey(TEXT("GFUR"), FURDATA_DERIVEDDATA_VER, *Hash.ToString());
+}
+
+bool FFurData::LoadDerivedData(const FString& InKey, uint32 InVertexSize)
+{
+	if (InKey.IsEmpty())
+		return false;
+
+	TArray<uint8> DerivedData;
+	if (!GetDerivedDataCacheRef().GetSynchronous(*InKey, DerivedData, TEXT("gFur")))
+		return false;
+
+	FMemoryReader Ar(DerivedData, true);
+	return LoadBuiltData(Ar, InVertexSize);
+}
+
+void FFurData::SaveDerivedData(const FString& InKey) const
+{
+	if (InKey.IsEmpty())
+		return;
+
+	TArray<uint8> DerivedData;
+	FMemoryWriter Ar(DerivedData, true);
+	SaveBuiltData(Ar);
+	GetDerivedDataCacheRef().Put(*InKey, DerivedData, TEXT("gFur"));
+}
+
+void FFurData::SaveCookedData(TArray<uint8>& OutPayload, const FString& InOwnerName) const
+{
+	FMemoryWriter Ar(OutPayload, true);
+	SaveBuiltData(Ar);
+
+	const uint64 VertexDataSize = VertexBuffer.GetStagingData().Num();
+	const uint64 ProfileDataSize = bProceduralShells ? ProfileBuffer.GetStagingData().Num() * sizeof(FVector4f) : 0;
+	const uint64 IndexDataSize = IndexBuffer.GetStagingData().Num() * sizeof(int32);
+	UE_LOG(LogGFur, Verbose, TEXT("gFur cooked %s LOD %d: %d layers, %u vertices, vertices %.1f KiB, profiles %.1f KiB, indices %.1f KiB, payload %.1f KiB"),
+		*InOwnerName, Lod, FurLayerCount, VertexCountPerLayer * GetVertexLayerCount(),
+		VertexDataSize / 1024.0, ProfileDataSize / 1024.0, IndexDataSize / 1024.0, OutPayload.Num() / 1024.0);
+}
+
+void FFurData::SaveBuiltData(FArchive& Ar) const
+{
+	// the header is checked against the vertex format resolved by the loading build first
+	int32 Version = BuiltDataVersion;
+	uint32 SavedVertexSize = VertexBuffer.GetVertexSize();
+	int32 SavedVertexLayerCount = GetVertexLayerCount();
+	bool bSavedGrowMeshFetch = bGrowMeshFetch;
+	bool bSavedProceduralShells = bProceduralShells;
+	Ar << Version;
+	Ar << SavedVertexSize;
+	Ar << SavedVertexLayerCount;
+	Ar << bSavedGrowMeshFetch;
+	Ar << bSavedProceduralShells;
+
+	Ar << const_cast<uint32&>(VertexCountPerLayer);
+	Ar << const_cast<float&>(CurrentMinFurLength);
+	Ar << const_cast<float&>(CurrentMaxFurLength);
+	Ar << const_cast<float&>(MaxVertexBoneDistance);
+	Ar << const_cast<TArray<int32>&>(SplineMap);
+	Ar << const_cast<TArray<uint32>&>(VertexRemap);
+
+	int32 NumSections = TempSections.Num();
+	Ar << NumSections;
+	Ar.Serialize(const_cast<FSection*>(TempSections.GetData()), NumSections * sizeof(FSection));
+
+	const auto& Vertices = VertexBuffer.GetStagingData();
+	uint32 SavedVertexDataSize = Vertices.Num();
+	Ar << SavedVertexDataSize;
+	Ar.Serialize(const_cast<uint8*>(Vertices.GetData()), SavedVertexDataSize);
+
+	if (bProceduralShells)
+	{
+		const auto& Profiles = ProfileBuffer.GetStagingData();
+		uint32 ProfileStride = ProfileBuffer.GetStagingStride();
+		int32 NumProfiles = Profiles.Num();
+		Ar << ProfileStride;
+		Ar << NumProfiles;
+		Ar.Serialize(const_cast<FVector4f*>(Profiles.GetData()), NumProfiles * sizeof(FVector4f));
+	}
+
+	const auto& Indices = IndexBuffer.GetStagingData();
+	int32 NumIndices = Indices.Num();
+	Ar << NumIndices;
+	Ar.Serialize(const_cast<int32*>(Indices.GetData()), NumIndices * sizeof(int32));
+}
+#endif // WITH_EDITOR
+
+bool FFurData::LoadCookedData(uint32 InVertexSize)
+{
+	if (!CookedData.IsValid())
+		return false;
+
+	// the loaded copy is discarded, a recreated render state reads the payload from disk again
+	void* Payload = nullptr;
+	const int64 PayloadSize = CookedData->GetBulkDataSize();
+	CookedData->GetCopy(&Payload, true);
+	CookedData.Reset();
+	if (Payload == nullptr)
+		return false;
+
+	FMemoryReaderView Ar(MakeArrayView((const uint8*)Payload, PayloadSize), true);
+	const bool bLoaded = LoadBuiltData(Ar, InVertexSize);
+	FMemory::Free(Payload);
+#if !WITH_EDITORONLY_DATA
+	SplineMap.Empty();
+	VertexRemap.Empty();
+#endif // WITH_EDITORONLY_DATA
+	if (!bLoaded)
+		UE_LOG(LogGFur, Warning, TEXT("gFur LOD %d: cooked fur doesn't match the vertex format of this platform, generating it instead"), Lod);
+	return bLoaded;
+}
+
+bool FFurData::LoadBuiltData(FArchive& Ar, uint32 InVertexSize)
+{
+	int32 Version = 0;
+	uint32 LoadedVertexSize = 0;
+	int32 LoadedVertexLayerCount = 0;
+	bool bLoadedGrowMeshFetch = false;
+	bool bLoadedProceduralShells = false;
+	Ar << Version;
+	Ar << LoadedVertexSize;
+	Ar << LoadedVertexLayerCount;
+	Ar << bLoadedGrowMeshFetch;
+	Ar << bLoadedProceduralShells;
+	if (Ar.IsError() || Version != BuiltDataVersion || LoadedVertexSize != InVertexSize || LoadedVertexLayerCount != GetVertexLayerCount()
+		|| bLoadedGrowMeshFetch != bGrowMeshFetch || bLoadedProceduralShells != bProceduralShells)
+		return false;
+
+	// the payload is read from disk, every size is checked before the buffers are written and uploaded
+	const int64 TotalSize = Ar.TotalSize();
+	auto CanRead = [&Ar, TotalSize](uint64 InSize) { return !Ar.IsError() && InSize <= uint64(TotalSize - Ar.Tell()); };
+
+	Ar << VertexCountPerLayer;
+	Ar << CurrentMinFurLength;
+	Ar << CurrentMaxFurLength;
+	Ar << MaxVertexBoneDistance;
+	Ar << SplineMap;
+	Ar << VertexRemap;
+
+	int32 NumSections = 0;
+	Ar << NumSections;
+	if (NumSections < 0 || !CanRead(uint64(NumSections) * sizeof(FSection)))
+		return false;
+	TempSections.SetNumUninitialized(NumSections);
+	Ar.Serialize(TempSections.GetData(), NumSections * sizeof(FSection));
+
+	const uint64 NewVertexCount = uint64(VertexCountPerLayer) * GetVertexLayerCount();
+	uint32 LoadedVertexDataSize = 0;
+	Ar << LoadedVertexDataSize;
+	const int64 VertexDataOffset = Ar.Tell();
+	if (LoadedVertexDataSize != NewVertexCount * LoadedVertexSize || !CanRead(LoadedVertexDataSize))
+		return false;
+	Ar.Seek(VertexDataOffset + LoadedVertexDataSize);
+
+	uint32 ProfileStride = 1;
+	int32 NumProfiles = 0;
+	int64 ProfileDataOffset = 0;
+	if (bProceduralShells)
+	{
+		Ar << ProfileStride;
+		Ar << NumProfiles;
+		ProfileDataOffset = Ar.Tell();
+		if (ProfileStride == 0 || NumProfiles < 0 || uint64(NumProfiles) != NewVertexCount * ProfileStride || !CanRead(uint64(NumProfiles) * sizeof(FVector4f)))
+			return false;
+		Ar.Seek(ProfileDataOffset + int64(NumProfiles) * sizeof(FVector4f));
+	}
+
+	int32 NumIndices = 0;
+	Ar << NumIndices;
+	const int64 IndexDataOffset = Ar.Tell();
+	if (NumIndices < 0 || !CanRead(uint64(NumIndices) * sizeof(int32)))
+		return false;
+	for (const FSection& Section : TempSections)
+	{
+		if (uint64(Section.BaseIndex) + uint64(Section.NumTriangles) * 3 > uint64(NumIndices)
+			|| (Section.NumTriangles > 0 && (Section.MinVertexIndex > Section.MaxVertexIndex || Section.MaxVertexIndex >= NewVertexCount)))
+			return false;
 	}
+
+	Ar.Seek(VertexDataOffset);
+	Ar.Serialize(VertexBuffer.Lock(VertexCountPerLayer * GetVertexLayerCount(), LoadedVertexSize), LoadedVertexDataSize);
+	VertexBuffer.Unlock();
+
+	if (bProceduralShells)
+	{
+		Ar.Seek(ProfileDataOffset);
+		Ar.Serialize(ProfileBuffer.Lock(VertexCountPerLayer, ProfileStride), NumProfiles * sizeof(FVector4f));
+		ProfileBuffer.Unlock();
+	}
+
+	Ar.Seek(IndexDataOffset);
+	auto& Indices = IndexBuffer.Lock();
+	Indices.SetNumUninitialized(NumIndices);
+	Ar.Serialize(Indices.GetData(), NumIndices * sizeof(int32));
+	IndexBuffer.Unlock();
+	if (Ar.IsError())
+		return false;
+
+	OldFurLayerCount = GetVertexLayerCount();
+	OldRemoveFacesWithoutSplines = RemoveFacesWithoutSplines;
+	ENQUEUE_RENDER_COMMAND(UpdateDataCommand)([this, NewSections = TempSections, NewVertexCount](FRHICommandListImmediate& RHICmdList) {
+		Sections = NewSections;
+		VertexCount = uint32(NewVertexCount);
+	});
+	return true;
 }
 
-FFurData::FFurGenLayerData FFurData::CalcFurGenLayerData(int32 Layer)
+bool FFurData::UseParallelBuild(uint32 InVertexCount) const
+{
+	return CVarFurParallelBuild.GetValueOnAnyThread() != 0 && InVertexCount >= (uint32)FMath::Max(CVarFurParallelBuildMinVertices.GetValueOnAnyThread(), 1);
+}
+
+FFurData::FFurGenLayerData FFurData::CalcFurGenLayerData(int32 Layer) const
 {
 	FFurGenLayerData Data;
 	Data.LinearFactor = Layer / (float)FurLayerCount;
@@ -337,35 +1410,64 @@ FFurData::FFurGenLayerData FFurData::CalcFurGenLayerData(int32 Layer)
 		Derivative = 1.0f;
 	}
 	Data.LayerNoiseStrength = Derivative * NoiseStrength;
+	Data.Layer = Layer;
 	return Data;
 }
 
-void FFurData::GenerateFurLengths(TArray<float>& FurLengths)
+void FFurData::CalcSplineLengths(TArray<float>& OutSplineLengths) const
 {
-	if (FurSplinesUsed)
+	int32 ControlPointCount = FurSplinesUsed->ControlPointCount;
+	OutSplineLengths.SetNumUninitialized(FurSplinesUsed->SplineCount());
+	for (int32 SplineIndex = 0, SplineCount = FurSplinesUsed->SplineCount(); SplineIndex < SplineCount; SplineIndex++)
 	{
-		int32 ControlPointCount = FurSplinesUsed->ControlPointCount;
-		FurLengths.AddUninitialized(FurSplinesUsed->SplineCount());
-		for (int32 SplineIndex = 0, SplineCount = FurSplinesUsed->SplineCount(); SplineIndex < SplineCount; SplineIndex++)
+		float Length = 0.0f;
+		FVector Prev = FurSplinesUsed->Vertices[SplineIndex * ControlPointCount];
+		for (int32 ControlPointIndex = 1; ControlPointIndex < ControlPointCount; ControlPointIndex++)
 		{
-			float Length = 0.0f;
-			FVector Prev = FurSplinesUsed->Vertices[SplineIndex * ControlPointCount];
-			for (int32 ControlPointIndex = 1; ControlPointIndex < ControlPointCount; ControlPointIndex++)
-			{
-				FVector Point = FurSplinesUsed->Vertices[SplineIndex * ControlPointCount + ControlPointIndex];
-				Length += FVector::Dist(Point, Prev);
-				Prev = Point;
-			}
-			FurLengths[SplineIndex] = FMath::Max(Length * FurLength, MinFurLength);
+			FVector Point = FurSplinesUsed->Vertices[SplineIndex * ControlPointCount + ControlPointIndex];
+			Length += FVector::Dist(Point, Prev);
+			Prev = Point;
 		}
+		OutSplineLengths[SplineIndex] = Length;
 	}
 }
 
-void FFurData::GenerateFurVertex(FVector3f& OutFurOffset, FVector2f& OutUv1, FVector2f& OutUv2, FVector2f& OutUv3, const FVector3f& InTangentZ, float InFurLength, const FFurGenLayerData& InGenLayerData)
+void FFurData::GenerateFurLengths(TArray<float>& FurLengths)
+{
+	if (FurSplinesUsed)
+	{
+		// incremental builds of combed splines invalidated the shared lengths
+		TArray<float> LocalSplineLengths;
+		const bool bShared = Intermediates.IsValid() && Intermediates->bSplinesBuilt;
+		if (!bShared)
+			CalcSplineLengths(LocalSplineLengths);
+		const TArray<float>& SplineLengths = bShared ? Intermediates->SplineLengths : LocalSplineLengths;
+
+		FurLengths.AddUninitialized(SplineLengths.Num());
+		for (int32 SplineIndex = 0; SplineIndex < SplineLengths.Num(); SplineIndex++)
+			FurLengths[SplineIndex] = FMath::Max(SplineLengths[SplineIndex] * FurLength, MinFurLength);
+	}
+}
+
+float FFurData::GenerateNoise(uint32 InSrcVertexIndex, const FFurGenLayerData& InGenLayerData) const
+{
+	// Stateless hash of (source vertex, layer, seed), the noise doesn't depend on the order in which the vertices are generated
+	uint32 Hash = InSrcVertexIndex * 0x9E3779B1u ^ uint32(InGenLayerData.Layer) * 0x85EBCA77u ^ uint32(NoiseSeed) * 0xC2B2AE3Du;
+	Hash ^= Hash >> 16;
+	Hash *= 0x85EBCA6Bu;
+	Hash ^= Hash >> 13;
+	Hash *= 0xC2B2AE35u;
+	Hash ^= Hash >> 16;
+	float Random = (Hash >> 8) * (1.0f / 16777215.0f);
+	return (Random * 2.0f - 1.0f) * InGenLayerData.LayerNoiseStrength;
+}
+
+void FFurData::GenerateFurVertex(FVector3f& OutFurOffset, FVector2f& OutUv1, FVector2f& OutUv2, FVector2f& OutUv3, uint32 InSrcVertexIndex, const FVector3f& InTangentZ, float InFurLength, const FFurGenLayerData& InGenLayerData)
 {
 	OutUv1.X = InGenLayerData.NonLinearFactor * FurLength;
-	float r = InGenLayerData.LayerNoiseStrength != 0 ? FMath::RandRange(-InGenLayerData.LayerNoiseStrength, InGenLayerData.LayerNoiseStrength) : 0;
-	OutFurOffset = InTangentZ * (InGenLayerData.NonLinearFactor * FurLength + r);
+	float r = InGenLayerData.LayerNoiseStrength != 0 ? GenerateNoise(InSrcVertexIndex, InGenLayerData) : 0;
+	// GetFurLayer in GFurShells.ush adds the biased offset along the normal to the unit noise of the linear shells
+	OutFurOffset = InTangentZ * (bLinearShells ? r : InGenLayerData.NonLinearFactor * FurLength + r);
 
 	if (HairLengthForceUniformity > 0)
 	{
@@ -387,7 +1489,7 @@ void FFurData::GenerateFurVertex(FVector3f& OutFurOffset, FVector2f& OutUv1, FVe
 	OutUv3.X = Lod;
 }
 
-void FFurData::GenerateFurVertex(FVector3f& OutFurOffset, FVector2f& OutUv1, FVector2f& OutUv2, FVector2f& OutUv3, const FVector3f& InTangentZ, float InFurLength, const FFurGenLayerData& InGenLayerData, int32 InSplineIndex)
+void FFurData::GenerateFurVertex(FVector3f& OutFurOffset, FVector2f& OutUv1, FVector2f& OutUv2, FVector2f& OutUv3, uint32 InSrcVertexIndex, const FVector3f& InTangentZ, float InFurLength, const FFurGenLayerData& InGenLayerData, int32 InSplineIndex)
 {
 	if (InSplineIndex >= 0)
 	{
@@ -426,7 +1528,7 @@ void FFurData::GenerateFurVertex(FVector3f& OutFurOffset, FVector2f& OutUv1, FVe
 		}
 		if (InGenLayerData.LayerNoiseStrength != 0)
 		{
-			float r = FMath::RandRange(-InGenLayerData.LayerNoiseStrength, InGenLayerData.LayerNoiseStrength);
+			float r = GenerateNoise(InSrcVertexIndex, InGenLayerData);
 			OutFurOffset += InTangentZ * r;
 		}
 
@@ -458,3 +1560,364 @@ void FFurData::GenerateFurVertex(FVector3f& OutFurOffset, FVector2f& OutUv1, FVe
 	OutUv2.Y = InFurLength;
 	OutUv3.X = Lod;
 }
+
+void FFurData::BuildFurProfile(FFurProfileSpan& OutSpan, const uint32* InSrcVertexIndices, int32 InCount, const TArray<float>& InFurLengths) const
+{
+	const int32 ControlPointCount = FurSplinesUsed->ControlPointCount;
+	const int32 Num = Align(InCount, 4);
+	OutSpan.Num = Num;
+	OutSpan.ControlPointCount = ControlPointCount;
+	OutSpan.ControlPoints.Reset();
+	OutSpan.ControlPoints.SetNumZeroed(ControlPointCount * 3 * Num);
+	OutSpan.Normals.Reset();
+	OutSpan.Normals.SetNumZeroed(3 * Num);
+	OutSpan.Valid.Reset();
+	OutSpan.Valid.SetNumZeroed(Num);
+	OutSpan.AlongNormal.Reset();
+	OutSpan.AlongNormal.SetNumZeroed(Num);
+	OutSpan.UvScale.Reset();
+	OutSpan.UvScale.SetNumZeroed(Num);
+	OutSpan.Lengths.Reset();
+	OutSpan.Lengths.SetNumZeroed(Num);
+	OutSpan.Noise.Reset();
+	OutSpan.Noise.SetNumZeroed(Num);
+	OutSpan.FurOffsets.SetNumUninitialized(3 * Num);
+	OutSpan.Uv1X.SetNumUninitialized(Num);
+
+	// Length = SplineLength * UniformityScale + UniformityBias, see the scalar GenerateFurVertex
+	float UniformityScale = HairLengthForceUniformity > 0 ? 1.0f - HairLengthForceUniformity : 1.0f + HairLengthForceUniformity;
+	float UniformityBias = HairLengthForceUniformity > 0 ? CurrentMaxFurLength * HairLengthForceUniformity : -CurrentMinFurLength * HairLengthForceUniformity;
+
+	for (int32 Index = 0; Index < InCount; Index++)
+	{
+		uint32 SrcVertexIndex = InSrcVertexIndices[Index];
+		int32 SplineIndex = SplineMap[SrcVertexIndex];
+		const FVector& Normal = Normals[SrcVertexIndex];
+		OutSpan.Normals[Index] = Normal.X;
+		OutSpan.Normals[Num + Index] = Normal.Y;
+		OutSpan.Normals[Num * 2 + Index] = Normal.Z;
+		if (SplineIndex < 0)
+		{
+			check(!RemoveFacesWithoutSplines);
+			OutSpan.AlongNormal[Index] = 1.0f;
+			OutSpan.Lengths[Index] = FurLength;
+			continue;
+		}
+
+		const FVector* Points = &FurSplinesUsed->Vertices[SplineIndex * ControlPointCount];
+		FVector Spline = Points[ControlPointCount - 1] - Points[0];
+		float SplineLength = Spline.Size() * FurLength;
+		float Scale = FurLength;
+		if (FVector::DotProduct(Normal, Spline) <= 0.0f)
+		{
+			OutSpan.AlongNormal[Index] = 1.0f;
+		}
+		else if (SplineLength < MinFurLength)
+		{
+			if (SplineLength >= 0.0001f)
+				Scale *= MinFurLength / SplineLength;
+			else
+				OutSpan.AlongNormal[Index] = 1.0f;
+			SplineLength = MinFurLength;
+		}
+
+		OutSpan.Valid[Index] = 1.0f;
+		OutSpan.UvScale[Index] = (SplineLength * UniformityScale + UniformityBias) / SplineLength;
+		OutSpan.Lengths[Index] = InFurLengths[SplineIndex];
+		for (int32 ControlPointIndex = 0; ControlPointIndex < ControlPointCount; ControlPointIndex++)
+		{
+			FVector Point = (Points[ControlPointIndex] - Points[0]) * Scale;
+			float* Dst = &OutSpan.ControlPoints[ControlPointIndex * 3 * Num + Index];
+			Dst[0] = Point.X;
+			Dst[Num] = Point.Y;
+			Dst[Num * 2] = Point.Z;
+		}
+	}
+}
+
+void FFurData::GenerateProfileLayer(FFurProfileSpan& InOutSpan, const uint32* InSrcVertexIndices, int32 InCount, const FFurGenLayerData& InGenLayerData) const
+{
+	const int32 Num = InOutSpan.Num;
+	const int32 Count = InOutSpan.ControlPointCount;
+
+	if (InGenLayerData.LayerNoiseStrength != 0)
+	{
+		for (int32 Index = 0; Index < InCount; Index++)
+			InOutSpan.Noise[Index] = InOutSpan.Valid[Index] != 0.0f ? GenerateNoise(InSrcVertexIndices[Index], InGenLayerData) : 0.0f;
+	}
+
+	float Bias = InGenLayerData.NonLinearFactor * (Count - 1);
+	int Bottom = (int)Bias;
+	int Top = (int)ceilf(Bias);
+	float Height = Bias - Bottom;
+
+	const float* BottomPoints = &InOutSpan.ControlPoints[Bottom * 3 * Num];
+	const float* TopPoints = &InOutSpan.ControlPoints[Top * 3 * Num];
+	const float* SpanNormals = InOutSpan.Normals.GetData();
+	float* FurOffsets = InOutSpan.FurOffsets.GetData();
+
+	const VectorRegister4Float Zero = VectorZeroFloat();
+	const VectorRegister4Float VHeight = VectorSetFloat1(Height);
+	const VectorRegister4Float VInvHeight = VectorSetFloat1(1.0f - Height);
+	const VectorRegister4Float VNormalOffset = VectorSetFloat1(InGenLayerData.NonLinearFactor * MinFurLength);
+
+	for (int32 Index = 0; Index < Num; Index += 4)
+	{
+		VectorRegister4Float NormalX = VectorLoad(SpanNormals + Index);
+		VectorRegister4Float NormalY = VectorLoad(SpanNormals + Num + Index);
+		VectorRegister4Float NormalZ = VectorLoad(SpanNormals + Num * 2 + Index);
+
+		VectorRegister4Float OffsetX = VectorMultiplyAdd(VectorLoad(TopPoints + Index), VHeight, VectorMultiply(VectorLoad(BottomPoints + Index), VInvHeight));
+		VectorRegister4Float OffsetY = VectorMultiplyAdd(VectorLoad(TopPoints + Num + Index), VHeight, VectorMultiply(VectorLoad(BottomPoints + Num + Index), VInvHeight));
+		VectorRegister4Float OffsetZ = VectorMultiplyAdd(VectorLoad(TopPoints + Num * 2 + Index), VHeight, VectorMultiply(VectorLoad(BottomPoints + Num * 2 + Index), VInvHeight));
+
+		VectorRegister4Float AlongNormal = VectorCompareNE(VectorLoad(InOutSpan.AlongNormal.GetData() + Index), Zero);
+		OffsetX = VectorSelect(AlongNormal, VectorMultiply(NormalX, VNormalOffset), OffsetX);
+		OffsetY = VectorSelect(AlongNormal, VectorMultiply(NormalY, VNormalOffset), OffsetY);
+		OffsetZ = VectorSelect(AlongNormal, VectorMultiply(NormalZ, VNormalOffset), OffsetZ);
+
+		VectorRegister4Float Noise = VectorLoad(InOutSpan.Noise.GetData() + Index);
+		OffsetX = VectorMultiplyAdd(NormalX, Noise, OffsetX);
+		OffsetY = VectorMultiplyAdd(NormalY, Noise, OffsetY);
+		OffsetZ = VectorMultiplyAdd(NormalZ, Noise, OffsetZ);
+
+		VectorRegister4Float Uv1X = VectorSqrt(VectorMultiplyAdd(OffsetZ, OffsetZ, VectorMultiplyAdd(OffsetY, OffsetY, VectorMultiply(OffsetX, OffsetX))));
+		Uv1X = VectorMultiply(Uv1X, VectorLoad(InOutSpan.UvScale.GetData() + Index));
+		Uv1X = VectorSelect(VectorCompareEQ(VectorLoad(InOutSpan.Valid.GetData() + Index), Zero), VNormalOffset, Uv1X);
+
+		VectorStore(OffsetX, FurOffsets + Index);
+		VectorStore(OffsetY, FurOffsets + Num + Index);
+		VectorStore(OffsetZ, FurOffsets + Num * 2 + Index);
+		VectorStore(Uv1X, InOutSpan.Uv1X.GetData() + Index);
+	}
+}
+
+void FFurData::WriteProceduralProfile(FVector4f* OutProfile, const FFurProfileSpan& InSpan, int32 InIndex, uint32 InSrcVertexIndex) const
+{
+	// Header: X > 0 grows along the normal up to X, X == 0 follows the control points.
+	// Y > 0 scales the fur offset length to UV1.X, Y < 0 is the length UV1.X reaches on the tip (no spline).
+	// Z is the fur length (UV2.Y), W the source vertex index hashed for the noise or -1 without noise.
+	if (FurSplinesUsed == nullptr)
+	{
+		float Length;
+		if (HairLengthForceUniformity > 0)
+			Length = FurLength * (1.0f - HairLengthForceUniformity) + CurrentMaxFurLength * HairLengthForceUniformity;
+		else
+			Length = FurLength * (1.0f + HairLengthForceUniformity) - CurrentMinFurLength * HairLengthForceUniformity;
+		OutProfile[0] = FVector4f(FurLength, -Length, FurLength, float(InSrcVertexIndex));
+		return;
+	}
+
+	const int32 Num = InSpan.Num;
+	if (InSpan.Valid[InIndex] == 0.0f)
+		OutProfile[0] = FVector4f(MinFurLength, -MinFurLength, InSpan.Lengths[InIndex], -1.0f);
+	else
+		OutProfile[0] = FVector4f(InSpan.AlongNormal[InIndex] != 0.0f ? MinFurLength : 0.0f, InSpan.UvScale[InIndex], InSpan.Lengths[InIndex], float(InSrcVertexIndex));
+	for (int32 ControlPointIndex = 0; ControlPointIndex < InSpan.ControlPointCount; ControlPointIndex++)
+	{
+		const float* Point = &InSpan.ControlPoints[ControlPointIndex * 3 * Num + InIndex];
+		OutProfile[1 + ControlPointIndex] = FVector4f(Point[0], Point[Num], Point[Num * 2], 0.0f);
+	}
+}
+
+void FFurData::GenerateProceduralFurVertex(FVector3f& OutFurOffset, FVector2f& OutUv1, FVector2f& OutUv2, const FVector4f* InProfile, const FVector3f& InTangentZ, int32 InLayerSlot) const
+{
+	// CPU reference of CalcProceduralFurLayer in GFurShells.ush, keep both in sync
+	const FFurGenLayerData GenLayerData = CalcFurGenLayerData(FurLayerCount - InLayerSlot);
+
+	const FVector4f& Header = InProfile[0];
+	if (Header.X > 0.0f)
+	{
+		OutFurOffset = InTangentZ * (GenLayerData.NonLinearFactor * Header.X);
+	}
+	else
+	{
+		int32 ControlPointCount = GetProceduralProfileStride() - 1;
+		float Bias = GenLayerData.NonLinearFactor * (ControlPointCount - 1);
+		int32 Bottom = (int32)Bias;
+		int32 Top = (int32)ceilf(Bias);
+		float Height = Bias - Bottom;
+		const FVector4f& BottomPoint = InProfile[1 + Bottom];
+		const FVector4f& TopPoint = InProfile[1 + Top];
+		OutFurOffset = FVector3f(BottomPoint.X, BottomPoint.Y, BottomPoint.Z) * (1.0f - Height) + FVector3f(TopPoint.X, TopPoint.Y, TopPoint.Z) * Height;
+	}
+	if (Header.W >= 0.0f && GenLayerData.LayerNoiseStrength != 0)
+		OutFurOffset += InTangentZ * GenerateNoise(uint32(Header.W), GenLayerData);
+
+	OutUv1.X = Header.Y > 0.0f ? OutFurOffset.Size() * Header.Y : GenLayerData.NonLinearFactor * -Header.Y;
+	OutUv1.Y = GenLayerData.NonLinearFactor;
+	OutUv2.X = GenLayerData.LinearFactor;
+	OutUv2.Y = Header.Z;
+}
+
+/** Spline Kernel Benchmark */
+class FFurSplineKernelBenchmark : public FFurData
+{
+public:
+	virtual bool CreateVertexFactories(TArray<FFurVertexFactory*>& VertexFactories, FVertexBuffer* InMorphVertexBuffer, bool InPhysics, ERHIFeatureLevel::Type InFeatureLevel) override { return true; }
+#if WITH_EDITORONLY_DATA
+	virtual TUniqueFunction<void()> PrepareEditBuild() override { return []() {}; }
+	virtual bool EvictIfReleased() override { return false; }
+#endif // WITH_EDITORONLY_DATA
+
+	void Setup(int32 InVertexCount, int32 InControlPointCount, int32 InLayerCount)
+	{
+		UFurSplines* Splines = NewObject<UFurSplines>(GetTransientPackage());
+		Splines->ControlPointCount = InControlPointCount;
+		Splines->Vertices.SetNumUninitialized(InVertexCount * InControlPointCount);
+		Normals.SetNumUninitialized(InVertexCount);
+		SplineMap.SetNumUninitialized(InVertexCount);
+
+		FRandomStream Random(0);
+		for (int32 VertexIndex = 0; VertexIndex < InVertexCount; VertexIndex++)
+		{
+			FVector Root = Random.VRand() * 100.0f;
+			FVector Normal = Random.VRand();
+			FVector Direction = (Normal + Random.VRand() * 0.75f).GetSafeNormal();
+			float Step = Random.FRandRange(0.0f, 1.0f);
+			for (int32 ControlPointIndex = 0; ControlPointIndex < InControlPointCount; ControlPointIndex++)
+				Splines->Vertices[VertexIndex * InControlPointCount + ControlPointIndex] = Root + Direction * (ControlPointIndex * Step);
+			Normals[VertexIndex] = Normal;
+			SplineMap[VertexIndex] = VertexIndex;
+		}
+
+		FurSplinesUsed = Splines;
+		Lod = 0;
+		FurLayerCount = InLayerCount;
+		FurLength = 1.0f;
+		ShellBias = 1.0f;
+		HairLengthForceUniformity = 0.75f;
+		MinFurLength = 0.1f;
+		NoiseStrength = 0.1f;
+		NoiseSeed = 0;
+		RemoveFacesWithoutSplines = false;
+		ReferenceGrowMeshVertices = false;
+		CompactVertexFormat = false;
+		ProceduralShells = false;
+		ProgressiveLayers = false;
+		InitLayerSlots();
+		CurrentMinFurLength = MinFurLength;
+		CurrentMaxFurLength = FurLength * InControlPointCount;
+	}
+
+	void Teardown()
+	{
+		if (FurSplinesUsed)
+			FurSplinesUsed->ConditionalBeginDestroy();
+		FurSplinesUsed = nullptr;
+	}
+
+	void Run(int32 InVertexCount, int32 InControlPointCount, int32 InLayerCount, FOutputDevice& Ar)
+	{
+		Setup(InVertexCount, InControlPointCount, InLayerCount);
+
+		TArray<float> FurLengths;
+		GenerateFurLengths(FurLengths);
+		TArray<uint32> SrcVertexIndices;
+		SrcVertexIndices.SetNumUninitialized(InVertexCount);
+		for (int32 VertexIndex = 0; VertexIndex < InVertexCount; VertexIndex++)
+			SrcVertexIndices[VertexIndex] = VertexIndex;
+
+		TArray<FVector3f> ScalarOffsets;
+		ScalarOffsets.SetNumUninitialized(InVertexCount);
+		FVector2f Uv1, Uv2, Uv3;
+		double ScalarStart = FPlatformTime::Seconds();
+		for (int32 Layer = 1; Layer <= InLayerCount; Layer++)
+		{
+			auto GenLayerData = CalcFurGenLayerData(Layer);
+			for (int32 VertexIndex = 0; VertexIndex < InVertexCount; VertexIndex++)
+				GenerateFurVertex(ScalarOffsets[VertexIndex], Uv1, Uv2, Uv3, VertexIndex, FVector3f(Normals[VertexIndex]), FurLengths[VertexIndex], GenLayerData, VertexIndex);
+		}
+		double ScalarTime = FPlatformTime::Seconds() - ScalarStart;
+
+		FFurProfileSpan Span;
+		double KernelStart = FPlatformTime::Seconds();
+		BuildFurProfile(Span, SrcVertexIndices.GetData(), InVertexCount, FurLengths);
+		for (int32 Layer = 1; Layer <= InLayerCount; Layer++)
+			GenerateProfileLayer(Span, SrcVertexIndices.GetData(), InVertexCount, CalcFurGenLayerData(Layer));
+		double KernelTime = FPlatformTime::Seconds() - KernelStart;
+
+		// both paths end on the tip layer
+		float MaxError = 0.0f;
+		for (int32 VertexIndex = 0; VertexIndex < InVertexCount; VertexIndex++)
+		{
+			FVector3f KernelOffset(Span.FurOffsets[VertexIndex], Span.FurOffsets[Span.Num + VertexIndex], Span.FurOffsets[Span.Num * 2 + VertexIndex]);
+			MaxError = FMath::Max(MaxError, (KernelOffset - ScalarOffsets[VertexIndex]).GetAbsMax());
+		}
+
+		Ar.Logf(TEXT("gFur spline kernel: %d vertices, %d control points, %d layers: scalar %.2f ms, SIMD %.2f ms (%.2fx), max offset difference %g"),
+			InVertexCount, InControlPointCount, InLayerCount, ScalarTime * 1000.0, KernelTime * 1000.0, ScalarTime / FMath::Max(KernelTime, 1e-9), MaxError);
+
+		Teardown();
+	}
+
+	/** Compares the procedural shell reference math against the generated layers, returns the largest differences */
+	void RunProceduralShells(int32 InVertexCount, int32 InControlPointCount, int32 InLayerCount, float InShellBias, bool InSplines, float& OutMaxOffsetError, float& OutMaxUvError)
+	{
+		Setup(InVertexCount, InControlPointCount, InLayerCount);
+		ShellBias = InShellBias;
+		// cover vertices without a spline too
+		for (int32 VertexIndex = 0; VertexIndex < InVertexCount; VertexIndex += 16)
+			SplineMap[VertexIndex] = -1;
+
+		UFurSplines* Splines = FurSplinesUsed;
+		FurSplinesUsed = InSplines ? Splines : nullptr;
+
+		TArray<float> FurLengths;
+		GenerateFurLengths(FurLengths);
+		TArray<uint32> SrcVertexIndices;
+		SrcVertexIndices.SetNumUninitialized(InVertexCount);
+		for (int32 VertexIndex = 0; VertexIndex < InVertexCount; VertexIndex++)
+			SrcVertexIndices[VertexIndex] = VertexIndex;
+
+		FFurProfileSpan Span;
+		if (FurSplinesUsed)
+			BuildFurProfile(Span, SrcVertexIndices.GetData(), InVertexCount, FurLengths);
+		const uint32 Stride = GetProceduralProfileStride();
+		TArray<FVector4f> Profiles;
+		Profiles.SetNumUninitialized(InVertexCount * Stride);
+		for (int32 VertexIndex = 0; VertexIndex < InVertexCount; VertexIndex++)
+			WriteProceduralProfile(&Profiles[VertexIndex * Stride], Span, VertexIndex, VertexIndex);
+
+		OutMaxOffsetError = 0.0f;
+		OutMaxUvError = 0.0f;
+		for (int32 LayerSlot = 0; LayerSlot < InLayerCount; LayerSlot++)
+		{
+			auto GenLayerData = CalcFurGenLayerData(FurLayerCount - LayerSlot);
+			for (int32 VertexIndex = 0; VertexIndex < InVertexCount; VertexIndex++)
+			{
+				FVector3f Normal(Normals[VertexIndex]);
+				FVector3f FurOffset, ReferenceFurOffset;
+				FVector2f Uv1, Uv2, Uv3, ReferenceUv1, ReferenceUv2;
+				if (FurSplinesUsed)
+					GenerateFurVertex(FurOffset, Uv1, Uv2, Uv3, VertexIndex, Normal, SplineMap[VertexIndex] >= 0 ? FurLengths[VertexIndex] : FurLength, GenLayerData, SplineMap[VertexIndex]);
+				else
+					GenerateFurVertex(FurOffset, Uv1, Uv2, Uv3, VertexIndex, Normal, FurLength, GenLayerData);
+				GenerateProceduralFurVertex(ReferenceFurOffset, ReferenceUv1, ReferenceUv2, &Profiles[VertexIndex * Stride], Normal, LayerSlot);
+				OutMaxOffsetError = FMath::Max(OutMaxOffsetError, (ReferenceFurOffset - FurOffset).GetAbsMax());
+				OutMaxUvError = FMath::Max(OutMaxUvError, FMath::Max((ReferenceUv1 - Uv1).GetAbsMax(), (ReferenceUv2 - Uv2).GetAbsMax()));
+			}
+		}
+
+		FurSplinesUsed = Splines;
+		Teardown();
+	}
+};
+
+static FAutoConsoleCommandWithWorldArgsAndOutputDevice GFurBenchmarkSplineKernelCommand(
+	TEXT("gfur.BenchmarkSplineKernel"),
+	TEXT("Compares the scalar and SIMD spline fur offset generation. Arguments: [VertexCount=100000] [ControlPointCount=4] [LayerCount=32]"),
+	FConsoleCommandWithWorldArgsAndOutputDeviceDelegate::CreateLambda([](const TArray<FString>& Args, UWorld* World, FOutputDevice& Ar)
+	{
+		int32 VertexCount = Args.Num() > 0 ? FMath::Max(FCString::Atoi(*Args[0]), 1) : 100000;
+		int32 ControlPointCount = Args.Num() > 1 ? FMath::Max(FCString::Atoi(*Args[1]), 2) : 4;
+		int32 LayerCount = Args.Num() > 2 ? FMath::Clamp(FCString::Atoi(*Args[2]), FFurData::MinimalFurLayerCount, FFurData::MaximalFurLayerCount) : 32;
+		FFurSplineKernelBenchmark Benchmark;
+		Benchmark.Run(VertexCount, ControlPointCount, LayerCount, Ar);
+	}));
+
+void FFurData::CompareProceduralShells(int32 InVertexCount, int32 InControlPointCount, int32 InLayerCount, float InShellBias, bool InSplines, float& OutMaxOffsetError, float& OutMaxUvError)
+{
+	FFurSplineKernelBenchmark Benchmark;
+	Benchmark.RunProceduralShells(InVertexCount, InControlPointCount, InLayerCount, InShellBias, InSplines, OutMaxOffsetError, OutMaxUvError);
+}
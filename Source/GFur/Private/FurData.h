@@ -8,16 +8,98 @@
 #include "Runtime/Engine/Public/Rendering/ColorVertexBuffer.h"
 
 #include "RHICommandList.h"
+#include "Containers/DynamicRHIResourceArray.h"
 
 #include "VertexFactory.h"
 #include "BoneIndices.h"
 
 #include "Async/AsyncWork.h"
+#include "Async/ParallelFor.h"
+#include "Tasks/Task.h"
+#include "Async/TaskGraphInterfaces.h"
+#include "Misc/SecureHash.h"
+#include "Serialization/BulkData.h"
+#include "Misc/ScopeRWLock.h"
+#include "Misc/Optional.h"
+#include "UObject/StrongObjectPtr.h"
+#include <atomic>
 
 #include "FurSplines.h"
 
+/** Fur Layer Attributes */
+struct FFurLayerAttributes
+{
+	// UVs
+	FVector2f		UV1;
+	// UVs
+	FVector2f		UV2;
+	// UVs
+	FVector2f		UV3;
+
+	FVector3f		FurOffset;
+
+	void Set(const FVector3f& InFurOffset, const FVector2f& InUv1, const FVector2f& InUv2, const FVector2f& InUv3)
+	{
+		FurOffset = InFurOffset;
+		UV1 = InUv1;
+		UV2 = InUv2;
+		UV3 = InUv3;
+	}
+
+	static void GetStreamComponents(const FVertexBuffer* InVertexBuffer, uint32 InOffset, uint32 InStride,
+		FVertexStreamComponent& OutFurOffset, FVertexStreamComponent& OutUv1, FVertexStreamComponent& OutUv2)
+	{
+		OutFurOffset = FVertexStreamComponent(InVertexBuffer, InOffset + STRUCT_OFFSET(FFurLayerAttributes, FurOffset), InStride, VET_Float3);
+		OutUv1 = FVertexStreamComponent(InVertexBuffer, InOffset + STRUCT_OFFSET(FFurLayerAttributes, UV1), InStride, VET_Float2);
+		OutUv2 = FVertexStreamComponent(InVertexBuffer, InOffset + STRUCT_OFFSET(FFurLayerAttributes, UV2), InStride, VET_Float2);
+	}
+};
+
+/**
+* Fur Layer Attributes in half precision. UV1.Y and UV2.X are constant per layer, the shaders derive them from the linear layer factor
+* stored in FurOffset.W. UV3.X (LOD index) isn't read by the shaders and is dropped.
+*/
+struct FFurCompactLayerAttributes
+{
+	// FurOffset in XYZ, linear layer factor in W
+	FFloat16		FurOffset[4];
+	// UV1.X, UV2.Y
+	FFloat16		FurLengths[2];
+
+	void Set(const FVector3f& InFurOffset, const FVector2f& InUv1, const FVector2f& InUv2, const FVector2f& InUv3)
+	{
+		FurOffset[0] = InFurOffset.X;
+		FurOffset[1] = InFurOffset.Y;
+		FurOffset[2] = InFurOffset.Z;
+		FurOffset[3] = InUv2.X;
+		FurLengths[0] = InUv1.X;
+		FurLengths[1] = InUv2.Y;
+	}
+
+	// Both layer UVs read the same lengths, their layer constant component is replaced in the shader
+	static void GetStreamComponents(const FVertexBuffer* InVertexBuffer, uint32 InOffset, uint32 InStride,
+		FVertexStreamComponent& OutFurOffset, FVertexStreamComponent& OutUv1, FVertexStreamComponent& OutUv2)
+	{
+		OutFurOffset = FVertexStreamComponent(InVertexBuffer, InOffset + STRUCT_OFFSET(FFurCompactLayerAttributes, FurOffset), InStride, VET_Half4);
+		OutUv1 = FVertexStreamComponent(InVertexBuffer, InOffset + STRUCT_OFFSET(FFurCompactLayerAttributes, FurLengths), InStride, VET_Half2);
+		OutUv2 = OutUv1;
+	}
+};
+
+template<bool bCompactT>
+struct TFurLayerAttributesTypeSelector
+{
+	typedef FFurLayerAttributes LayerAttributesT;
+};
+
+template<>
+struct TFurLayerAttributesTypeSelector<true>
+{
+	typedef FFurCompactLayerAttributes LayerAttributesT;
+};
+
 /** Fur Static Vertex */
-template<EStaticMeshVertexTangentBasisType TangentBasisTypeT, EStaticMeshVertexUVType UVTypeT>
+template<EStaticMeshVertexTangentBasisType TangentBasisTypeT, EStaticMeshVertexUVType UVTypeT, bool bCompactT>
 struct FFurStaticVertex
 {
 	typedef typename TStaticMeshVertexTangentTypeSelector<TangentBasisTypeT>::TangentTypeT TangentTypeT;
@@ -32,69 +114,241 @@ struct FFurStaticVertex
 	// Normal
 	TangentTypeT	TangentZ;
 
+	typedef typename TFurLayerAttributesTypeSelector<bCompactT>::LayerAttributesT LayerAttributesT;
+
 	// UVs
 	UVsTypeT		UV0;
-	// UVs
-	FVector2f		UV1;
-	// UVs
-	FVector2f		UV2;
-	// UVs
-	FVector2f		UV3;
 	// VertexColor
 	FColor			Color;
 
-	FVector3f			FurOffset;
+	LayerAttributesT	Layer;
+};
+
+/** Fur Shell Vertex, per layer attributes only. The base attributes are fetched from the grow mesh vertex buffers. */
+template<bool bCompactT>
+struct FFurShellVertex
+{
+	typedef typename TFurLayerAttributesTypeSelector<bCompactT>::LayerAttributesT LayerAttributesT;
+
+	LayerAttributesT	Layer;
+
+	// Index into the vertex buffers of the grow mesh LOD
+	uint32			SourceVertexIndex;
+};
+
+struct FStaticMeshVertexBuffers;
+
+/**
+* Build inputs that only depend on the grow mesh LOD and the splines, shared by all fur data built from them.
+* The first build that needs a stage computes it under the lock, the others wait and copy the results.
+*/
+struct FFurBuildIntermediates
+{
+	FCriticalSection CriticalSection;
+	FSHAHash Key;
+	bool bNormalsBuilt = false;
+	bool bSplinesBuilt = false;
+
+	TArray<FVector> Normals;
+	TArray<int32> SplineMap;
+	// Spline lengths before the scale by the fur length
+	TArray<float> SplineLengths;
+	uint32 SplineVertexCount = 0;
+	float MinSplineLengthSquared = FLT_MAX;
+	float MaxSplineLengthSquared = -FLT_MAX;
+	// Squared distance of the farthest vertex from its bones, of all vertices and of the vertices with a spline
+	float MaxVertexDistSquared = 0.0f;
+	float MaxSplineVertexDistSquared = 0.0f;
+};
+
+/** Shader resources of the grow mesh vertex buffers referenced by the shells */
+struct FFurGrowMeshFetchData
+{
+	FRHIShaderResourceView* Positions = nullptr;
+	FRHIShaderResourceView* Tangents = nullptr;
+	FRHIShaderResourceView* TexCoords = nullptr;
+	FRHIShaderResourceView* Colors = nullptr;
+	uint32 NumTexCoords = 1;
+	uint32 ColorIndexMask = 0;
+
+	void Set(const FStaticMeshVertexBuffers& InVertexBuffers);
+};
+
+/** Range of a staging buffer written by a partial update, in elements */
+struct FFurDirtyRange
+{
+	uint32 Offset;
+	uint32 Size;
+};
+
+/**
+* Double buffered CPU staging memory of a fur buffer. A build writes one copy while the rendering thread may still upload the other,
+* the render command signals the event of its copy once it has been read and only then the copy is handed to a build again.
+* The copies are handed to the RHI as initial data of the buffers, which discards them in cooked builds.
+*/
+template<typename ElementType, uint32 Alignment = DEFAULT_ALIGNMENT>
+class TFurStagingBuffer
+{
+public:
+	typedef TResourceArray<ElementType, Alignment> FArray;
+
+	/**
+	* Waits until the copy for the next build isn't read anymore, the content of the last submitted copy is kept with InPreserve.
+	* After a partial update the other copy only lacks the ranges of that update.
+	*/
+	FArray& Acquire(bool InPreserve)
+	{
+		const int32 Next = 1 - Submitted;
+		if (ReleaseEvents[Next].IsValid() && !ReleaseEvents[Next]->IsComplete())
+			FTaskGraphInterface::Get().WaitUntilTaskCompletes(ReleaseEvents[Next]);
+		if (InPreserve)
+		{
+			if (SubmittedRanges.Num() && Copies[Next].Num() == Copies[Submitted].Num())
+			{
+				for (const FFurDirtyRange& Range : SubmittedRanges)
+					FMemory::Memcpy(Copies[Next].GetData() + Range.Offset, Copies[Submitted].GetData() + Range.Offset, Range.Size * sizeof(ElementType));
+			}
+			else
+			{
+				Copies[Next] = Copies[Submitted];
+			}
+		}
+		return Copies[Next];
+	}
+
+	/**
+	* Hands the acquired copy over to the rendering thread, the render command reads the returned copy and releases it.
+	* InRanges are the ranges written since Acquire, none for a full update.
+	*/
+	int32 Submit(const TArray<FFurDirtyRange>& InRanges = TArray<FFurDirtyRange>())
+	{
+		Submitted = 1 - Submitted;
+		ReleaseEvents[Submitted] = FGraphEvent::CreateGraphEvent();
+		SubmittedRanges = InRanges;
+		return Submitted;
+	}
+
+	FArray& Get(int32 InCopy) { return Copies[InCopy]; }
+	const FArray& GetSubmitted() const { return Copies[Submitted]; }
+	void Release(int32 InCopy) { ReleaseEvents[InCopy]->DispatchSubsequents(); }
+
+private:
+	FArray Copies[2];
+	FGraphEventRef ReleaseEvents[2];
+	TArray<FFurDirtyRange> SubmittedRanges;
+	int32 Submitted = 0;
+};
+
+/**
+* Fur Profile Buffer, layer invariant per vertex data of the procedural shells. Every vertex of the single stored layer owns Stride
+* consecutive entries: the header (FFurData::WriteProceduralProfile) followed by its control points.
+*/
+class FFurProfileBuffer : public FVertexBuffer
+{
+public:
+	virtual void InitRHI(FRHICommandListBase& RHICmdList) override;
+	virtual void ReleaseRHI() override;
+
+	FVector4f* Lock(uint32 InVertexCount, uint32 InStride, bool InPreserve = false);
+	void Unlock();
+
+	FRHIShaderResourceView* GetSRV() const { return ShaderResourceViewRHI; }
+	uint32 GetStride() const { return Stride; }
+	/** Profiles of the last Lock on the build side */
+	const TArray<FVector4f, TAlignedHeapAllocator<VERTEXBUFFER_ALIGNMENT>>& GetStagingData() const { return Profiles.GetSubmitted(); }
+	uint32 GetStagingStride() const { return PendingStride; }
+
+private:
+	typedef TFurStagingBuffer<FVector4f, VERTEXBUFFER_ALIGNMENT>::FArray FProfileArray;
+
+	TFurStagingBuffer<FVector4f, VERTEXBUFFER_ALIGNMENT> Profiles;
+	FShaderResourceViewRHIRef ShaderResourceViewRHI;
+	uint32 Stride = 1;
+	uint32 PendingStride = 1;
+	int32 UploadCopy = 0;
+	uint32 UploadStride = 1;
+
+	void CreateBuffer(FRHICommandListBase& RHICmdList, FProfileArray& InProfiles, uint32 InStride);
+};
+
+/** Layer constants for the shaders, the compact vertex format doesn't store them per vertex and procedural shells derive the whole layer from them */
+struct FFurLayerShaderData
+{
+	uint32 CompactVertexFormat = 0;
+	float FurLayerCount = 1.0f;
+	float ShellBias = 0.0f;
+	// shells without splines are built linear and without the noise, the vertex factories apply the shell bias and the noise strength
+	uint32 LinearShells = 0;
+	uint32 ProceduralShells = 0;
+	float NoiseStrength = 0.0f;
+	uint32 NoiseSeed = 0;
+	const FFurProfileBuffer* Profiles = nullptr;
+
+	FRHIShaderResourceView* GetProfilesSRV() const;
+	uint32 GetProfileStride() const { return Profiles ? Profiles->GetStride() : 1; }
 };
 
 /** Fur Vertex Buffer */
 class FFurVertexBuffer : public FVertexBuffer
 {
 public:
-	virtual ~FFurVertexBuffer() override;
-
 	virtual void InitRHI(FRHICommandListBase& RHICmdList) override;
 
+	/** Staging memory of the next upload, InPreserve keeps the vertices of the last one for partial updates */
 	template<typename VertexType>
-	VertexType* Lock(uint32 VertexCount);
+	VertexType* Lock(uint32 VertexCount, bool InPreserve = false);
+	void* Lock(uint32 VertexCount, uint32 InVertexSize, bool InPreserve = false);
 	void Unlock();
+	/** Marks a vertex written since a preserving Lock, only the marked vertices are uploaded then */
+	void MarkDirty(uint32 InVertexIndex) { DirtyVertices.Add(InVertexIndex); }
 
 	uint32 GetSize() const { return Size; }
 	uint32 GetVertexSize() const { return VertexSize; }
+	/** Vertices of the last Lock on the build side */
+	const TArray<uint8, TAlignedHeapAllocator<VERTEXBUFFER_ALIGNMENT>>& GetStagingData() const { return VertexData.GetSubmitted(); }
 
 private:
-	uint8* VertexData = nullptr;
+	typedef TFurStagingBuffer<uint8, VERTEXBUFFER_ALIGNMENT>::FArray FVertexArray;
+
+	TFurStagingBuffer<uint8, VERTEXBUFFER_ALIGNMENT> VertexData;
 	uint32 Size = 0;
 	uint32 VertexSize = 0;
+	int32 UploadCopy = 0;
+	bool bPartialUpdate = false;
+	TArray<uint32> DirtyVertices;
+
+	void UploadData(FRHICommandListBase& RHICmdList, FVertexArray& InData);
+	void UploadRanges(FRHICommandListImmediate& RHICmdList, const FVertexArray& InData, const TArray<FFurDirtyRange>& InRanges);
+	void BuildDirtyRanges(TArray<FFurDirtyRange>& OutRanges);
 };
 
 template<typename VertexType>
-VertexType* FFurVertexBuffer::Lock(uint32 InVertexCount)
+VertexType* FFurVertexBuffer::Lock(uint32 InVertexCount, bool InPreserve)
 {
-	if (InVertexCount == 0)
-		InVertexCount = 1;
-	VertexSize = sizeof(VertexType);
-	uint32 NewSize = InVertexCount * sizeof(VertexType);
-	if (NewSize != Size)
-	{
-		delete[] VertexData;
-		VertexData = new uint8[NewSize];
-		Size = NewSize;
-	}
-	return (VertexType*)VertexData;
+	return (VertexType*)Lock(InVertexCount, sizeof(VertexType), InPreserve);
 }
 
 
 /** Index Buffer */
+/** Fur Index Buffer, uploaded with 16 bit indices when all of them fit */
 class FFurIndexBuffer : public FIndexBuffer
 {
 public:
 	virtual void InitRHI(FRHICommandListBase& RHICmdList) override;
 
-	TArray<int32>& Lock();
+	typedef TFurStagingBuffer<int32, INDEXBUFFER_ALIGNMENT>::FArray FIndexArray;
+
+	FIndexArray& Lock();
 	void Unlock();
 
+	/** Indices of the last Lock on the build side */
+	const FIndexArray& GetStagingData() const { return Indices.GetSubmitted(); }
+
 private:
-	TArray<int32> Indices;
+	TFurStagingBuffer<int32, INDEXBUFFER_ALIGNMENT> Indices;
+	int32 UploadCopy = 0;
+
+	void CreateBuffer(FRHICommandListBase& RHICmdList, FIndexArray& InIndices);
 };
 
 /** Vertex Factory */
@@ -111,19 +365,45 @@ public:
 		ERHIFeatureLevel::Type InFeatureLevel) {}
 	virtual void UpdateStaticShaderData(float InFurOffsetPower, const FVector& InLinearOffset, const FVector& InAngularOffset,
 		const FVector& InPosition, bool InDiscontinuous, ERHIFeatureLevel::Type InFeatureLevel) {}
+
+	/** Fur length of the component, the fur data is built for the length 1.0 and shared by components differing only in it */
+	void SetFurLengthScale(float InFurLengthScale) { FurLengthScale = InFurLengthScale; }
+	float GetFurLengthScale() const { return FurLengthScale; }
+	/** Shell bias and noise strength of the component, applied to the linear shells only, see FFurData::UsesLinearShells */
+	void SetFurShellShape(float InShellBias, float InNoiseStrength) { FurShellBias = InShellBias; FurNoiseStrength = InNoiseStrength; }
+	float GetFurShellBias() const { return FurShellBias; }
+	float GetFurNoiseStrength() const { return FurNoiseStrength; }
+
+private:
+	float FurLengthScale = 1.0f;
+	float FurShellBias = 0.0f;
+	float FurNoiseStrength = 0.0f;
 };
 
 /** Fur Data */
 class FFurData
 {
+	friend class FFurBuildScheduler;
+	template<typename DataType> friend class TFurDataRegistry;
+
 public:
+	/**
+	* The index buffer holds the triangles of a single layer, relative to BaseVertexIndex in the first stored layer of the section.
+	* The other stored layers are drawn with a base vertex index of BaseVertexIndex + LayerIndex * LayerVertexCount.
+	*/
 	struct FSection
 	{
 		uint32 MaterialIndex;
 		uint32 BaseIndex;
+		// Triangles of one layer
 		uint32 NumTriangles;
+		// Vertex range of all stored layers
 		uint32 MinVertexIndex;
 		uint32 MaxVertexIndex;
+		uint32 LayerVertexCount;
+		// Vertices of one layer referenced by the indices
+		uint32 BaseVertexIndex;
+		uint32 NumIndexedVertices;
 		int32 NumBones;
 	};
 
@@ -131,14 +411,46 @@ public:
 	static const int32 MaximalFurLayerCount;
 	static const float MinimalFurLength;
 
+	/** The fur is built for the length 1.0, the vertex factories scale it by the fur length of the component */
+	static float CalcFurLengthScale(const UGFurComponent* InFurComponent);
+	/** Shells without splines grow along the normal, the data is shared regardless of the shell bias and the noise strength the vertex factories apply */
+	static bool UsesLinearShells(const UGFurComponent* InFurComponent);
+	/** Generates the layers of random fur both ways and returns the largest differences of the procedural shells, see GFur.ProceduralShells */
+	static void CompareProceduralShells(int32 InVertexCount, int32 InControlPointCount, int32 InLayerCount, float InShellBias, bool InSplines, float& OutMaxOffsetError, float& OutMaxUvError);
+
 	const TArray<FSection>& GetSections_RenderThread() const { /*check(IsInRenderingThread());*/ return Sections; }
+	// The build runs in the background, the buffers and sections may only be used once it has been handed over to the rendering thread
+	bool IsBuilt_RenderThread() const { /*check(IsInRenderingThread());*/ return bBuilt_RenderThread; }
+	void WaitForBuild() const;
 	int32 GetNumVertices_RenderThread() const { /*check(IsInRenderingThread());*/ return VertexCount; }
 	const FIndexBuffer* GetIndexBuffer_RenderThread() const { /*check(IsInRenderingThread());*/ return &IndexBuffer; }
 	int32 GetLod() const { return Lod; }
-	float GetCurrentMinFurLength() const { return CurrentMinFurLength; }
-	float GetCurrentMaxFurLength() const { return CurrentMaxFurLength; }
-	float GetMaxVertexBoneDistance() const { return MaxVertexBoneDistance; }
+	// Fur lengths relative to the fur length of the component, see CalcFurLengthScale
+	// published when a build finishes, a running rebuild does not change them
+	float GetCurrentMinFurLength() const { return CurrentMinFurLength_GameThread; }
+	float GetCurrentMaxFurLength() const { return CurrentMaxFurLength_GameThread; }
+	float GetMaxVertexBoneDistance() const { return MaxVertexBoneDistance_GameThread; }
 	int32 GetFurLayerCount() const { return FurLayerCount; }
+	// Number of layers stored in the vertex buffer, procedural shells store a single one and draw it once per layer
+	int32 GetVertexLayerCount() const { return bProceduralShells ? 1 : FurLayerCount; }
+	// Layer of a layer slot counted from the tip, progressive layers permute the slots so that every prefix of them approximates fewer layers
+	int32 GetSlotLayerOffset(int32 InLayerSlot) const { return SlotLayerOffsets[InLayerSlot]; }
+	bool UsesProgressiveLayers() const { return ProgressiveLayers; }
+	typedef TArray<int32, TInlineAllocator<128>> FLayerSlots;
+	/** Slots drawn for InLayerCount layers ordered from the tip down, only progressive layers draw fewer layers than stored */
+	void GetDrawLayerSlots(FLayerSlots& OutLayerSlots, int32 InLayerCount) const;
+	bool UsesGrowMeshFetch() const { return bGrowMeshFetch; }
+	bool UsesProceduralShells() const { return bProceduralShells; }
+	FFurLayerShaderData GetLayerShaderData() const;
+	/** GPU memory of the last full build, retained fur and the memory budget are accounted with it */
+	uint64 GetBuiltSize() const { return BuiltSize; }
+	/** A full build finished, on the build side */
+	bool HasBuilt() const { return bHasBuilt; }
+	/** Content hash the registry shares the data by, cooked payloads are shared by it too */
+	const FSHAHash& GetRegistryKey() const { return RegistryKey; }
+	/** Budget of the fur retained after its last component was destroyed, see TFurDataRegistry::Trim */
+	static uint64 GetRetentionBudget();
+	static int32 GetRetentionMaxEntries();
 
 	const TArray<int32>& GetSplineMap() const { return SplineMap; }
 	const TArray<FVector>& GetVertexNormals() const { return Normals; }
@@ -146,8 +458,15 @@ public:
 	const TArray<FSection>& GetSections() const { return Sections; }
 	FFurVertexBuffer& GetVertexBuffer() { return VertexBuffer; }
 	FFurIndexBuffer& GetIndexBuffer() { return IndexBuffer; }
+	FFurProfileBuffer& GetProfileBuffer() { return ProfileBuffer; }
 
-	virtual void CreateVertexFactories(TArray<FFurVertexFactory*>& VertexFactories, FVertexBuffer* InMorphVertexBuffer, bool InPhysics, ERHIFeatureLevel::Type InFeatureLevel) = 0;
+	/** Fails while the render data of the grow mesh doesn't match the build, the proxy tries again later */
+	virtual bool CreateVertexFactories(TArray<FFurVertexFactory*>& VertexFactories, FVertexBuffer* InMorphVertexBuffer, bool InPhysics, ERHIFeatureLevel::Type InFeatureLevel) = 0;
+
+#if WITH_EDITOR
+	/** Payload cooked instead of generating the fur at runtime, the build must have finished. Logs the payload sizes. */
+	void SaveCookedData(TArray<uint8>& OutPayload, const FString& InOwnerName) const;
+#endif // WITH_EDITOR
 
 protected:
 	enum class BuildType
@@ -162,9 +481,35 @@ protected:
 		float LinearFactor;
 		float NonLinearFactor;
 		float LayerNoiseStrength;
+		int32 Layer;
+	};
+
+	/** Layer invariant fur profile of a span of vertices, single precision structure of arrays padded to the SIMD width */
+	struct FFurProfileSpan
+	{
+		int32 Num = 0;
+		int32 ControlPointCount = 0;
+		TArray<float> ControlPoints;	// [ControlPoint][Axis][Vertex], relative to the first control point and scaled to the final fur length
+		TArray<float> Normals;			// [Axis][Vertex]
+		TArray<float> Valid;			// 1 for vertices with a spline, 0 otherwise
+		TArray<float> AlongNormal;		// 1 for vertices growing along the normal (missing, backwards or degenerate spline)
+		TArray<float> UvScale;			// fur length blended by HairLengthForceUniformity divided by the spline length
+		TArray<float> Lengths;
+		TArray<float> Noise;
+		TArray<float> FurOffsets;		// [Axis][Vertex]
+		TArray<float> Uv1X;
+	};
+
+	/** Simulated post-transform vertex cache misses of the shell index buffer, before and after reordering */
+	struct FFurTriangleOrderStats
+	{
+		uint32 NumTriangles = 0;
+		uint32 CacheMissesBefore = 0;
+		uint32 CacheMissesAfter = 0;
 	};
 
-	int32 RefCount;
+	std::atomic<int32> RefCount;
+	FSHAHash RegistryKey;
 
 	// set
 	UFurSplines* FurSplinesAssigned = nullptr;
@@ -175,70 +520,194 @@ protected:
 	float HairLengthForceUniformity;
 	float MinFurLength;
 	float NoiseStrength;
+	int32 NoiseSeed;
 	bool RemoveFacesWithoutSplines;
+	bool ReferenceGrowMeshVertices;
+	bool CompactVertexFormat;
+	bool ProceduralShells;
+	bool ProgressiveLayers;
+	// components of content-identical assets share the data, it keeps the assets of the first component alive
+	TArray<TStrongObjectPtr<UObject>> ReferencedAssets;
 
 	// generated
 	UFurSplines* FurSplinesUsed = nullptr;
 	FFurVertexBuffer VertexBuffer;
 	FFurIndexBuffer IndexBuffer;
+	FFurProfileBuffer ProfileBuffer;
 	TArray<FSection> Sections;
+	TArray<int32> SlotLayerOffsets;
 	float CurrentMinFurLength;
 	float CurrentMaxFurLength;
-	float MaxVertexBoneDistance;
+	float MaxVertexBoneDistance = 1.0f;
 	bool bUseHighPrecisionTangentBasis;
 	bool bUseFullPrecisionUVs;
-	uint32 VertexCount;
+	bool bUseCompactVertexFormat = false;
+	bool bGrowMeshFetch = false;
+	bool bProceduralShells = false;
+	bool bLinearShells = false;
+	// the render data of the grow mesh can be rebuilt or released after the build, the shells resolve it when their vertex factories are created
+	uint32 GrowMeshVertexCount = 0;
+	uint32 VertexCount = 0;
 
 	UFurSplines* FurSplinesGenerated = nullptr;
 
+	// background build
+	UE::Tasks::FTask BuildTask;
+	// guarded by the build scheduler, cleared when a queued build is cancelled
+	bool bBuildRequested = false;
+	bool bBuilt_RenderThread = false;
+	std::atomic<uint64> BuiltSize = 0;
+	std::atomic<bool> bHasBuilt = false;
+	std::atomic<float> CurrentMinFurLength_GameThread = 1.0f;
+	std::atomic<float> CurrentMaxFurLength_GameThread = 1.0f;
+	std::atomic<float> MaxVertexBoneDistance_GameThread = 1.0f;
+	// cooked payload, the first full build loads it instead of generating the fur
+	TSharedPtr<FByteBulkData, ESPMode::ThreadSafe> CookedData;
+
 	// Temp Data
 	uint32 VertexCountPerLayer;
+	// Sections of the last build, the rendering thread gets a copy
 	TArray<FSection> TempSections;
 	TArray<FVector> Normals;
 	TArray<int32> SplineMap;
 	TArray<uint32> VertexRemap;
+	TSharedPtr<FFurBuildIntermediates, ESPMode::ThreadSafe> Intermediates;
 	int32 OldFurLayerCount = 0;
 	bool OldRemoveFacesWithoutSplines = false;
 
-	volatile bool RenderThreadDataSubmissionPending = false;
-
 	FFurData();
 	virtual ~FFurData();
 
 	void Set(int InFurLayerCount, int InLod, class UGFurComponent* InFurComponent);
-
-	bool Compare(int InFurLayerCount, int InLod, class UGFurComponent* InFurComponent);
+	/**
+	* Progressive layers store the layers in the bit-reversed order of their offsets from the tip, skipping the offsets past the layer count.
+	* A prefix of a power of two fraction of the layers is then exactly the fur with fewer layers and the other prefixes are spread evenly.
+	*/
+	void InitLayerSlots();
+
+	/** Registry key of the parameters, the same inputs as Set */
+	static void HashParameters(FSHA1& InOutHash, int InFurLayerCount, int InLod, const class UGFurComponent* InFurComponent);
+	/**
+	* Registry key of an asset. The editor hashes the asset itself since it may change at any time, cooked builds hash the content
+	* so that duplicated assets share the fur. InHashContent returns false when the content isn't available on the CPU.
+	*/
+	static void HashAsset(FSHA1& InOutHash, const UObject* InAsset, int32 InLod, TFunctionRef<bool(FSHA1&)> InHashContent);
+	static bool HashGrowMeshVertices(FSHA1& InOutHash, const FStaticMeshVertexBuffers& InVertexBuffers);
 	bool Similar(int InLod, class UGFurComponent* InFurComponent);
 
-	template<EStaticMeshVertexTangentBasisType TangentBasisTypeT>
-	void UnpackNormals(const FStaticMeshVertexBuffer& InVertices);
-	void GenerateSplineMap(const FPositionVertexBuffer& InPositions);
+	void LaunchBuild(const class UGFurComponent* InFurComponent, TUniqueFunction<void()>&& InBuild);
+	void ExecuteBuild(const TUniqueFunction<void()>& InBuild);
+	uint64 CalcBuiltSize() const;
+
+	bool CanReferenceGrowMeshVertices() const;
+	bool CanUseProceduralShells() const;
+	uint32 GetProceduralProfileStride() const;
 
-	FFurGenLayerData CalcFurGenLayerData(int32 Layer);
+	template<EStaticMeshVertexTangentBasisType TangentBasisTypeT>
+	static void UnpackNormals(TArray<FVector>& OutNormals, const FStaticMeshVertexBuffer& InVertices);
+	/** Shares the intermediates of the grow mesh LOD and the used splines with the other fur data, InUnpackNormals runs for the first one */
+	void AcquireIntermediates(const UObject* InGrowMesh, TFunctionRef<void(TArray<FVector>&)> InUnpackNormals);
+	/** Called before the rebuild of an edited grow mesh or splines, the next build computes the intermediates again */
+	void InvalidateIntermediates();
+#if WITH_EDITORONLY_DATA
+	/** Edits merged until the build scheduler dispatches their rebuild, a full build covers a splines build which covers the combed vertices */
+	struct FEditBuild
+	{
+		TOptional<BuildType> Build;
+		bool bRegenerateSplines = false;
+		TSet<uint32> CombedVertices;
+	};
+	FEditBuild PendingEditBuild;
+
+	/** Called by the change delegates of the edited assets, the build scheduler coalesces and debounces the rebuilds */
+	void RequestEditBuild(BuildType InBuild, bool InRegenerateSplines = false);
+	void RequestEditBuild(const TArray<uint32>& InCombedVertices);
+	/** Game thread part of the pending edits once no build of the data is running, returns the rebuild */
+	virtual TUniqueFunction<void()> PrepareEditBuild() = 0;
+	/** Retained data of edited assets is deleted instead of rebuilt, nothing draws it. Returns true when the data was evicted. */
+	virtual bool EvictIfReleased() = 0;
+#endif // WITH_EDITORONLY_DATA
+	/** Spline map of the intermediates, InCalcVertexDistances returns the squared distance of every vertex from its bones */
+	void GenerateSplineMap(const FPositionVertexBuffer& InPositions, TFunctionRef<void(TArray<float>&)> InCalcVertexDistances);
+	void BuildSplineIntermediates(FFurBuildIntermediates& OutIntermediates, const FPositionVertexBuffer& InPositions) const;
+	void CalcSplineLengths(TArray<float>& OutSplineLengths) const;
+	void RebaseSectionIndices(FFurIndexBuffer::FIndexArray& InOutIndices, FSection& InOutSection, uint32 InEndIndex) const;
+	void GatherSectionIndices(TArray<uint32>& OutIndices, const TArray<uint32>& InSourceIndices, uint32 InFirstIndex, uint32 InNumTriangles) const;
+	void OptimizeTriangleOrder(TArray<uint32>& InOutIndices, const FPositionVertexBuffer& InPositions, FFurTriangleOrderStats& InOutStats) const;
+	void ReportTriangleOrder(const FFurTriangleOrderStats& InStats) const;
+
+	/** Result of a full build shared by the DDC and cooked payloads, loading fails when it doesn't match the resolved vertex format */
+	static const int32 BuiltDataVersion;
+	bool LoadBuiltData(FArchive& Ar, uint32 InVertexSize);
+	bool LoadCookedData(uint32 InVertexSize);
+#if WITH_EDITOR
+	void SaveBuiltData(FArchive& Ar) const;
+
+	/** DDC key of a full build, InOutGrowMeshHash holds the content of the grow mesh LOD. Empty when the cache is disabled. */
+	FString BuildDerivedDataKey(FSHA1& InOutGrowMeshHash) const;
+	bool LoadDerivedData(const FString& InKey, uint32 InVertexSize);
+	void SaveDerivedData(const FString& InKey) const;
+#endif // WITH_EDITOR
+
+	FFurGenLayerData CalcFurGenLayerData(int32 Layer) const;
 	void GenerateFurLengths(TArray<float>& FurLengths);
-	void GenerateFurVertex(FVector3f& OutFurOffset, FVector2f& OutUv1, FVector2f& OutUv2, FVector2f& OutUv3, const FVector3f& InTangentZ, float FurLength, const FFurGenLayerData& InGenLayerData);
-	void GenerateFurVertex(FVector3f& OutFurOffset, FVector2f& OutUv1, FVector2f& OutUv2, FVector2f& OutUv3, const FVector3f& InTangentZ, float FurLength, const FFurGenLayerData& InGenLayerData, int32 InSplineIndex);
+	float GenerateNoise(uint32 InSrcVertexIndex, const FFurGenLayerData& InGenLayerData) const;
+	void GenerateFurVertex(FVector3f& OutFurOffset, FVector2f& OutUv1, FVector2f& OutUv2, FVector2f& OutUv3, uint32 InSrcVertexIndex, const FVector3f& InTangentZ, float FurLength, const FFurGenLayerData& InGenLayerData);
+	void GenerateFurVertex(FVector3f& OutFurOffset, FVector2f& OutUv1, FVector2f& OutUv2, FVector2f& OutUv3, uint32 InSrcVertexIndex, const FVector3f& InTangentZ, float FurLength, const FFurGenLayerData& InGenLayerData, int32 InSplineIndex);
+	template<typename LayerAttributesT>
+	void GenerateFurLayer(LayerAttributesT& OutLayer, uint32 InSrcVertexIndex, const FVector3f& InTangentZ, float FurLength, const FFurGenLayerData& InGenLayerData);
+
+	void BuildFurProfile(FFurProfileSpan& OutSpan, const uint32* InSrcVertexIndices, int32 InCount, const TArray<float>& InFurLengths) const;
+	void GenerateProfileLayer(FFurProfileSpan& InOutSpan, const uint32* InSrcVertexIndices, int32 InCount, const FFurGenLayerData& InGenLayerData) const;
+	template<typename VertexTypeT>
+	void WriteProfileVertex(VertexTypeT& OutVertex, const FFurProfileSpan& InSpan, int32 InIndex, const FFurGenLayerData& InGenLayerData) const;
+
+	void WriteProceduralProfile(FVector4f* OutProfile, const FFurProfileSpan& InSpan, int32 InIndex, uint32 InSrcVertexIndex) const;
+	void GenerateProceduralFurVertex(FVector3f& OutFurOffset, FVector2f& OutUv1, FVector2f& OutUv2, const FVector4f* InProfile, const FVector3f& InTangentZ, int32 InLayerSlot) const;
+
+	static const uint32 ParallelBuildChunkSize;
+	bool UseParallelBuild(uint32 InVertexCount) const;
 
 	template<typename VertexTypeT, typename VertexBlitterT>
-	uint32 GenerateFurVertices(uint32 SrcVertexIndexBegin, uint32 SrcVertexIndexEnd, VertexTypeT* Vertices, const VertexBlitterT& VertexBlitter);
+	uint32 GenerateFurVertices(uint32 SrcVertexIndexBegin, uint32 SrcVertexIndexEnd, VertexTypeT* Vertices, const VertexBlitterT& VertexBlitter, FVector4f* Profiles = nullptr);
 };
 
 template<EStaticMeshVertexTangentBasisType TangentBasisTypeT>
-void FFurData::UnpackNormals(const FStaticMeshVertexBuffer& InVertices)
+void FFurData::UnpackNormals(TArray<FVector>& OutNormals, const FStaticMeshVertexBuffer& InVertices)
 {
 	typedef TStaticMeshVertexTangentDatum<typename TStaticMeshVertexTangentTypeSelector<TangentBasisTypeT>::TangentTypeT> TangentType;
 	const TangentType* SrcTangents = reinterpret_cast<const TangentType*>(const_cast<FStaticMeshVertexBuffer&>(InVertices).GetTangentData());
 	uint32 NumVertices = InVertices.GetNumVertices();
-	Normals.Reset(0);
-	Normals.AddUninitialized(NumVertices);
+	OutNormals.Reset(0);
+	OutNormals.AddUninitialized(NumVertices);
 	for (uint32 i = 0; i < NumVertices; i++)
 	{
-		Normals[i] = SrcTangents[i].TangentZ.ToFVector();
+		OutNormals[i] = SrcTangents[i].TangentZ.ToFVector();
 	}
 }
 
+template<typename LayerAttributesT>
+inline void FFurData::GenerateFurLayer(LayerAttributesT& OutLayer, uint32 InSrcVertexIndex, const FVector3f& InTangentZ, float InFurLength, const FFurGenLayerData& InGenLayerData)
+{
+	FVector3f FurOffset;
+	FVector2f Uv1, Uv2;
+	FVector2f Uv3(0.0f, 0.0f);
+	GenerateFurVertex(FurOffset, Uv1, Uv2, Uv3, InSrcVertexIndex, InTangentZ, InFurLength, InGenLayerData);
+	OutLayer.Set(FurOffset, Uv1, Uv2, Uv3);
+}
+
+template<typename VertexTypeT>
+inline void FFurData::WriteProfileVertex(VertexTypeT& OutVertex, const FFurProfileSpan& InSpan, int32 InIndex, const FFurGenLayerData& InGenLayerData) const
+{
+	const int32 Num = InSpan.Num;
+	OutVertex.Layer.Set(FVector3f(InSpan.FurOffsets[InIndex], InSpan.FurOffsets[Num + InIndex], InSpan.FurOffsets[Num * 2 + InIndex]),
+		FVector2f(InSpan.Uv1X[InIndex], InGenLayerData.NonLinearFactor),
+		FVector2f(InGenLayerData.LinearFactor, InSpan.Lengths[InIndex]),
+		FVector2f(Lod, 0.0f));
+}
+
 template<typename VertexTypeT, typename VertexBlitterT>
-inline uint32 FFurData::GenerateFurVertices(uint32 SrcVertexIndexBegin, uint32 SrcVertexIndexEnd, VertexTypeT* Vertices, const VertexBlitterT& VertexBlitter)
+inline uint32 FFurData::GenerateFurVertices(uint32 SrcVertexIndexBegin, uint32 SrcVertexIndexEnd, VertexTypeT* Vertices, const VertexBlitterT& VertexBlitter, FVector4f* Profiles)
 {
 	if (Vertices == nullptr)
 	{
@@ -248,71 +717,86 @@ inline uint32 FFurData::GenerateFurVertices(uint32 SrcVertexIndexBegin, uint32 S
 	TArray<float> FurLengths;
 	GenerateFurLengths(FurLengths);
 
-	uint32 VerticesPerLayer;
-	uint32 DstVertexIndex = 0;
+	// Source vertex of every destination vertex of a layer. Faces without splines are compacted here so that the layers can be generated independently.
+	TArray<uint32> LayerSourceVertices;
+	LayerSourceVertices.Reserve(SrcVertexIndexEnd - SrcVertexIndexBegin);
+	for (uint32 SrcVertexIndex = SrcVertexIndexBegin; SrcVertexIndex < SrcVertexIndexEnd; SrcVertexIndex++)
 	{
-		auto GenLayerData = CalcFurGenLayerData(FurLayerCount);
-		for (uint32 SrcVertexIndex = SrcVertexIndexBegin; SrcVertexIndex < SrcVertexIndexEnd; SrcVertexIndex++)
+		if (FurSplinesUsed && RemoveFacesWithoutSplines)
 		{
-			if (FurSplinesUsed)
-			{
-				int32 SplineIndex = SplineMap[SrcVertexIndex];
-				if (RemoveFacesWithoutSplines)
-				{
-					if (SplineIndex == -1)
-					{
-						VertexRemap[SrcVertexIndex] = -1;
-						continue;
-					}
-					else
-					{
-						VertexRemap[SrcVertexIndex] = DstVertexIndex;
-					}
-				}
-				auto& Vertex = Vertices[DstVertexIndex];
-				VertexBlitter.Blit(Vertex, SrcVertexIndex);
-				float Length = SplineIndex >= 0 ? FurLengths[SplineIndex] : FurLength;
-				GenerateFurVertex(Vertex.FurOffset, Vertex.UV1, Vertex.UV2, Vertex.UV3, FVector3f(Normals[SrcVertexIndex]), Length, GenLayerData, SplineIndex);
-			}
-			else
+			if (SplineMap[SrcVertexIndex] == -1)
 			{
-				auto& Vertex = Vertices[DstVertexIndex];
-				VertexBlitter.Blit(Vertex, SrcVertexIndex);
-				GenerateFurVertex(Vertex.FurOffset, Vertex.UV1, Vertex.UV2, Vertex.UV3, FVector3f(Normals[SrcVertexIndex]), FurLength, GenLayerData);
+				VertexRemap[SrcVertexIndex] = -1;
+				continue;
 			}
-			DstVertexIndex++;
+			VertexRemap[SrcVertexIndex] = LayerSourceVertices.Num();
 		}
+		LayerSourceVertices.Add(SrcVertexIndex);
 	}
-	VerticesPerLayer = DstVertexIndex;
-
-	for (int32 Layer = FurLayerCount - 2; Layer >= 0; --Layer)
+	const uint32 VerticesPerLayer = LayerSourceVertices.Num();
+
+	const int32 VertexLayerCount = GetVertexLayerCount();
+	TArray<FFurGenLayerData> GenLayerData;
+	GenLayerData.SetNumUninitialized(VertexLayerCount);
+	for (int32 LayerSlot = 0; LayerSlot < VertexLayerCount; LayerSlot++)
+		GenLayerData[LayerSlot] = CalcFurGenLayerData(FurLayerCount - GetSlotLayerOffset(LayerSlot));
+	const uint32 ProfileStride = GetProceduralProfileStride();
+
+	// Layers are stored from the tip (FurLayerCount) down to the first shell above the skin (1), progressive layers in the order of InitLayerSlots.
+	// Every source vertex is blitted once into the tip layer and copied to the other layers, only the fur attributes differ per layer.
+	// Procedural shells store only the tip layer plus the layer invariant profile the shaders derive the other layers from.
+	auto GenerateChunk = [&](uint32 DstVertexIndexBegin, uint32 DstVertexIndexEnd)
 	{
-		auto GenLayerData = CalcFurGenLayerData(Layer + 1);
-		for (uint32 SrcVertexIndex = SrcVertexIndexBegin; SrcVertexIndex < SrcVertexIndexEnd; SrcVertexIndex++)
+		const uint32* SrcVertexIndices = LayerSourceVertices.GetData() + DstVertexIndexBegin;
+		int32 Count = DstVertexIndexEnd - DstVertexIndexBegin;
+		VertexTypeT* BaseVertices = Vertices + DstVertexIndexBegin;
+		for (int32 Index = 0; Index < Count; Index++)
+			VertexBlitter.Blit(BaseVertices[Index], SrcVertexIndices[Index]);
+
+		FFurProfileSpan Span;
+		if (FurSplinesUsed)
+			BuildFurProfile(Span, SrcVertexIndices, Count, FurLengths);
+		if (Profiles)
+		{
+			for (int32 Index = 0; Index < Count; Index++)
+				WriteProceduralProfile(Profiles + (DstVertexIndexBegin + Index) * ProfileStride, Span, Index, SrcVertexIndices[Index]);
+		}
+		for (int32 LayerSlot = 0; LayerSlot < VertexLayerCount; LayerSlot++)
 		{
+			VertexTypeT* LayerVertices = BaseVertices + LayerSlot * VerticesPerLayer;
+			if (LayerSlot > 0)
+				FMemory::Memcpy(LayerVertices, BaseVertices, Count * sizeof(VertexTypeT));
 			if (FurSplinesUsed)
 			{
-				int32 SplineIndex = SplineMap[SrcVertexIndex];
-				if (RemoveFacesWithoutSplines)
-				{
-					if (SplineIndex == -1)
-					{
-						continue;
-					}
-				}
-				auto& Vertex = Vertices[DstVertexIndex];
-				VertexBlitter.Blit(Vertex, SrcVertexIndex);
-				float Length = SplineIndex >= 0 ? FurLengths[SplineIndex] : FurLength;
-				GenerateFurVertex(Vertex.FurOffset, Vertex.UV1, Vertex.UV2, Vertex.UV3, FVector3f(Normals[SrcVertexIndex]), Length, GenLayerData, SplineIndex);
+				GenerateProfileLayer(Span, SrcVertexIndices, Count, GenLayerData[LayerSlot]);
+				for (int32 Index = 0; Index < Count; Index++)
+					WriteProfileVertex(LayerVertices[Index], Span, Index, GenLayerData[LayerSlot]);
 			}
 			else
 			{
-				auto& Vertex = Vertices[DstVertexIndex];
-				VertexBlitter.Blit(Vertex, SrcVertexIndex);
-				GenerateFurVertex(Vertex.FurOffset, Vertex.UV1, Vertex.UV2, Vertex.UV3, FVector3f(Normals[SrcVertexIndex]), FurLength, GenLayerData);
+				for (int32 Index = 0; Index < Count; Index++)
+				{
+					uint32 SrcVertexIndex = SrcVertexIndices[Index];
+					GenerateFurLayer(LayerVertices[Index].Layer, SrcVertexIndex, FVector3f(Normals[SrcVertexIndex]), FurLength, GenLayerData[LayerSlot]);
+				}
 			}
-			DstVertexIndex++;
 		}
+	};
+
+	const uint32 ChunkCount = FMath::DivideAndRoundUp(VerticesPerLayer, ParallelBuildChunkSize);
+	auto GenerateChunkIndex = [&](int32 ChunkIndex)
+	{
+		uint32 Begin = ChunkIndex * ParallelBuildChunkSize;
+		GenerateChunk(Begin, FMath::Min(Begin + ParallelBuildChunkSize, VerticesPerLayer));
+	};
+	if (UseParallelBuild(VerticesPerLayer * VertexLayerCount))
+	{
+		ParallelFor(int32(ChunkCount), GenerateChunkIndex);
+	}
+	else
+	{
+		for (uint32 ChunkIndex = 0; ChunkIndex < ChunkCount; ChunkIndex++)
+			GenerateChunkIndex(ChunkIndex);
 	}
 	return VerticesPerLayer;
 }
@@ -345,7 +829,8 @@ public:
 		}
 	}
 
-	void Blit(FFurStaticVertex<TangentBasisTypeT, UVTypeT>& OutVertex, uint32 InVertexIndex) const
+	template<bool bCompactT>
+	void Blit(FFurStaticVertex<TangentBasisTypeT, UVTypeT, bCompactT>& OutVertex, uint32 InVertexIndex) const
 	{
 		OutVertex.Position = ((FPositionVertex*)(Positions + InVertexIndex * PositionStride))->Position;
 		OutVertex.TangentX = Tangents[InVertexIndex].TangentX;
@@ -364,7 +849,131 @@ private:
 	uint32 ColorStride;
 };
 
-/** Fur Data Cleanup Task */
+/** Fur Shell Vertex Blitter */
+class FFurShellVertexBlitter
+{
+public:
+	template<bool bCompactT>
+	void Blit(FFurShellVertex<bCompactT>& OutVertex, uint32 InVertexIndex) const
+	{
+		OutVertex.SourceVertexIndex = InVertexIndex;
+	}
+};
+
+/**
+* Shared fur data keyed by the hash of their inputs, lookups only take a read lock.
+* Data without references stays registered until Trim evicts it, a lookup revives it with its last build.
+*/
+template<typename DataType>
+class TFurDataRegistry
+{
+public:
+	/** Returns the data registered under the key with a new reference, null when there is none */
+	DataType* Find(const FSHAHash& InKey)
+	{
+		FReadScopeLock Lock(RWLock);
+		DataType* const* Data = Map.Find(InKey);
+		if (Data == nullptr)
+			return nullptr;
+		(*Data)->RefCount++;
+		return *Data;
+	}
+
+	/** Registers new data, returns the data of another thread with a new reference when it registered the key first */
+	DataType* Add(const FSHAHash& InKey, DataType* InData)
+	{
+		FWriteScopeLock Lock(RWLock);
+		if (DataType** Data = Map.Find(InKey))
+		{
+			(*Data)->RefCount++;
+			return *Data;
+		}
+		InData->RegistryKey = InKey;
+		Map.Add(InKey, InData);
+		return InData;
+	}
+
+	/**
+	* Drops a reference of each data, unreferenced data becomes the most recently released one.
+	* InOnUnreferenced runs under the lock so that no lookup can revive the data meanwhile.
+	*/
+	template<typename FuncType>
+	void Release(const TArray<FFurData*>& InDataArray, const FuncType& InOnUnreferenced)
+	{
+		FWriteScopeLock Lock(RWLock);
+		for (FFurData* Data : InDataArray)
+		{
+			DataType* ReleasedData = static_cast<DataType*>(Data);
+			if (--ReleasedData->RefCount == 0)
+			{
+				InOnUnreferenced(Data);
+				Released.Remove(ReleasedData);
+				Released.Add(ReleasedData);
+			}
+		}
+	}
+
+	/**
+	* Unregisters the least recently released data until the rest fits the budget and the entry count, everything with a budget of 0.
+	* Data released before it was built is unregistered right away, a revival would build it anyway.
+	*/
+	void Trim(uint64 InBudget, int32 InMaxEntries, TArray<DataType*>& OutData)
+	{
+		FWriteScopeLock Lock(RWLock);
+
+		// revived data leaves the list here, lookups don't touch it
+		Released.RemoveAll([](const DataType* Data) { return Data->RefCount > 0; });
+		Released.RemoveAll([this, &OutData](DataType* Data) {
+			if (Data->HasBuilt())
+				return false;
+			Map.Remove(Data->RegistryKey);
+			OutData.Add(Data);
+			return true;
+		});
+
+		uint64 ReleasedSize = 0;
+		for (const DataType* Data : Released)
+			ReleasedSize += Data->GetBuiltSize();
+
+		int32 NumEvicted = 0;
+		while (NumEvicted < Released.Num() && (InBudget == 0 || ReleasedSize > InBudget || Released.Num() - NumEvicted > InMaxEntries))
+		{
+			DataType* Data = Released[NumEvicted++];
+			ReleasedSize -= Data->GetBuiltSize();
+			Map.Remove(Data->RegistryKey);
+			OutData.Add(Data);
+		}
+		Released.RemoveAt(0, NumEvicted);
+	}
+
+	/** Unregisters the data when it's retained, returns false when it's referenced */
+	bool Evict(DataType* InData)
+	{
+		FWriteScopeLock Lock(RWLock);
+		if (InData->RefCount > 0 || Released.Remove(InData) == 0)
+			return false;
+		Map.Remove(InData->RegistryKey);
+		return true;
+	}
+
+	/** Number of registered data, retained included, and the size of their built fur */
+	void GetStats(int32& OutNumData, uint64& OutBuiltSize)
+	{
+		FReadScopeLock Lock(RWLock);
+		OutNumData = Map.Num();
+		OutBuiltSize = 0;
+		for (const auto& Pair : Map)
+			OutBuiltSize += Pair.Value->GetBuiltSize();
+	}
+
+private:
+	TMap<FSHAHash, DataType*> Map;
+	// unreferenced data, the least recently released first
+	TArray<DataType*> Released;
+	FRWLock RWLock;
+};
+
+/** Fur Data Cleanup Task, deletes evicted fur data off the game thread once its build finished */
 template<typename T>
 class FFurDataCleanupTask : public FNonAbandonableTask
 {
@@ -378,7 +987,6 @@ protected:
 
 	void DoWork()
 	{
-		FPlatformProcess::Sleep(1.0f);
 		Lambda();
 	}
 
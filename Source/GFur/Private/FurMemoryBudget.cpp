@@ -0,0 +1,230 @@
+// Copyright 2023 GiM s.r.o. All Rights Reserved.
+
+#include "FurMemoryBudget.h"
+#include "FurData.h"
+#include "FurComponent.h"
+#include "Engine/World.h"
+#include "HAL/IConsoleManager.h"
+
+static TAutoConsoleVariable<int32> CVarFurMemoryBudget(
+	TEXT("gfur.MemoryBudgetMB"),
+	0,
+	TEXT("GPU memory in megabytes for the fur of all components, the least significant components are demoted to stay within it.\n")
+	TEXT("0 disables the budget (default)."),
+	ECVF_Default);
+
+static TAutoConsoleVariable<int32> CVarFurMemoryBudgetMaxDemotion(
+	TEXT("gfur.MemoryBudget.MaxDemotion"),
+	3,
+	TEXT("Maximal demotion level of a component. Every level halves its layer counts and evicts its most detailed LOD."),
+	ECVF_Default);
+
+static TAutoConsoleVariable<float> CVarFurMemoryBudgetUpdateInterval(
+	TEXT("gfur.MemoryBudget.UpdateInterval"),
+	0.5f,
+	TEXT("Seconds between the checks of the fur memory budget."),
+	ECVF_Default);
+
+DEFINE_LOG_CATEGORY_STATIC(LogGFurMemory, Log, All);
+
+FFurMemoryBudget& FFurMemoryBudget::Get()
+{
+	static FFurMemoryBudget MemoryBudget;
+	return MemoryBudget;
+}
+
+void FFurMemoryBudget::Startup()
+{
+	TickerHandle = FTSTicker::GetCoreTicker().AddTicker(FTickerDelegate::CreateRaw(this, &FFurMemoryBudget::Tick));
+}
+
+void FFurMemoryBudget::Shutdown()
+{
+	FTSTicker::GetCoreTicker().RemoveTicker(TickerHandle);
+	TickerHandle.Reset();
+
+	FScopeLock Lock(&CriticalSection);
+	FurComponents.Empty();
+}
+
+void FFurMemoryBudget::Register(UGFurComponent* InFurComponent)
+{
+	FScopeLock Lock(&CriticalSection);
+	FurComponents.AddUnique(InFurComponent);
+}
+
+void FFurMemoryBudget::Unregister(UGFurComponent* InFurComponent)
+{
+	FScopeLock Lock(&CriticalSection);
+	FurComponents.RemoveSwap(InFurComponent);
+}
+
+bool FFurMemoryBudget::Tick(float DeltaTime)
+{
+	const double Time = FPlatformTime::Seconds();
+	if (Time < NextUpdateTime)
+		return true;
+	NextUpdateTime = Time + CVarFurMemoryBudgetUpdateInterval.GetValueOnGameThread();
+
+	const uint64 Budget = uint64(FMath::Max(CVarFurMemoryBudget.GetValueOnGameThread(), 0)) * 1024 * 1024;
+	const int32 MaxDemotion = FMath::Clamp(CVarFurMemoryBudgetMaxDemotion.GetValueOnGameThread(), 0, 7);
+
+	// render states are recreated after the lock is released, the components unregister meanwhile
+	TArray<UGFurComponent*> DirtyComponents;
+	{
+		FScopeLock Lock(&CriticalSection);
+
+		bool bBuilding = false;
+		TArray<FEntry> Entries;
+		GatherEntries(Entries, bBuilding);
+		uint64 UsedSize = 0;
+		for (const FEntry& Entry : Entries)
+			UsedSize += Entry.Size;
+
+		if (Budget == 0)
+		{
+			for (UGFurComponent* FurComponent : FurComponents)
+			{
+				if (FurComponent->BudgetDemotion > 0)
+				{
+					FurComponent->BudgetDemotion = 0;
+					DirtyComponents.Add(FurComponent);
+				}
+			}
+			SizeBeforeDemotion = 0;
+		}
+		// the sizes are known once the fur of the last changes has been built
+		else if (!bBuilding)
+		{
+			if (SizeBeforeDemotion)
+			{
+				UE_LOG(LogGFurMemory, Log, TEXT("gFur memory budget %.1f MiB: demotions reclaimed %.1f MiB, %.1f MiB in use"),
+					Budget / (1024.0 * 1024.0), (SizeBeforeDemotion - FMath::Min(UsedSize, SizeBeforeDemotion)) / (1024.0 * 1024.0), UsedSize / (1024.0 * 1024.0));
+				SizeBeforeDemotion = 0;
+			}
+
+			// least significant first, components not rendered lately before the visible ones
+			Entries.Sort([](const FEntry& A, const FEntry& B) {
+				return A.bRecentlyRendered != B.bRecentlyRendered ? B.bRecentlyRendered : A.ScreenSize < B.ScreenSize;
+			});
+
+			if (UsedSize > Budget)
+			{
+				// the fur of an entry is released once all its components are demoted, the demoted fur is about half as large
+				int64 Excess = UsedSize - Budget;
+				for (const FEntry& Entry : Entries)
+				{
+					if (Excess <= 0)
+						break;
+					if (Entry.Size == 0 || Entry.MinDemotion >= MaxDemotion)
+						continue;
+					for (UGFurComponent* FurComponent : Entry.FurComponents)
+					{
+						if (FurComponent->BudgetDemotion >= MaxDemotion)
+							continue;
+						FurComponent->BudgetDemotion++;
+						DirtyComponents.Add(FurComponent);
+					}
+					Excess -= Entry.Size - Entry.Size / 2;
+					UE_LOG(LogGFurMemory, Verbose, TEXT("gFur memory budget: %s and %d components sharing its fur demoted to level %d"),
+						*Entry.FurComponents[0]->GetPathName(), Entry.FurComponents.Num() - 1, Entry.MinDemotion + 1);
+				}
+				if (DirtyComponents.Num())
+					SizeBeforeDemotion = UsedSize;
+			}
+			else
+			{
+				// the most significant demoted entry is promoted once its fur fits, its size about doubles
+				const uint64 PromotionLimit = Budget - Budget / 4;
+				for (int32 Index = Entries.Num() - 1; Index >= 0; Index--)
+				{
+					const FEntry& Entry = Entries[Index];
+					if (Entry.MaxDemotion > 0 && UsedSize + Entry.Size <= PromotionLimit)
+					{
+						for (UGFurComponent* FurComponent : Entry.FurComponents)
+						{
+							if (FurComponent->BudgetDemotion == Entry.MaxDemotion)
+							{
+								FurComponent->BudgetDemotion--;
+								DirtyComponents.Add(FurComponent);
+							}
+						}
+						UE_LOG(LogGFurMemory, Verbose, TEXT("gFur memory budget: %s and %d components sharing its fur promoted to level %d"),
+							*Entry.FurComponents[0]->GetPathName(), Entry.FurComponents.Num() - 1, Entry.MaxDemotion - 1);
+						break;
+					}
+				}
+			}
+		}
+	}
+
+	for (UGFurComponent* FurComponent : DirtyComponents)
+		FurComponent->MarkRenderStateDirty();
+	return true;
+}
+
+void FFurMemoryBudget::GatherEntries(TArray<FEntry>& OutEntries, bool& OutBuilding) const
+{
+	// components sharing fur data, also through other components, form one entry. Its fur is released only when all of them are demoted.
+	TArray<int32> Parents;
+	TMap<const FFurData*, int32> DataComponents;
+	auto FindRoot = [&Parents](int32 Index) {
+		while (Parents[Index] != Index)
+			Index = Parents[Index] = Parents[Parents[Index]];
+		return Index;
+	};
+	for (int32 Index = 0; Index < FurComponents.Num(); Index++)
+	{
+		Parents.Add(Index);
+		for (const FFurData* Data : FurComponents[Index]->FurData)
+		{
+			if (const int32* Other = DataComponents.Find(Data))
+				Parents[FindRoot(Index)] = FindRoot(*Other);
+			else
+				DataComponents.Add(Data, Index);
+		}
+	}
+
+	TMap<int32, int32> RootEntries;
+	for (int32 Index = 0; Index < FurComponents.Num(); Index++)
+	{
+		UGFurComponent* FurComponent = FurComponents[Index];
+		const int32 Root = FindRoot(Index);
+		const int32* EntryIndex = RootEntries.Find(Root);
+		if (EntryIndex == nullptr)
+		{
+			EntryIndex = &RootEntries.Add(Root, OutEntries.AddDefaulted());
+			OutEntries[*EntryIndex].MinDemotion = FurComponent->BudgetDemotion;
+		}
+		FEntry& Entry = OutEntries[*EntryIndex];
+		Entry.FurComponents.Add(FurComponent);
+		Entry.bRecentlyRendered |= FurComponent->WasRecentlyRendered(1.0f);
+		Entry.ScreenSize = FMath::Max(Entry.ScreenSize, CalcScreenSize(FurComponent));
+		Entry.MinDemotion = FMath::Min(Entry.MinDemotion, FurComponent->BudgetDemotion);
+		Entry.MaxDemotion = FMath::Max(Entry.MaxDemotion, FurComponent->BudgetDemotion);
+	}
+
+	// every data belongs to a single entry
+	for (const auto& DataComponent : DataComponents)
+	{
+		const FFurData* Data = DataComponent.Key;
+		if (!Data->HasBuilt())
+			OutBuilding = true;
+		OutEntries[RootEntries[FindRoot(DataComponent.Value)]].Size += Data->GetBuiltSize();
+	}
+}
+
+float FFurMemoryBudget::CalcScreenSize(const UGFurComponent* InFurComponent)
+{
+	// same as FFurBuildScheduler::CalcPriority, bounds radius over the distance to the closest view of the last frame
+	float ScreenSize = 0.0f;
+	const UWorld* World = InFurComponent->GetWorld();
+	if (World == nullptr)
+		return ScreenSize;
+	for (const FVector& ViewLocation : World->ViewLocationsRenderedLastFrame)
+	{
+		float Distance = FVector::Distance(ViewLocation, InFurComponent->Bounds.Origin);
+		ScreenSize = FMath::Max(ScreenSize, float(InFurComponent->Bounds.SphereRadius / FMath::Max(Distance, 1.0f)));
+	}
+	return ScreenSize;
+}
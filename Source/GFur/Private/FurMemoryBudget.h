@@ -0,0 +1,49 @@
+// Copyright 2023 GiM s.r.o. All Rights Reserved.
+
+#pragma once
+
+#include "Containers/Ticker.h"
+
+class FFurData;
+class UGFurComponent;
+
+/**
+* Fur Memory Budget. Keeps the GPU memory of the fur of all components within gfur.MemoryBudgetMB.
+* Over the budget the least significant components are demoted: every demotion level halves their layer counts and evicts
+* their most detailed LOD. Components sharing fur data are demoted together, otherwise the shared fur would stay alive. Under the budget the most significant demoted components are promoted back and rebuilt.
+*/
+class FFurMemoryBudget
+{
+public:
+	static FFurMemoryBudget& Get();
+
+	void Startup();
+	void Shutdown();
+
+	/** Components with a render state, their fur counts against the budget */
+	void Register(UGFurComponent* InFurComponent);
+	void Unregister(UGFurComponent* InFurComponent);
+
+private:
+	/** Components sharing fur data, demoted and promoted together */
+	struct FEntry
+	{
+		TArray<UGFurComponent*, TInlineAllocator<1>> FurComponents;
+		uint64 Size = 0;
+		bool bRecentlyRendered = false;
+		float ScreenSize = 0.0f;
+		int32 MinDemotion = 0;
+		int32 MaxDemotion = 0;
+	};
+
+	FCriticalSection CriticalSection;
+	TArray<UGFurComponent*> FurComponents;
+	FTSTicker::FDelegateHandle TickerHandle;
+	double NextUpdateTime = 0.0;
+	// memory in use before the last demotions, reported once their builds finished
+	uint64 SizeBeforeDemotion = 0;
+
+	bool Tick(float DeltaTime);
+	void GatherEntries(TArray<FEntry>& OutEntries, bool& OutBuilding) const;
+	static float CalcScreenSize(const UGFurComponent* InFurComponent);
+};
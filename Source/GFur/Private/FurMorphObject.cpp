@@ -51,10 +51,10 @@ FFurMorphObject::~FFurMorphObject()
 void FFurMorphObject::Update_RenderThread(FRHICommandListImmediate& RHICmdList, const FMorphTargetWeightMap& ActiveMorphTargets, const TArray<float>& MorphTargetWeights, const TArray<TArray<int32>>& InMorphRemapTables, int InMeshLod)
 {
 	int32 NumFurVertices = FurData->GetNumVertices_RenderThread();
-	int32 NumVertices = NumFurVertices / FurData->GetFurLayerCount();
+	int32 NumVertices = NumFurVertices / FurData->GetVertexLayerCount();
 	if (NumVertices > 0)
 	{
-		int32 NumLayers = FurData->GetFurLayerCount();
+		int32 NumLayers = FurData->GetVertexLayerCount();
 
 		uint32 Size = NumVertices * sizeof(FMorphGPUSkinVertex);
 
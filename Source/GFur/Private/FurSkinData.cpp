@@ -7,10 +7,11 @@
 #include "RHICommandList.h"
 #include "MeshDrawShaderBindings.h"
 #include "ShaderParameterUtils.h"
+#include "DataDrivenShaderPlatformInfo.h"
 #include "FurComponent.h"
+#include "FurBuildScheduler.h"
 
-static TArray< FFurSkinData* > FurSkinData;
-static FCriticalSection FurSkinDataCS;
+static TFurDataRegistry<FFurSkinData> FurSkinData;
 
 // bone limit 512 (from previous 256)
 static unsigned int MaxGPUSkinBones = 512;
@@ -25,12 +26,13 @@ public:
 		: FFurStaticVertexBlitter<TangentBasisTypeT, UVTypeT>(InPositions, InVertices, InColors), SkinWeights(InSkinWeights)
 	{}
 
-	void Blit(FFurSkinVertex<TangentBasisTypeT, UVTypeT, bExtraBoneInfluencesT>& OutVertex, uint32 InVertexIndex) const
+	template<bool bCompactT>
+	void Blit(FFurSkinVertex<TangentBasisTypeT, UVTypeT, bExtraBoneInfluencesT, bCompactT>& OutVertex, uint32 InVertexIndex) const
 	{
-		FFurStaticVertexBlitter<TangentBasisTypeT, UVTypeT>::Blit(OutVertex, InVertexIndex);
+		FFurStaticVertexBlitter<TangentBasisTypeT, UVTypeT>::template Blit<bCompactT>(OutVertex, InVertexIndex);
 
 //		const auto* WeightInfo = SkinWeights.GetSkinWeightPtr<bExtraBoneInfluencesT>(InVertexIndex);
-		const int32 NumInfluences = FFurSkinVertex<TangentBasisTypeT, UVTypeT, bExtraBoneInfluencesT>::NumInfluences;
+		const int32 NumInfluences = FFurSkinVertex<TangentBasisTypeT, UVTypeT, bExtraBoneInfluencesT, bCompactT>::NumInfluences;
 		for (int32 ib = 0; ib < NumInfluences; ib++)
 		{
 		/* // debug code
@@ -66,6 +68,26 @@ public:
 		PreviousBoneMatrices.Bind(ParameterMap, TEXT("PreviousBoneMatrices"));
 		BoneFurOffsets.Bind(ParameterMap, TEXT("BoneFurOffsets"));
 		PreviousBoneFurOffsets.Bind(ParameterMap, TEXT("PreviousBoneFurOffsets"));
+		GrowMeshPositions.Bind(ParameterMap, TEXT("GrowMeshPositions"));
+		GrowMeshTangents.Bind(ParameterMap, TEXT("GrowMeshTangents"));
+		GrowMeshTexCoords.Bind(ParameterMap, TEXT("GrowMeshTexCoords"));
+		GrowMeshColors.Bind(ParameterMap, TEXT("GrowMeshColors"));
+		GrowMeshSkinWeights.Bind(ParameterMap, TEXT("GrowMeshSkinWeights"));
+		GrowMeshNumTexCoordsParameter.Bind(ParameterMap, TEXT("GrowMeshNumTexCoords"));
+		GrowMeshColorIndexMaskParameter.Bind(ParameterMap, TEXT("GrowMeshColorIndexMask"));
+		GrowMeshSkinWeightLayoutParameter.Bind(ParameterMap, TEXT("GrowMeshSkinWeightLayout"));
+		GrowMeshNumBoneInfluencesParameter.Bind(ParameterMap, TEXT("GrowMeshNumBoneInfluences"));
+		CompactVertexFormatParameter.Bind(ParameterMap, TEXT("CompactVertexFormat"));
+		FurLayerCountParameter.Bind(ParameterMap, TEXT("FurLayerCount"));
+		FurShellBiasParameter.Bind(ParameterMap, TEXT("FurShellBias"));
+		FurLengthScaleParameter.Bind(ParameterMap, TEXT("FurLengthScale"));
+		LinearShellsParameter.Bind(ParameterMap, TEXT("LinearShells"));
+		ProceduralShellsParameter.Bind(ParameterMap, TEXT("ProceduralShells"));
+		FurLayerIndexParameter.Bind(ParameterMap, TEXT("FurLayerIndex"));
+		FurNoiseStrengthParameter.Bind(ParameterMap, TEXT("FurNoiseStrength"));
+		FurNoiseSeedParameter.Bind(ParameterMap, TEXT("FurNoiseSeed"));
+		FurProfileStrideParameter.Bind(ParameterMap, TEXT("FurProfileStride"));
+		FurProfilesParameter.Bind(ParameterMap, TEXT("FurProfiles"));
 	}
 
 
@@ -79,6 +101,26 @@ public:
 		Ar << PreviousBoneMatrices;
 		Ar << BoneFurOffsets;
 		Ar << PreviousBoneFurOffsets;
+		Ar << GrowMeshPositions;
+		Ar << GrowMeshTangents;
+		Ar << GrowMeshTexCoords;
+		Ar << GrowMeshColors;
+		Ar << GrowMeshSkinWeights;
+		Ar << GrowMeshNumTexCoordsParameter;
+		Ar << GrowMeshColorIndexMaskParameter;
+		Ar << GrowMeshSkinWeightLayoutParameter;
+		Ar << GrowMeshNumBoneInfluencesParameter;
+		Ar << CompactVertexFormatParameter;
+		Ar << FurLayerCountParameter;
+		Ar << FurShellBiasParameter;
+		Ar << FurLengthScaleParameter;
+		Ar << LinearShellsParameter;
+		Ar << ProceduralShellsParameter;
+		Ar << FurLayerIndexParameter;
+		Ar << FurNoiseStrengthParameter;
+		Ar << FurNoiseSeedParameter;
+		Ar << FurProfileStrideParameter;
+		Ar << FurProfilesParameter;
 	}
 
 
@@ -107,17 +149,37 @@ private:
 	LAYOUT_FIELD(FShaderResourceParameter, PreviousBoneMatrices);
 	LAYOUT_FIELD(FShaderResourceParameter, BoneFurOffsets);
 	LAYOUT_FIELD(FShaderResourceParameter, PreviousBoneFurOffsets);
+	LAYOUT_FIELD(FShaderResourceParameter, GrowMeshPositions);
+	LAYOUT_FIELD(FShaderResourceParameter, GrowMeshTangents);
+	LAYOUT_FIELD(FShaderResourceParameter, GrowMeshTexCoords);
+	LAYOUT_FIELD(FShaderResourceParameter, GrowMeshColors);
+	LAYOUT_FIELD(FShaderResourceParameter, GrowMeshSkinWeights);
+	LAYOUT_FIELD(FShaderParameter, GrowMeshNumTexCoordsParameter);
+	LAYOUT_FIELD(FShaderParameter, GrowMeshColorIndexMaskParameter);
+	LAYOUT_FIELD(FShaderParameter, GrowMeshSkinWeightLayoutParameter);
+	LAYOUT_FIELD(FShaderParameter, GrowMeshNumBoneInfluencesParameter);
+	LAYOUT_FIELD(FShaderParameter, CompactVertexFormatParameter);
+	LAYOUT_FIELD(FShaderParameter, FurLayerCountParameter);
+	LAYOUT_FIELD(FShaderParameter, FurShellBiasParameter);
+	LAYOUT_FIELD(FShaderParameter, FurLengthScaleParameter);
+	LAYOUT_FIELD(FShaderParameter, LinearShellsParameter);
+	LAYOUT_FIELD(FShaderParameter, ProceduralShellsParameter);
+	LAYOUT_FIELD(FShaderParameter, FurLayerIndexParameter);
+	LAYOUT_FIELD(FShaderParameter, FurNoiseStrengthParameter);
+	LAYOUT_FIELD(FShaderParameter, FurNoiseSeedParameter);
+	LAYOUT_FIELD(FShaderParameter, FurProfileStrideParameter);
+	LAYOUT_FIELD(FShaderResourceParameter, FurProfilesParameter);
 };
 
 IMPLEMENT_TYPE_LAYOUT(FFurSkinVertexFactoryShaderParameters<true>)
 IMPLEMENT_TYPE_LAYOUT(FFurSkinVertexFactoryShaderParameters<false>)
 
 /** Vertex Factory */
-template<bool MorphTargets, bool Physics, bool bExtraInfluencesT>
+template<bool MorphTargets, bool Physics, bool bExtraInfluencesT, bool GrowMeshFetch>
 class FFurSkinVertexFactoryBase : public FFurVertexFactory
 {
 
-	typedef FFurSkinVertexFactoryBase<MorphTargets, Physics, bExtraInfluencesT> This;
+	typedef FFurSkinVertexFactoryBase<MorphTargets, Physics, bExtraInfluencesT, GrowMeshFetch> This;
 	
 
 
@@ -129,6 +191,9 @@ public:
 			, MeshExtension(1, 1, 1)
 			, FurOffsetPower(2.0f)
 			, MaxPhysicsOffsetLength(FLT_MAX)
+			, GrowMeshSkinWeights(nullptr)
+			, GrowMeshSkinWeightLayout(0, 0, 0, 0)
+			, GrowMeshNumBoneInfluences(0)
 			, CurrentBuffer(0)
 			, FeatureLevel(InFeatureLevel)
 			, Discontinuous(true)
@@ -142,11 +207,34 @@ public:
 		float FurOffsetPower;
 		float MaxPhysicsOffsetLength;
 
+		/** Grow mesh vertex buffers the shells fetch their base attributes and skin weights from **/
+		FFurGrowMeshFetchData GrowMesh;
+		FRHIShaderResourceView* GrowMeshSkinWeights;
+		/** Vertex stride, offset of the weights, bone index size and bone weight size of the skin weights in bytes **/
+		FUintVector4 GrowMeshSkinWeightLayout;
+		uint32 GrowMeshNumBoneInfluences;
+
+		/** Layer constants not stored per vertex by the compact vertex format **/
+		FFurLayerShaderData Layers;
+
 		void Init(uint32 InBoneCount)
 		{
 			BoneCount = InBoneCount;
 		}
 
+		void SetGrowMesh(const FStaticMeshVertexBuffers& InVertexBuffers, const FSkinWeightVertexBuffer& InSkinWeights)
+		{
+			GrowMesh.Set(InVertexBuffers);
+			GrowMeshSkinWeights = InSkinWeights.GetDataVertexBuffer()->GetSRV();
+			GrowMeshSkinWeightLayout = FUintVector4(
+				InSkinWeights.GetConstantInfluencesVertexStride(),
+				InSkinWeights.GetConstantInfluencesBoneWeightsOffset(),
+				InSkinWeights.GetBoneIndexByteSize(),
+				InSkinWeights.GetBoneWeightByteSize());
+			GrowMeshNumBoneInfluences = InSkinWeights.GetMaxBoneInfluences();
+			check(GrowMeshSkinWeights);
+		}
+
 		// @param FrameTime from GFrameTime
 		void UpdateBoneData(const TArray<FMatrix>& ReferenceToLocalMatrices, const TArray<FVector>& LinearOffsets, const TArray<FVector>& AngularOffsets,
 			const TArray<FMatrix>& LastTransformations, const TArray<FBoneIndexType>& BoneMap, bool InDiscontinuous, ERHIFeatureLevel::Type FeatureLevel);
@@ -300,24 +388,51 @@ public:
 
 		FVertexStreamComponent DeltaPosition;
 		FVertexStreamComponent DeltaTangentZ;
+
+		FVertexStreamComponent SourceVertexIndex;
 	};
 
-	template<EStaticMeshVertexTangentBasisType TangentBasisTypeT, EStaticMeshVertexUVType UVTypeT>
-	void Init(const FFurVertexBuffer* VertexBuffer, const FVertexBuffer* MorphVertexBuffer, uint32 BoneCount)
+	template<EStaticMeshVertexTangentBasisType TangentBasisTypeT, EStaticMeshVertexUVType UVTypeT, bool bCompactT>
+	void Init(const FFurVertexBuffer* VertexBuffer, const FVertexBuffer* MorphVertexBuffer, uint32 BoneCount,
+		const FStaticMeshVertexBuffers* GrowMeshVertexBuffers, const FSkinWeightVertexBuffer* GrowMeshSkinWeights, const FFurLayerShaderData& InLayers)
 	{
-		typedef FFurSkinVertex<TangentBasisTypeT, UVTypeT, bExtraInfluencesT> VertexType;
+		typedef FFurSkinVertex<TangentBasisTypeT, UVTypeT, bExtraInfluencesT, bCompactT> VertexType;
+		typedef FFurShellVertex<bCompactT> ShellVertexType;
+		typedef typename TFurLayerAttributesTypeSelector<bCompactT>::LayerAttributesT LayerAttributesType;
 		ShaderData.Init(BoneCount);
+		ShaderData.Layers = InLayers;
 		ENQUEUE_RENDER_COMMAND(InitProceduralMeshVertexFactory)
-			([this, VertexBuffer, MorphVertexBuffer](FRHICommandListImmediate& RHICmdList) {
+			([this, VertexBuffer, MorphVertexBuffer, GrowMeshVertexBuffers, GrowMeshSkinWeights](FRHICommandListImmediate& RHICmdList) {
 				const auto TangentElementType = TStaticMeshVertexTangentTypeSelector<TangentBasisTypeT>::VertexElementType;
 				const auto UvElementType = UVTypeT == EStaticMeshVertexUVType::HighPrecision ? VET_Float2 : VET_Half2;
 
 				// Initialize the vertex factory's stream components.
 				FDataType NewData;
+				FVertexStreamComponent Uv1Component, Uv2Component;
+				if (GrowMeshFetch)
+				{
+					// UV0 is fetched from the grow mesh, its attribute slot is only kept for the layout of the other UVs.
+					LayerAttributesType::GetStreamComponents(VertexBuffer, STRUCT_OFFSET(ShellVertexType, Layer), sizeof(ShellVertexType), NewData.FurOffset, Uv1Component, Uv2Component);
+					NewData.SourceVertexIndex = STRUCTMEMBER_VERTEXSTREAMCOMPONENT(VertexBuffer, ShellVertexType, SourceVertexIndex, VET_UInt);
+					NewData.TextureCoordinates.Add(Uv1Component);
+					NewData.TextureCoordinates.Add(Uv1Component);
+					NewData.TextureCoordinates.Add(Uv2Component);
+					if (MorphTargets)
+					{
+						NewData.DeltaPosition = STRUCTMEMBER_VERTEXSTREAMCOMPONENT(MorphVertexBuffer, FMorphGPUSkinVertex, DeltaPosition, VET_Float3);
+						NewData.DeltaTangentZ = STRUCTMEMBER_VERTEXSTREAMCOMPONENT(MorphVertexBuffer, FMorphGPUSkinVertex, DeltaTangentZ, VET_Float3);
+					}
+					ShaderData.SetGrowMesh(*GrowMeshVertexBuffers, *GrowMeshSkinWeights);
+
+					SetData(NewData);
+					return;
+				}
+
+				LayerAttributesType::GetStreamComponents(VertexBuffer, STRUCT_OFFSET(VertexType, Layer), sizeof(VertexType), NewData.FurOffset, Uv1Component, Uv2Component);
 				NewData.PositionComponent = STRUCTMEMBER_VERTEXSTREAMCOMPONENT(VertexBuffer, VertexType, Position, VET_Float3);
 				NewData.TextureCoordinates.Add(FVertexStreamComponent(VertexBuffer, STRUCT_OFFSET(VertexType, UV0), sizeof(VertexType), UvElementType));
-				NewData.TextureCoordinates.Add(FVertexStreamComponent(VertexBuffer, STRUCT_OFFSET(VertexType, UV1), sizeof(VertexType), VET_Float2));
-				NewData.TextureCoordinates.Add(FVertexStreamComponent(VertexBuffer, STRUCT_OFFSET(VertexType, UV2), sizeof(VertexType), VET_Float2));
+				NewData.TextureCoordinates.Add(Uv1Component);
+				NewData.TextureCoordinates.Add(Uv2Component);
 				NewData.TangentBasisComponents[0] = STRUCTMEMBER_VERTEXSTREAMCOMPONENT(VertexBuffer, VertexType, TangentX, TangentElementType);
 				NewData.TangentBasisComponents[1] = STRUCTMEMBER_VERTEXSTREAMCOMPONENT(VertexBuffer, VertexType, TangentZ, TangentElementType);
 				NewData.ColorComponent = STRUCTMEMBER_VERTEXSTREAMCOMPONENT(VertexBuffer, VertexType, Color, VET_Color);
@@ -337,7 +452,6 @@ public:
 					NewData.BoneWeightsExtra[0] = FVertexStreamComponent(VertexBuffer, STRUCT_OFFSET(VertexType, InfluenceWeights) + 8, sizeof(VertexType), VET_UShort4N);
 					NewData.BoneWeightsExtra[1] = FVertexStreamComponent(VertexBuffer, STRUCT_OFFSET(VertexType, InfluenceWeights) + 16, sizeof(VertexType), VET_UShort4N);
 				}
-				NewData.FurOffset = STRUCTMEMBER_VERTEXSTREAMCOMPONENT(VertexBuffer, VertexType, FurOffset, VET_Float3);
 
 				if (MorphTargets)
 				{
@@ -369,10 +483,14 @@ public:
 			OutEnvironment.SetDefine(TEXT("GFUR_PHYSICS"), TEXT("1"));
 		if (bExtraInfluencesT)
 			OutEnvironment.SetDefine(TEXT("GPUSKIN_USE_EXTRA_INFLUENCES"), TEXT("1"));
+		if (GrowMeshFetch)
+			OutEnvironment.SetDefine(TEXT("GFUR_GROW_MESH_FETCH"), TEXT("1"));
 	}
 
 	static bool ShouldCompilePermutation(const FVertexFactoryShaderPermutationParameters& Parameters)
 	{
+		if (GrowMeshFetch && !RHISupportsManualVertexFetch(Parameters.Platform))
+			return false;
 		if (Parameters.MaterialParameters.bIsUsedWithSkeletalMesh)
 			return true;
 		if (Parameters.MaterialParameters.bIsSpecialEngineMaterial)
@@ -390,10 +508,17 @@ public:
 
 	void AddVertexElements(FDataType& InData, FVertexDeclarationElementList& OutElements)
 	{
-		OutElements.Add(AccessStreamComponent(InData.PositionComponent, 0));
+		if (GrowMeshFetch)
+		{
+			OutElements.Add(AccessStreamComponent(InData.SourceVertexIndex, 0));
+		}
+		else
+		{
+			OutElements.Add(AccessStreamComponent(InData.PositionComponent, 0));
 
-		OutElements.Add(AccessStreamComponent(InData.TangentBasisComponents[0], 1));
-		OutElements.Add(AccessStreamComponent(InData.TangentBasisComponents[1], 2));
+			OutElements.Add(AccessStreamComponent(InData.TangentBasisComponents[0], 1));
+			OutElements.Add(AccessStreamComponent(InData.TangentBasisComponents[1], 2));
+		}
 
 		if (InData.TextureCoordinates.Num())
 		{
@@ -412,17 +537,20 @@ public:
 			}
 		}
 
-		if (InData.ColorComponent.VertexBuffer)
+		if (!GrowMeshFetch)
 		{
-			OutElements.Add(AccessStreamComponent(InData.ColorComponent, 13));
-		}
-		else
-		{
-			FVertexStreamComponent NullColorComponent(&GNullColorVertexBuffer, 0, 0, VET_Color);
-			OutElements.Add(AccessStreamComponent(NullColorComponent, 13));
+			if (InData.ColorComponent.VertexBuffer)
+			{
+				OutElements.Add(AccessStreamComponent(InData.ColorComponent, 13));
+			}
+			else
+			{
+				FVertexStreamComponent NullColorComponent(&GNullColorVertexBuffer, 0, 0, VET_Color);
+				OutElements.Add(AccessStreamComponent(NullColorComponent, 13));
+			}
+			OutElements.Add(AccessStreamComponent(InData.BoneIndices, 3));
+			OutElements.Add(AccessStreamComponent(InData.BoneWeights, 4));
 		}
-		OutElements.Add(AccessStreamComponent(InData.BoneIndices, 3));
-		OutElements.Add(AccessStreamComponent(InData.BoneWeights, 4));
 		OutElements.Add(AccessStreamComponent(InData.FurOffset, 12));
 
 		if (MorphTargets)
@@ -431,7 +559,7 @@ public:
 			OutElements.Add(AccessStreamComponent(InData.DeltaTangentZ, 10));
 		}
 
-		if (bExtraInfluencesT)
+		if (bExtraInfluencesT && !GrowMeshFetch)
 		{
 			OutElements.Add(AccessStreamComponent(InData.BoneIndicesExtra[0], 14));
 			OutElements.Add(AccessStreamComponent(InData.BoneIndicesExtra[1], 15));
@@ -472,100 +600,148 @@ public:
 	FShaderDataType ShaderData;
 };
 
-class FMorphPhysicsExtraInfluencesFurSkinVertexFactory : public FFurSkinVertexFactoryBase<true, true, true>
+class FMorphPhysicsExtraInfluencesFurSkinVertexFactory : public FFurSkinVertexFactoryBase<true, true, true, false>
 {
 	DECLARE_VERTEX_FACTORY_TYPE(FMorphPhysicsExtraInfluencesFurSkinVertexFactory);
 public:
 	FMorphPhysicsExtraInfluencesFurSkinVertexFactory(ERHIFeatureLevel::Type InFeatureLevel)
-		: FFurSkinVertexFactoryBase<true, true, true>(InFeatureLevel)
+		: FFurSkinVertexFactoryBase<true, true, true, false>(InFeatureLevel)
 	{
 	}
 
-	using FFurSkinVertexFactoryBase<true, true, true>::Init;
+	using FFurSkinVertexFactoryBase<true, true, true, false>::Init;
 };
 
-class FPhysicsExtraInfluencesFurSkinVertexFactory : public FFurSkinVertexFactoryBase<false, true, true>
+class FPhysicsExtraInfluencesFurSkinVertexFactory : public FFurSkinVertexFactoryBase<false, true, true, false>
 {
 	DECLARE_VERTEX_FACTORY_TYPE(FPhysicsExtraInfluencesFurSkinVertexFactory);
 public:
 	FPhysicsExtraInfluencesFurSkinVertexFactory(ERHIFeatureLevel::Type InFeatureLevel)
-		: FFurSkinVertexFactoryBase<false, true, true>(InFeatureLevel)
+		: FFurSkinVertexFactoryBase<false, true, true, false>(InFeatureLevel)
 	{
 	}
 
-	using FFurSkinVertexFactoryBase<false, true, true>::Init;
+	using FFurSkinVertexFactoryBase<false, true, true, false>::Init;
 };
 
-class FMorphExtraInfluencesFurSkinVertexFactory : public FFurSkinVertexFactoryBase<true, false, true>
+class FMorphExtraInfluencesFurSkinVertexFactory : public FFurSkinVertexFactoryBase<true, false, true, false>
 {
 	DECLARE_VERTEX_FACTORY_TYPE(FMorphExtraInfluencesFurSkinVertexFactory);
 public:
 	FMorphExtraInfluencesFurSkinVertexFactory(ERHIFeatureLevel::Type InFeatureLevel)
-		: FFurSkinVertexFactoryBase<true, false, true>(InFeatureLevel)
+		: FFurSkinVertexFactoryBase<true, false, true, false>(InFeatureLevel)
 	{
 	}
 
-	using FFurSkinVertexFactoryBase<true, false, true>::Init;
+	using FFurSkinVertexFactoryBase<true, false, true, false>::Init;
 };
 
-class FExtraInfluencesFurSkinVertexFactory : public FFurSkinVertexFactoryBase<false, false, true>
+class FExtraInfluencesFurSkinVertexFactory : public FFurSkinVertexFactoryBase<false, false, true, false>
 {
 	DECLARE_VERTEX_FACTORY_TYPE(FExtraInfluencesFurSkinVertexFactory);
 public:
 	FExtraInfluencesFurSkinVertexFactory(ERHIFeatureLevel::Type InFeatureLevel)
-		: FFurSkinVertexFactoryBase<false, false, true>(InFeatureLevel)
+		: FFurSkinVertexFactoryBase<false, false, true, false>(InFeatureLevel)
 	{
 	}
 
-	using FFurSkinVertexFactoryBase<false, false, true>::Init;
+	using FFurSkinVertexFactoryBase<false, false, true, false>::Init;
 };
 
-class FMorphPhysicsFurSkinVertexFactory : public FFurSkinVertexFactoryBase<true, true, false>
+class FMorphPhysicsFurSkinVertexFactory : public FFurSkinVertexFactoryBase<true, true, false, false>
 {
 	DECLARE_VERTEX_FACTORY_TYPE(FMorphPhysicsFurSkinVertexFactory);
 public:
 	FMorphPhysicsFurSkinVertexFactory(ERHIFeatureLevel::Type InFeatureLevel)
-		: FFurSkinVertexFactoryBase<true, true, false>(InFeatureLevel)
+		: FFurSkinVertexFactoryBase<true, true, false, false>(InFeatureLevel)
 	{
 	}
 
-	using FFurSkinVertexFactoryBase<true, true, false>::Init;
+	using FFurSkinVertexFactoryBase<true, true, false, false>::Init;
 };
 
-class FPhysicsFurSkinVertexFactory : public FFurSkinVertexFactoryBase<false, true, false>
+class FPhysicsFurSkinVertexFactory : public FFurSkinVertexFactoryBase<false, true, false, false>
 {
 	DECLARE_VERTEX_FACTORY_TYPE(FPhysicsFurSkinVertexFactory);
 public:
 	FPhysicsFurSkinVertexFactory(ERHIFeatureLevel::Type InFeatureLevel)
-		: FFurSkinVertexFactoryBase<false, true, false>(InFeatureLevel)
+		: FFurSkinVertexFactoryBase<false, true, false, false>(InFeatureLevel)
 	{
 	}
 
-	using FFurSkinVertexFactoryBase<false, true, false>::Init;
+	using FFurSkinVertexFactoryBase<false, true, false, false>::Init;
 };
 
-class FMorphFurSkinVertexFactory : public FFurSkinVertexFactoryBase<true, false, false>
+class FMorphFurSkinVertexFactory : public FFurSkinVertexFactoryBase<true, false, false, false>
 {
 	DECLARE_VERTEX_FACTORY_TYPE(FMorphFurSkinVertexFactory);
 public:
 	FMorphFurSkinVertexFactory(ERHIFeatureLevel::Type InFeatureLevel)
-		: FFurSkinVertexFactoryBase<true, false, false>(InFeatureLevel)
+		: FFurSkinVertexFactoryBase<true, false, false, false>(InFeatureLevel)
 	{
 	}
 
-	using FFurSkinVertexFactoryBase<true, false, false>::Init;
+	using FFurSkinVertexFactoryBase<true, false, false, false>::Init;
 };
 
-class FFurSkinVertexFactory : public FFurSkinVertexFactoryBase<false, false, false>
+class FFurSkinVertexFactory : public FFurSkinVertexFactoryBase<false, false, false, false>
 {
 	DECLARE_VERTEX_FACTORY_TYPE(FFurSkinVertexFactory);
 public:
 	FFurSkinVertexFactory(ERHIFeatureLevel::Type InFeatureLevel)
-		: FFurSkinVertexFactoryBase<false, false, false>(InFeatureLevel)
+		: FFurSkinVertexFactoryBase<false, false, false, false>(InFeatureLevel)
 	{
 	}
 
-	using FFurSkinVertexFactoryBase<false, false, false>::Init;
+	using FFurSkinVertexFactoryBase<false, false, false, false>::Init;
+};
+
+class FMorphPhysicsGrowMeshFurSkinVertexFactory : public FFurSkinVertexFactoryBase<true, true, false, true>
+{
+	DECLARE_VERTEX_FACTORY_TYPE(FMorphPhysicsGrowMeshFurSkinVertexFactory);
+public:
+	FMorphPhysicsGrowMeshFurSkinVertexFactory(ERHIFeatureLevel::Type InFeatureLevel)
+		: FFurSkinVertexFactoryBase<true, true, false, true>(InFeatureLevel)
+	{
+	}
+
+	using FFurSkinVertexFactoryBase<true, true, false, true>::Init;
+};
+
+class FPhysicsGrowMeshFurSkinVertexFactory : public FFurSkinVertexFactoryBase<false, true, false, true>
+{
+	DECLARE_VERTEX_FACTORY_TYPE(FPhysicsGrowMeshFurSkinVertexFactory);
+public:
+	FPhysicsGrowMeshFurSkinVertexFactory(ERHIFeatureLevel::Type InFeatureLevel)
+		: FFurSkinVertexFactoryBase<false, true, false, true>(InFeatureLevel)
+	{
+	}
+
+	using FFurSkinVertexFactoryBase<false, true, false, true>::Init;
+};
+
+class FMorphGrowMeshFurSkinVertexFactory : public FFurSkinVertexFactoryBase<true, false, false, true>
+{
+	DECLARE_VERTEX_FACTORY_TYPE(FMorphGrowMeshFurSkinVertexFactory);
+public:
+	FMorphGrowMeshFurSkinVertexFactory(ERHIFeatureLevel::Type InFeatureLevel)
+		: FFurSkinVertexFactoryBase<true, false, false, true>(InFeatureLevel)
+	{
+	}
+
+	using FFurSkinVertexFactoryBase<true, false, false, true>::Init;
+};
+
+class FGrowMeshFurSkinVertexFactory : public FFurSkinVertexFactoryBase<false, false, false, true>
+{
+	DECLARE_VERTEX_FACTORY_TYPE(FGrowMeshFurSkinVertexFactory);
+public:
+	FGrowMeshFurSkinVertexFactory(ERHIFeatureLevel::Type InFeatureLevel)
+		: FFurSkinVertexFactoryBase<false, false, false, true>(InFeatureLevel)
+	{
+	}
+
+	using FFurSkinVertexFactoryBase<false, false, false, true>::Init;
 };
 
 IMPLEMENT_VERTEX_FACTORY_PARAMETER_TYPE(FMorphPhysicsExtraInfluencesFurSkinVertexFactory, SF_Vertex, FFurSkinVertexFactoryShaderParameters<true>);
@@ -576,6 +752,10 @@ IMPLEMENT_VERTEX_FACTORY_PARAMETER_TYPE(FMorphPhysicsFurSkinVertexFactory, SF_Ve
 IMPLEMENT_VERTEX_FACTORY_PARAMETER_TYPE(FPhysicsFurSkinVertexFactory, SF_Vertex, FFurSkinVertexFactoryShaderParameters<true>);
 IMPLEMENT_VERTEX_FACTORY_PARAMETER_TYPE(FMorphFurSkinVertexFactory, SF_Vertex, FFurSkinVertexFactoryShaderParameters<false>);
 IMPLEMENT_VERTEX_FACTORY_PARAMETER_TYPE(FFurSkinVertexFactory, SF_Vertex, FFurSkinVertexFactoryShaderParameters<false>);
+IMPLEMENT_VERTEX_FACTORY_PARAMETER_TYPE(FMorphPhysicsGrowMeshFurSkinVertexFactory, SF_Vertex, FFurSkinVertexFactoryShaderParameters<true>);
+IMPLEMENT_VERTEX_FACTORY_PARAMETER_TYPE(FPhysicsGrowMeshFurSkinVertexFactory, SF_Vertex, FFurSkinVertexFactoryShaderParameters<true>);
+IMPLEMENT_VERTEX_FACTORY_PARAMETER_TYPE(FMorphGrowMeshFurSkinVertexFactory, SF_Vertex, FFurSkinVertexFactoryShaderParameters<false>);
+IMPLEMENT_VERTEX_FACTORY_PARAMETER_TYPE(FGrowMeshFurSkinVertexFactory, SF_Vertex, FFurSkinVertexFactoryShaderParameters<false>);
 
 IMPLEMENT_VERTEX_FACTORY_TYPE(FMorphPhysicsExtraInfluencesFurSkinVertexFactory, "/Plugin/gFur/Private/GFurFactory.ush",
 	EVertexFactoryFlags::UsedWithMaterials
@@ -609,6 +789,22 @@ IMPLEMENT_VERTEX_FACTORY_TYPE(FFurSkinVertexFactory, "/Plugin/gFur/Private/GFurF
 	EVertexFactoryFlags::UsedWithMaterials
 	| EVertexFactoryFlags::SupportsDynamicLighting
 	| EVertexFactoryFlags::SupportsPrecisePrevWorldPos);
+IMPLEMENT_VERTEX_FACTORY_TYPE(FMorphPhysicsGrowMeshFurSkinVertexFactory, "/Plugin/gFur/Private/GFurFactory.ush",
+	EVertexFactoryFlags::UsedWithMaterials
+	| EVertexFactoryFlags::SupportsDynamicLighting
+	| EVertexFactoryFlags::SupportsPrecisePrevWorldPos);
+IMPLEMENT_VERTEX_FACTORY_TYPE(FPhysicsGrowMeshFurSkinVertexFactory, "/Plugin/gFur/Private/GFurFactory.ush",
+	EVertexFactoryFlags::UsedWithMaterials
+	| EVertexFactoryFlags::SupportsDynamicLighting
+	| EVertexFactoryFlags::SupportsPrecisePrevWorldPos);
+IMPLEMENT_VERTEX_FACTORY_TYPE(FMorphGrowMeshFurSkinVertexFactory, "/Plugin/gFur/Private/GFurFactory.ush",
+	EVertexFactoryFlags::UsedWithMaterials
+	| EVertexFactoryFlags::SupportsDynamicLighting
+	| EVertexFactoryFlags::SupportsPrecisePrevWorldPos);
+IMPLEMENT_VERTEX_FACTORY_TYPE(FGrowMeshFurSkinVertexFactory, "/Plugin/gFur/Private/GFurFactory.ush",
+	EVertexFactoryFlags::UsedWithMaterials
+	| EVertexFactoryFlags::SupportsDynamicLighting
+	| EVertexFactoryFlags::SupportsPrecisePrevWorldPos);
 
 // Fix from gloriousayu
 #if ENGINE_MAJOR_VERSION == 5 && ENGINE_MINOR_VERSION >= 4
@@ -637,15 +833,15 @@ IMPLEMENT_GLOBAL_SHADER_PARAMETER_STRUCT(FBoneMatricesUniformShaderParameters, "
 
 static FBoneMatricesUniformShaderParameters GBoneUniformStruct;
 
-template<bool MorphTargets, bool Physics, bool ExtraInfluences>
-void FFurSkinVertexFactoryBase<MorphTargets, Physics, ExtraInfluences>::FShaderDataType::GoToNextFrame(bool InDiscontinuous)
+template<bool MorphTargets, bool Physics, bool ExtraInfluences, bool GrowMeshFetch>
+void FFurSkinVertexFactoryBase<MorphTargets, Physics, ExtraInfluences, GrowMeshFetch>::FShaderDataType::GoToNextFrame(bool InDiscontinuous)
 {
 	CurrentBuffer = 1 - CurrentBuffer;
 	Discontinuous = InDiscontinuous;
 }
 
-template<bool MorphTargets, bool Physics, bool ExtraInfluences>
-void FFurSkinVertexFactoryBase<MorphTargets, Physics, ExtraInfluences>::FShaderDataType::UpdateBoneData(const TArray<FMatrix>& ReferenceToLocalMatrices, const TArray<FVector>& LinearOffsets, const TArray<FVector>& AngularOffsets,
+template<bool MorphTargets, bool Physics, bool ExtraInfluences, bool GrowMeshFetch>
+void FFurSkinVertexFactoryBase<MorphTargets, Physics, ExtraInfluences, GrowMeshFetch>::FShaderDataType::UpdateBoneData(const TArray<FMatrix>& ReferenceToLocalMatrices, const TArray<FVector>& LinearOffsets, const TArray<FVector>& AngularOffsets,
 	const TArray<FMatrix>& LastTransformations, const TArray<FBoneIndexType>& BoneMap, bool InDiscontinuous, ERHIFeatureLevel::Type InFeatureLevel)
 {
 	//class FRHICommandListBase* RHICmdList;
@@ -780,8 +976,8 @@ void FFurSkinVertexFactoryBase<MorphTargets, Physics, ExtraInfluences>::FShaderD
 	}
 }
 
-template<bool MorphTargets, bool Physics, bool ExtraInfluences>
-void FFurSkinVertexFactoryBase<MorphTargets, Physics, ExtraInfluences>::FShaderDataType::InitDynamicRHI()
+template<bool MorphTargets, bool Physics, bool ExtraInfluences, bool GrowMeshFetch>
+void FFurSkinVertexFactoryBase<MorphTargets, Physics, ExtraInfluences, GrowMeshFetch>::FShaderDataType::InitDynamicRHI()
 {
 	const uint32 NumBones = BoneCount;
 	check(NumBones <= MaxGPUSkinBones);
@@ -931,22 +1127,46 @@ void FFurSkinVertexFactoryShaderParameters<Physics>::GetElementShaderBindings(
 	{
 		ShaderBindings.Add(Shader->GetUniformBufferParameter<FBoneMatricesUniformShaderParameters>(), ShaderData.GetUniformBuffer());
 	}
+
+	if (GrowMeshPositions.IsBound())
+	{
+		ShaderBindings.Add(GrowMeshPositions, ShaderData.GrowMesh.Positions);
+		ShaderBindings.Add(GrowMeshTangents, ShaderData.GrowMesh.Tangents);
+		ShaderBindings.Add(GrowMeshTexCoords, ShaderData.GrowMesh.TexCoords);
+		ShaderBindings.Add(GrowMeshColors, ShaderData.GrowMesh.Colors);
+		ShaderBindings.Add(GrowMeshSkinWeights, ShaderData.GrowMeshSkinWeights);
+		ShaderBindings.Add(GrowMeshNumTexCoordsParameter, ShaderData.GrowMesh.NumTexCoords);
+		ShaderBindings.Add(GrowMeshColorIndexMaskParameter, ShaderData.GrowMesh.ColorIndexMask);
+		ShaderBindings.Add(GrowMeshSkinWeightLayoutParameter, ShaderData.GrowMeshSkinWeightLayout);
+		ShaderBindings.Add(GrowMeshNumBoneInfluencesParameter, ShaderData.GrowMeshNumBoneInfluences);
+	}
+
+	ShaderBindings.Add(CompactVertexFormatParameter, ShaderData.Layers.CompactVertexFormat);
+	ShaderBindings.Add(FurLayerCountParameter, ShaderData.Layers.FurLayerCount);
+	// the linear shells are shared by components differing in the shell bias and the noise strength, their vertex factories hold them
+	const FFurVertexFactory* FurVertexFactory = static_cast<const FFurVertexFactory*>(VertexFactory);
+	ShaderBindings.Add(FurShellBiasParameter, ShaderData.Layers.LinearShells ? FurVertexFactory->GetFurShellBias() : ShaderData.Layers.ShellBias);
+	ShaderBindings.Add(FurLengthScaleParameter, FurVertexFactory->GetFurLengthScale());
+	ShaderBindings.Add(LinearShellsParameter, ShaderData.Layers.LinearShells);
+	ShaderBindings.Add(ProceduralShellsParameter, ShaderData.Layers.ProceduralShells);
+	// procedural shells draw every layer as its own batch, UserIndex is the layer counted from the tip
+	ShaderBindings.Add(FurLayerIndexParameter, ShaderData.Layers.ProceduralShells ? (uint32)BatchElement.UserIndex : 0u);
+	ShaderBindings.Add(FurNoiseStrengthParameter, ShaderData.Layers.LinearShells ? FurVertexFactory->GetFurNoiseStrength() : ShaderData.Layers.NoiseStrength);
+	ShaderBindings.Add(FurNoiseSeedParameter, ShaderData.Layers.NoiseSeed);
+	ShaderBindings.Add(FurProfileStrideParameter, ShaderData.Layers.GetProfileStride());
+	ShaderBindings.Add(FurProfilesParameter, ShaderData.Layers.GetProfilesSRV());
 }
 
 /** Fur Skin Data */
-FFurSkinData* FFurSkinData::CreateFurData(int32 InFurLayerCount, int32 InLod, UGFurComponent* InFurComponent)
+FFurSkinData* FFurSkinData::CreateFurData(int32 InFurLayerCount, int32 InLod, UGFurComponent* InFurComponent, const TSharedPtr<FByteBulkData, ESPMode::ThreadSafe>& InCookedData, const UGFurComponent* InCookedComponent)
 {
 	check(InFurLayerCount >= MinimalFurLayerCount && InFurLayerCount <= MaximalFurLayerCount);
 
-	FScopeLock lock(&FurSkinDataCS);
-
-	for (FFurSkinData* Data : FurSkinData)
+	const FSHAHash Key = CalcRegistryKey(InFurLayerCount, InLod, InFurComponent);
+	if (FFurSkinData* Data = FurSkinData.Find(Key))
 	{
-		if (Data->Compare(InFurLayerCount, InLod, InFurComponent))
-		{
-			Data->RefCount++;
-			return Data;
-		}
+		Data->LaunchBuild(InFurComponent, [Data]() { Data->BuildFur(BuildType::Full); });
+		return Data;
 	}
 /*	for (FFurSkinData* Data : FurSkinData)
 	{
@@ -959,52 +1179,113 @@ FFurSkinData* FFurSkinData::CreateFurData(int32 InFurLayerCount, int32 InLod, UG
 		}
 	}*/
 
-	FFurSkinData* Data = new FFurSkinData();
-	Data->Set(InFurLayerCount, InLod, InFurComponent);
-	Data->BuildFur(BuildType::Full);
-	FurSkinData.Add(Data);
+	// set outside of the registry lock, it may generate the splines of the guide meshes
+	FFurSkinData* NewData = new FFurSkinData();
+	NewData->Set(InFurLayerCount, InLod, InFurComponent);
+	// the payload of a Blueprint template is loaded only when the spawned component generates the same fur
+	if (InCookedComponent == nullptr || InCookedComponent == InFurComponent || CalcRegistryKey(InFurLayerCount, InLod, InCookedComponent) == Key)
+		NewData->CookedData = InCookedData;
+	FFurSkinData* Data = FurSkinData.Add(Key, NewData);
+	if (Data != NewData)
+		delete NewData;
+	Data->LaunchBuild(InFurComponent, [Data]() { Data->BuildFur(BuildType::Full); });
 	return Data;
 }
 
-void FFurSkinData::DestroyFurData(const TArray<FFurData*>& InFurDataArray)
+static void DeleteEvictedData(const TArray<FFurSkinData*>& InEvictedData)
 {
-	FScopeLock lock(&FurSkinDataCS);
-
-	for (auto* Data : InFurDataArray)
-		((FFurSkinData*)Data)->RefCount--;
-
-	StartFurDataCleanupTask([]() {
-
-		FScopeLock lock(&FurSkinDataCS);
+	if (InEvictedData.Num() == 0)
+		return;
 
-		for (int32 i = FurSkinData.Num() - 1; i >= 0; i--)
+#if WITH_EDITORONLY_DATA
+	// a debounced edit must not start a build after the cleanup waited for the last one
+	for (FFurSkinData* Data : InEvictedData)
+		FFurBuildScheduler::Get().CancelEdit(Data);
+#endif // WITH_EDITORONLY_DATA
+	StartFurDataCleanupTask([InEvictedData]() {
+		// a component destroyed right after its creation may still be building
+		for (FFurSkinData* Data : InEvictedData)
 		{
-			FFurSkinData* Data = FurSkinData[i];
-			if (Data->RefCount == 0)
-			{
-				FurSkinData.RemoveAt(i);
-				ENQUEUE_RENDER_COMMAND(ReleaseDataCommand)([Data](FRHICommandListImmediate& RHICmdList) { delete Data; });
-			}
+			Data->WaitForBuild();
+			ENQUEUE_RENDER_COMMAND(ReleaseDataCommand)([Data](FRHICommandListImmediate& RHICmdList) { delete Data; });
 		}
 	});
 }
 
-void FFurSkinData::CreateVertexFactories(TArray<FFurVertexFactory*>& VertexFactories, FVertexBuffer* InMorphVertexBuffer, bool InPhysics, ERHIFeatureLevel::Type InFeatureLevel)
+void FFurSkinData::DestroyFurData(const TArray<FFurData*>& InFurDataArray)
 {
+	FurSkinData.Release(InFurDataArray, [](FFurData* Data) { FFurBuildScheduler::Get().Cancel(Data); });
+
+	TArray<FFurSkinData*> EvictedData;
+	FurSkinData.Trim(GetRetentionBudget(), GetRetentionMaxEntries(), EvictedData);
+	DeleteEvictedData(EvictedData);
+}
+
+void FFurSkinData::GetRegistryStats(int32& OutNumData, uint64& OutBuiltSize)
+{
+	FurSkinData.GetStats(OutNumData, OutBuiltSize);
+}
+
+const FSkeletalMeshLODRenderData* FFurSkinData::GetGrowMeshRenderData_RenderThread() const
+{
+	const FSkeletalMeshRenderData* RenderData = SkeletalMesh->GetResourceForRendering();
+	if (RenderData == nullptr || !RenderData->LODRenderData.IsValidIndex(Lod))
+		return nullptr;
+	const FSkeletalMeshLODRenderData& LodRenderData = RenderData->LODRenderData[Lod];
+	if (!LodRenderData.StaticVertexBuffers.PositionVertexBuffer.IsInitialized() || LodRenderData.StaticVertexBuffers.PositionVertexBuffer.GetNumVertices() != GrowMeshVertexCount
+		|| LodRenderData.SkinWeightVertexBuffer.GetVariableBonesPerVertex())
+		return nullptr;
+	return &LodRenderData;
+}
+
+bool FFurSkinData::CreateVertexFactories(TArray<FFurVertexFactory*>& VertexFactories, FVertexBuffer* InMorphVertexBuffer, bool InPhysics, ERHIFeatureLevel::Type InFeatureLevel)
+{
+	const FStaticMeshVertexBuffers* GrowMeshVertexBuffers = nullptr;
+	const FSkinWeightVertexBuffer* GrowMeshSkinWeights = nullptr;
+	if (bGrowMeshFetch)
+	{
+		const FSkeletalMeshLODRenderData* GrowMeshRenderData = GetGrowMeshRenderData_RenderThread();
+		if (GrowMeshRenderData == nullptr)
+			return false;
+		GrowMeshVertexBuffers = &GrowMeshRenderData->StaticVertexBuffers;
+		GrowMeshSkinWeights = &GrowMeshRenderData->SkinWeightVertexBuffer;
+	}
+
+	const FFurLayerShaderData Layers = GetLayerShaderData();
 	auto CreateVertexFactory = [&](const FFurData::FSection& s, auto* vf) {
 		if (bUseHighPrecisionTangentBasis)
 		{
 			if (bUseFullPrecisionUVs)
-				vf->template Init<EStaticMeshVertexTangentBasisType::HighPrecision, EStaticMeshVertexUVType::HighPrecision>(&VertexBuffer, InMorphVertexBuffer, s.NumBones);
+			{
+				if (bUseCompactVertexFormat)
+					vf->template Init<EStaticMeshVertexTangentBasisType::HighPrecision, EStaticMeshVertexUVType::HighPrecision, true>(&VertexBuffer, InMorphVertexBuffer, s.NumBones, GrowMeshVertexBuffers, GrowMeshSkinWeights, Layers);
+				else
+					vf->template Init<EStaticMeshVertexTangentBasisType::HighPrecision, EStaticMeshVertexUVType::HighPrecision, false>(&VertexBuffer, InMorphVertexBuffer, s.NumBones, GrowMeshVertexBuffers, GrowMeshSkinWeights, Layers);
+			}
 			else
-				vf->template Init<EStaticMeshVertexTangentBasisType::HighPrecision, EStaticMeshVertexUVType::Default>(&VertexBuffer, InMorphVertexBuffer, s.NumBones);
+			{
+				if (bUseCompactVertexFormat)
+					vf->template Init<EStaticMeshVertexTangentBasisType::HighPrecision, EStaticMeshVertexUVType::Default, true>(&VertexBuffer, InMorphVertexBuffer, s.NumBones, GrowMeshVertexBuffers, GrowMeshSkinWeights, Layers);
+				else
+					vf->template Init<EStaticMeshVertexTangentBasisType::HighPrecision, EStaticMeshVertexUVType::Default, false>(&VertexBuffer, InMorphVertexBuffer, s.NumBones, GrowMeshVertexBuffers, GrowMeshSkinWeights, Layers);
+			}
 		}
 		else
 		{
 			if (bUseFullPrecisionUVs)
-				vf->template Init<EStaticMeshVertexTangentBasisType::Default, EStaticMeshVertexUVType::HighPrecision>(&VertexBuffer, InMorphVertexBuffer, s.NumBones);
+			{
+				if (bUseCompactVertexFormat)
+					vf->template Init<EStaticMeshVertexTangentBasisType::Default, EStaticMeshVertexUVType::HighPrecision, true>(&VertexBuffer, InMorphVertexBuffer, s.NumBones, GrowMeshVertexBuffers, GrowMeshSkinWeights, Layers);
+				else
+					vf->template Init<EStaticMeshVertexTangentBasisType::Default, EStaticMeshVertexUVType::HighPrecision, false>(&VertexBuffer, InMorphVertexBuffer, s.NumBones, GrowMeshVertexBuffers, GrowMeshSkinWeights, Layers);
+			}
 			else
-				vf->template Init<EStaticMeshVertexTangentBasisType::Default, EStaticMeshVertexUVType::Default>(&VertexBuffer, InMorphVertexBuffer, s.NumBones);
+			{
+				if (bUseCompactVertexFormat)
+					vf->template Init<EStaticMeshVertexTangentBasisType::Default, EStaticMeshVertexUVType::Default, true>(&VertexBuffer, InMorphVertexBuffer, s.NumBones, GrowMeshVertexBuffers, GrowMeshSkinWeights, Layers);
+				else
+					vf->template Init<EStaticMeshVertexTangentBasisType::Default, EStaticMeshVertexUVType::Default, false>(&VertexBuffer, InMorphVertexBuffer, s.NumBones, GrowMeshVertexBuffers, GrowMeshSkinWeights, Layers);
+			}
 		}
 		BeginInitResource(vf);
 		VertexFactories.Add(vf);
@@ -1012,7 +1293,26 @@ void FFurSkinData::CreateVertexFactories(TArray<FFurVertexFactory*>& VertexFacto
 
 	for (auto& s : Sections)
 	{
-		if (InPhysics && InFeatureLevel >= ERHIFeatureLevel::ES3_1)
+		if (bGrowMeshFetch)
+		{
+			// Skin weights of any influence count are fetched by the same factories
+			bool Physics = InPhysics && InFeatureLevel >= ERHIFeatureLevel::ES3_1;
+			if (InMorphVertexBuffer)
+			{
+				if (Physics)
+					CreateVertexFactory(s, new FMorphPhysicsGrowMeshFurSkinVertexFactory(InFeatureLevel));
+				else
+					CreateVertexFactory(s, new FMorphGrowMeshFurSkinVertexFactory(InFeatureLevel));
+			}
+			else
+			{
+				if (Physics)
+					CreateVertexFactory(s, new FPhysicsGrowMeshFurSkinVertexFactory(InFeatureLevel));
+				else
+					CreateVertexFactory(s, new FGrowMeshFurSkinVertexFactory(InFeatureLevel));
+			}
+		}
+		else if (InPhysics && InFeatureLevel >= ERHIFeatureLevel::ES3_1)
 		{
 			if (InMorphVertexBuffer)
 			{
@@ -1047,6 +1347,7 @@ void FFurSkinData::CreateVertexFactories(TArray<FFurVertexFactory*>& VertexFacto
 			}
 		}
 	}
+	return true;
 }
 
 FFurSkinData::~FFurSkinData()
@@ -1088,6 +1389,7 @@ void FFurSkinData::UnbindChangeDelegates()
 			GuideMeshes[i]->GetOnMeshChanged().Remove(GuideMeshesChangeHandles[i]);
 	}
 	GuideMeshesChangeHandles.Reset();
+	FFurBuildScheduler::Get().CancelEdit(this);
 #endif // WITH_EDITORONLY_DATA
 }
 
@@ -1106,6 +1408,8 @@ void FFurSkinData::Set(int32 InFurLayerCount, int32 InLod, class UGFurComponent*
 
 	SkeletalMesh = InFurComponent->SkeletalGrowMesh;
 	GuideMeshes = InFurComponent->SkeletalGuideMeshes;
+	if (SkeletalMesh)
+		ReferencedAssets.Emplace(SkeletalMesh);
 #if WITH_EDITORONLY_DATA
 	if (SkeletalMesh)
 		SkeletalMesh->AddToRoot();
@@ -1125,11 +1429,11 @@ void FFurSkinData::Set(int32 InFurLayerCount, int32 InLod, class UGFurComponent*
 	}
 
 #if WITH_EDITORONLY_DATA
-	SkeletalMeshChangeHandle = SkeletalMesh->GetOnMeshChanged().AddLambda([this]() { BuildFur(BuildType::Full); });
+	SkeletalMeshChangeHandle = SkeletalMesh->GetOnMeshChanged().AddLambda([this]() { RequestEditBuild(BuildType::Full); });
 	if (FurSplinesAssigned)
 	{
-		FurSplinesChangeHandle = FurSplinesAssigned->OnSplinesChanged.AddLambda([this]() { BuildFur(BuildType::Splines); });
-		FurSplinesCombHandle = FurSplinesAssigned->OnSplinesCombed.AddLambda([this](const TArray<uint32>& VertexSet) { BuildFur(VertexSet); });
+		FurSplinesChangeHandle = FurSplinesAssigned->OnSplinesChanged.AddLambda([this]() { RequestEditBuild(BuildType::Splines); });
+		FurSplinesCombHandle = FurSplinesAssigned->OnSplinesCombed.AddLambda([this](const TArray<uint32>& VertexSet) { RequestEditBuild(VertexSet); });
 	}
 	else if (GuideMeshes.Num() > 0)
 	{
@@ -1137,14 +1441,7 @@ void FFurSkinData::Set(int32 InFurLayerCount, int32 InLod, class UGFurComponent*
 		{
 			if (GuideMesh)
 			{
-				auto Handle = GuideMesh->GetOnMeshChanged().AddLambda([this, InLod]() {
-					if (FurSplinesGenerated)
-						FurSplinesGenerated->ConditionalBeginDestroy();
-					FurSplinesGenerated = NewObject<UFurSplines>();
-					GenerateSplines(FurSplinesGenerated, SkeletalMesh, InLod, GuideMeshes);
-					FurSplinesUsed = FurSplinesGenerated;
-					BuildFur(BuildType::Splines);
-				});
+				auto Handle = GuideMesh->GetOnMeshChanged().AddLambda([this]() { RequestEditBuild(BuildType::Splines, true); });
 				GuideMeshesChangeHandles.Add(Handle);
 			}
 			else
@@ -1156,9 +1453,97 @@ void FFurSkinData::Set(int32 InFurLayerCount, int32 InLod, class UGFurComponent*
 #endif // WITH_EDITORONLY_DATA
 }
 
-bool FFurSkinData::Compare(int32 InFurLayerCount, int32 InLod, class UGFurComponent* InFurComponent)
+#if WITH_EDITORONLY_DATA
+bool FFurSkinData::EvictIfReleased()
 {
-	return FFurData::Compare(InFurLayerCount, InLod, InFurComponent) && SkeletalMesh == InFurComponent->SkeletalGrowMesh && GuideMeshes == InFurComponent->SkeletalGuideMeshes;
+	if (!FurSkinData.Evict(this))
+		return false;
+	DeleteEvictedData({ this });
+	return true;
+}
+
+TUniqueFunction<void()> FFurSkinData::PrepareEditBuild()
+{
+	FEditBuild Edit = MoveTemp(PendingEditBuild);
+	PendingEditBuild = FEditBuild();
+
+	InvalidateIntermediates();
+	if (Edit.bRegenerateSplines)
+	{
+		if (FurSplinesGenerated)
+			FurSplinesGenerated->ConditionalBeginDestroy();
+		FurSplinesGenerated = NewObject<UFurSplines>();
+		GenerateSplines(FurSplinesGenerated, SkeletalMesh, Lod, GuideMeshes);
+		FurSplinesUsed = FurSplinesGenerated;
+	}
+
+	if (Edit.Build.IsSet())
+		return [this, Build = Edit.Build.GetValue()]() { BuildFur(Build); };
+	return [this, VertexSet = Edit.CombedVertices.Array()]() { BuildFur(VertexSet); };
+}
+#endif // WITH_EDITORONLY_DATA
+
+FSHAHash FFurSkinData::CalcRegistryKey(int32 InFurLayerCount, int32 InLod, const UGFurComponent* InFurComponent)
+{
+	FSHA1 Hash;
+	HashParameters(Hash, InFurLayerCount, InLod, InFurComponent);
+
+	auto HashMesh = [&Hash, InLod](const USkeletalMesh* Mesh) {
+		HashAsset(Hash, Mesh, InLod, [Mesh, InLod](FSHA1& InOutContentHash) {
+			const FSkeletalMeshRenderData* RenderData = Mesh->GetResourceForRendering();
+			return RenderData && RenderData->LODRenderData.IsValidIndex(InLod) && HashGrowMesh(InOutContentHash, Mesh, RenderData->LODRenderData[InLod]);
+		});
+	};
+	HashMesh(InFurComponent->SkeletalGrowMesh);
+	const int32 NumGuideMeshes = InFurComponent->SkeletalGuideMeshes.Num();
+	Hash.Update((const uint8*)&NumGuideMeshes, sizeof(NumGuideMeshes));
+	for (const USkeletalMesh* GuideMesh : InFurComponent->SkeletalGuideMeshes)
+		HashMesh(GuideMesh);
+
+	Hash.Final();
+	FSHAHash Key;
+	Hash.GetHash(Key.Hash);
+	return Key;
+}
+
+bool FFurSkinData::HashGrowMesh(FSHA1& InOutHash, const USkeletalMesh* InSkeletalMesh, const FSkeletalMeshLODRenderData& LodRenderData)
+{
+	if (!HashGrowMeshVertices(InOutHash, LodRenderData.StaticVertexBuffers))
+		return false;
+
+	TArray<uint32> SourceIndices;
+	LodRenderData.MultiSizeIndexContainer.GetIndexBuffer(SourceIndices);
+	InOutHash.Update((const uint8*)SourceIndices.GetData(), SourceIndices.Num() * sizeof(uint32));
+	for (const auto& Section : LodRenderData.RenderSections)
+	{
+		InOutHash.Update((const uint8*)&Section.MaterialIndex, sizeof(Section.MaterialIndex));
+		InOutHash.Update((const uint8*)&Section.BaseIndex, sizeof(Section.BaseIndex));
+		InOutHash.Update((const uint8*)&Section.NumTriangles, sizeof(Section.NumTriangles));
+		InOutHash.Update((const uint8*)&Section.BaseVertexIndex, sizeof(Section.BaseVertexIndex));
+		InOutHash.Update((const uint8*)&Section.NumVertices, sizeof(Section.NumVertices));
+		InOutHash.Update((const uint8*)Section.BoneMap.GetData(), Section.BoneMap.Num() * sizeof(FBoneIndexType));
+	}
+
+	// skin weights and the reference pose end up in the vertices and the bone distance
+	const auto& SkinWeights = LodRenderData.SkinWeightVertexBuffer;
+	const uint32 MaxBoneInfluences = SkinWeights.GetMaxBoneInfluences();
+	InOutHash.Update((const uint8*)&MaxBoneInfluences, sizeof(MaxBoneInfluences));
+	for (uint32 VertexIndex = 0; VertexIndex < SkinWeights.GetNumVertices(); VertexIndex++)
+	{
+		for (uint32 InfluenceIndex = 0; InfluenceIndex < MaxBoneInfluences; InfluenceIndex++)
+		{
+			const uint32 BoneIndex = SkinWeights.GetBoneIndex(VertexIndex, InfluenceIndex);
+			const uint16 BoneWeight = SkinWeights.GetBoneWeight(VertexIndex, InfluenceIndex);
+			InOutHash.Update((const uint8*)&BoneIndex, sizeof(BoneIndex));
+			InOutHash.Update((const uint8*)&BoneWeight, sizeof(BoneWeight));
+		}
+	}
+	for (const FTransform& BonePose : InSkeletalMesh->GetRefSkeleton().GetRawRefBonePose())
+	{
+		const FVector Translation = BonePose.GetTranslation();
+		InOutHash.Update((const uint8*)&Translation, sizeof(Translation));
+	}
+	return true;
 }
 
 bool FFurSkinData::Similar(int32 InLod, class UGFurComponent* InFurComponent)
@@ -1166,6 +1551,15 @@ bool FFurSkinData::Similar(int32 InLod, class UGFurComponent* InFurComponent)
 	return FFurData::Similar(InLod, InFurComponent) && SkeletalMesh == InFurComponent->SkeletalGrowMesh && GuideMeshes == InFurComponent->SkeletalGuideMeshes;
 }
 
+#if WITH_EDITOR
+FString FFurSkinData::GetDerivedDataKey(const FSkeletalMeshLODRenderData& LodRenderData) const
+{
+	FSHA1 Hash;
+	HashGrowMesh(Hash, SkeletalMesh, LodRenderData);
+	return BuildDerivedDataKey(Hash);
+}
+#endif // WITH_EDITOR
+
 void FFurSkinData::BuildFur(BuildType Build)
 {
 	auto* SkeletalMeshResource = SkeletalMesh->GetResourceForRendering();
@@ -1191,19 +1585,35 @@ template<EStaticMeshVertexTangentBasisType TangentBasisTypeT, EStaticMeshVertexU
 inline void FFurSkinData::BuildFur(const FSkeletalMeshLODRenderData& LodRenderData, BuildType Build)
 {
 	if (LodRenderData.SkinWeightVertexBuffer.GetMaxBoneInfluences() > 4)
-		BuildFur<TangentBasisTypeT, UVTypeT, true>(LodRenderData, Build);
+	{
+		if (CompactVertexFormat)
+			BuildFur<TangentBasisTypeT, UVTypeT, true, true>(LodRenderData, Build);
+		else
+			BuildFur<TangentBasisTypeT, UVTypeT, true, false>(LodRenderData, Build);
+	}
 	else
-		BuildFur<TangentBasisTypeT, UVTypeT, false>(LodRenderData, Build);
+	{
+		if (CompactVertexFormat)
+			BuildFur<TangentBasisTypeT, UVTypeT, false, true>(LodRenderData, Build);
+		else
+			BuildFur<TangentBasisTypeT, UVTypeT, false, false>(LodRenderData, Build);
+	}
 }
 
-template<EStaticMeshVertexTangentBasisType TangentBasisTypeT, EStaticMeshVertexUVType UVTypeT, bool bExtraBoneInfluencesT>
+template<EStaticMeshVertexTangentBasisType TangentBasisTypeT, EStaticMeshVertexUVType UVTypeT, bool bExtraBoneInfluencesT, bool bCompactT>
 inline void FFurSkinData::BuildFur(const FSkeletalMeshLODRenderData& LodRenderData, BuildType Build)
 {
-	typedef FFurSkinVertex<TangentBasisTypeT, UVTypeT, bExtraBoneInfluencesT> VertexType;
+	typedef FFurSkinVertex<TangentBasisTypeT, UVTypeT, bExtraBoneInfluencesT, bCompactT> VertexType;
+	typedef FFurShellVertex<bCompactT> ShellVertexType;
 
 	bUseHighPrecisionTangentBasis = TangentBasisTypeT == EStaticMeshVertexTangentBasisType::HighPrecision;
 	bUseFullPrecisionUVs = UVTypeT == EStaticMeshVertexUVType::HighPrecision;
 	HasExtraBoneInfluences = bExtraBoneInfluencesT;
+	bUseCompactVertexFormat = bCompactT;
+	// Variable influence skin weights are stored with a lookup table, shells copy those
+	bGrowMeshFetch = CanReferenceGrowMeshVertices() && !LodRenderData.SkinWeightVertexBuffer.GetVariableBonesPerVertex();
+	GrowMeshVertexCount = LodRenderData.StaticVertexBuffers.PositionVertexBuffer.GetNumVertices();
+	bProceduralShells = CanUseProceduralShells();
 
 	const auto& SourcePositions = LodRenderData.StaticVertexBuffers.PositionVertexBuffer;
 	const auto& SourceSkinWeights = LodRenderData.SkinWeightVertexBuffer;
@@ -1216,30 +1626,64 @@ inline void FFurSkinData::BuildFur(const FSkeletalMeshLODRenderData& LodRenderDa
 	bool HasVertexColor = SourceColors.GetNumVertices() > 0;
 	check(!HasVertexColor || SourceVertexCount == SourceColors.GetNumVertices());
 
+	const uint32 BuiltVertexSize = bGrowMeshFetch ? sizeof(ShellVertexType) : sizeof(VertexType);
+	if (Build == BuildType::Full && LoadCookedData(BuiltVertexSize))
+		return;
+
+	if (Build >= BuildType::Splines)
+		AcquireIntermediates(SkeletalMesh, [&](TArray<FVector>& OutNormals) { UnpackNormals<TangentBasisTypeT>(OutNormals, SourceVertices); });
+#if WITH_EDITOR
+	FString DerivedDataKey;
 	if (Build == BuildType::Full)
 	{
-		UnpackNormals<TangentBasisTypeT>(SourceVertices);
+		DerivedDataKey = GetDerivedDataKey(LodRenderData);
+		if (LoadDerivedData(DerivedDataKey, BuiltVertexSize))
+			return;
 	}
+#endif // WITH_EDITOR
 	if (Build >= BuildType::Splines)
-		GenerateSplineMap(SourcePositions);
-
-	uint32 NewVertexCount = VertexCountPerLayer * FurLayerCount;
+	{
+		GenerateSplineMap(SourcePositions, [&](TArray<float>& OutVertexDistSquared) {
+			OutVertexDistSquared.SetNumZeroed(SourceVertexCount);
+			const auto& RefPose = SkeletalMesh->GetRefSkeleton().GetRawRefBonePose();
+			for (const auto& SourceSection : LodRenderData.RenderSections)
+			{
+				for (uint32 i = SourceSection.BaseVertexIndex; i < SourceSection.BaseVertexIndex + SourceSection.NumVertices; i++)
+				{
+					for (uint32 b = 0; b < SourceSkinWeights.GetMaxBoneInfluences(); b++)
+					{
+						if (SourceSkinWeights.GetBoneWeight(i, b) == 0)
+							break;
+						uint32 BoneIndex = SourceSection.BoneMap[SourceSkinWeights.GetBoneIndex(i, b)];
+						float DistSq = FVector::DistSquared(FVector(SourcePositions.VertexPosition(i)), RefPose[BoneIndex].GetTranslation());
+						OutVertexDistSquared[i] = FMath::Max(OutVertexDistSquared[i], DistSq);
+					}
+				}
+			}
+		});
+	}
 
-	while (RenderThreadDataSubmissionPending)
-		;
+	const int32 VertexLayerCount = GetVertexLayerCount();
+	uint32 NewVertexCount = VertexCountPerLayer * VertexLayerCount;
 
-	TArray<FSection>& LocalSections = Sections.Num() ? TempSections : Sections;
+	TArray<FSection>& LocalSections = TempSections;
 	LocalSections.SetNum(LodRenderData.RenderSections.Num());
 
 	FFurSkinVertexBlitter<TangentBasisTypeT, UVTypeT, bExtraBoneInfluencesT> VertexBlitter(SourcePositions, SourceVertices, SourceColors, SourceSkinWeights);
 
-	VertexType* Vertices = VertexBuffer.Lock<VertexType>(NewVertexCount);
-	if (Vertices == nullptr)
+	VertexType* Vertices = nullptr;
+	ShellVertexType* ShellVertices = nullptr;
+	if (bGrowMeshFetch)
+		ShellVertices = VertexBuffer.Lock<ShellVertexType>(NewVertexCount);
+	else
+		Vertices = VertexBuffer.Lock<VertexType>(NewVertexCount);
+	if (Vertices == nullptr && ShellVertices == nullptr)
 	{
 		return;
 	}
+	FVector4f* Profiles = bProceduralShells ? ProfileBuffer.Lock(NewVertexCount, GetProceduralProfileStride()) : nullptr;
+	const uint32 ProfileStride = GetProceduralProfileStride();
 	uint32 SectionVertexOffset = 0;
-	float MaxDistSq = 0.0f;
 	for (int32 SectionIndex = 0; SectionIndex < LodRenderData.RenderSections.Num(); SectionIndex++)
 	{
 		const auto& SourceSection = LodRenderData.RenderSections[SectionIndex];
@@ -1247,35 +1691,25 @@ inline void FFurSkinData::BuildFur(const FSkeletalMeshLODRenderData& LodRenderDa
 
 		FurSection.MinVertexIndex = SectionVertexOffset;
 
-		uint32 VertCount = GenerateFurVertices(SourceSection.BaseVertexIndex, SourceSection.BaseVertexIndex + SourceSection.NumVertices, Vertices + SectionVertexOffset, VertexBlitter);
-		if (Build == BuildType::Full)
-		{
-			const auto& RefPose = SkeletalMesh->GetRefSkeleton().GetRawRefBonePose();
-			for (uint32 i = 0; i < VertCount; i++)
-			{
-				uint32 VertexIndex = SectionVertexOffset + i;
-				for (uint32 b = 0; b < VertexType::NumInfluences; b++)
-				{
-					if (Vertices[VertexIndex].InfluenceWeights[b] == 0)
-						break;
-					uint32 BoneIndex = SourceSection.BoneMap[Vertices[VertexIndex].InfluenceBones[b]];
-					float distSq = FVector::DistSquared(FVector(Vertices[VertexIndex].Position), RefPose[BoneIndex].GetTranslation());
-					if (distSq > MaxDistSq)
-						MaxDistSq = distSq;
-				}
-			}
-		}
-		SectionVertexOffset += VertCount * FurLayerCount;
+		uint32 VertCount;
+		if (bGrowMeshFetch)
+			VertCount = GenerateFurVertices(SourceSection.BaseVertexIndex, SourceSection.BaseVertexIndex + SourceSection.NumVertices, ShellVertices + SectionVertexOffset, FFurShellVertexBlitter(),
+				Profiles ? Profiles + SectionVertexOffset * ProfileStride : nullptr);
+		else
+			VertCount = GenerateFurVertices(SourceSection.BaseVertexIndex, SourceSection.BaseVertexIndex + SourceSection.NumVertices, Vertices + SectionVertexOffset, VertexBlitter,
+				Profiles ? Profiles + SectionVertexOffset * ProfileStride : nullptr);
+		SectionVertexOffset += VertCount * VertexLayerCount;
 
 		FurSection.MaxVertexIndex = SectionVertexOffset - 1;
+		FurSection.LayerVertexCount = VertCount;
 	}
 	VertexBuffer.Unlock();
-	if (Build == BuildType::Full)
-		MaxVertexBoneDistance = sqrtf(MaxDistSq);
+	if (Profiles)
+		ProfileBuffer.Unlock();
 
-	if (Build >= BuildType::Splines || FurLayerCount != OldFurLayerCount || RemoveFacesWithoutSplines != OldRemoveFacesWithoutSplines)
+	if (Build >= BuildType::Splines || VertexLayerCount != OldFurLayerCount || RemoveFacesWithoutSplines != OldRemoveFacesWithoutSplines)
 	{
-		OldFurLayerCount = FurLayerCount;
+		OldFurLayerCount = VertexLayerCount;
 		OldRemoveFacesWithoutSplines = RemoveFacesWithoutSplines;
 
 		// indices
@@ -1284,8 +1718,11 @@ inline void FFurSkinData::BuildFur(const FSkeletalMeshLODRenderData& LodRenderDa
 
 		auto& Indices = IndexBuffer.Lock();
 		Indices.Reset();
-		Indices.AddUninitialized(SourceIndices.Num() * FurLayerCount);
+		Indices.AddUninitialized(SourceIndices.Num());
 		uint32 Idx = 0;
+		const bool UseRemap = FurSplinesUsed && RemoveFacesWithoutSplines;
+		FFurTriangleOrderStats OrderStats;
+		TArray<uint32> SectionIndices;
 		for (int32 SectionIndex = 0; SectionIndex < LodRenderData.RenderSections.Num(); SectionIndex++)
 		{
 			const auto& SourceSection = LodRenderData.RenderSections[SectionIndex];
@@ -1294,56 +1731,28 @@ inline void FFurSkinData::BuildFur(const FSkeletalMeshLODRenderData& LodRenderDa
 			FurSection.MaterialIndex = SourceSection.MaterialIndex;
 			FurSection.BaseIndex = Idx;
 
-			for (int32 Layer = 0; Layer < FurLayerCount; Layer++)
-			{
-				int32 VertexIndexOffset = Layer * ((FurSection.MaxVertexIndex - FurSection.MinVertexIndex + 1) / FurLayerCount) + FurSection.MinVertexIndex;
-				check(VertexIndexOffset >= 0);
-				if (FurSplinesUsed && RemoveFacesWithoutSplines)
-				{
-					for (uint32 t = 0; t < SourceSection.NumTriangles; ++t)
-					{
-						uint32 Idx0 = SourceIndices[SourceSection.BaseIndex + t * 3];
-						uint32 Idx1 = SourceIndices[SourceSection.BaseIndex + t * 3 + 1];
-						uint32 Idx2 = SourceIndices[SourceSection.BaseIndex + t * 3 + 2];
-						if (SplineMap[Idx0] >= 0 && SplineMap[Idx1] >= 0 && SplineMap[Idx2] >= 0)
-						{
-							Indices[Idx++] = VertexRemap[Idx0] + VertexIndexOffset;
-							Indices[Idx++] = VertexRemap[Idx1] + VertexIndexOffset;
-							Indices[Idx++] = VertexRemap[Idx2] + VertexIndexOffset;
-						}
-					}
-				}
-				else
-				{
-					VertexIndexOffset -= SourceSection.BaseVertexIndex;
-					for (uint32 i = 0; i < SourceSection.NumTriangles * 3; ++i)
-						Indices[Idx++] = SourceIndices[SourceSection.BaseIndex + i] + VertexIndexOffset;
-				}
-			}
+			GatherSectionIndices(SectionIndices, SourceIndices, SourceSection.BaseIndex, SourceSection.NumTriangles);
+			OptimizeTriangleOrder(SectionIndices, SourcePositions, OrderStats);
+			for (uint32 SrcVertexIndex : SectionIndices)
+				Indices[Idx++] = (UseRemap ? VertexRemap[SrcVertexIndex] : SrcVertexIndex - SourceSection.BaseVertexIndex) + FurSection.MinVertexIndex;
 			FurSection.NumTriangles = (Idx - FurSection.BaseIndex) / 3;
+			RebaseSectionIndices(Indices, FurSection, Idx);
 			FurSection.NumBones = SourceSection.BoneMap.Num();
 		}
 		check(Idx <= (uint32)Indices.Num());
 		Indices.RemoveAt(Idx, Indices.Num() - Idx, EAllowShrinking::No);
+		ReportTriangleOrder(OrderStats);
 		IndexBuffer.Unlock();
 
-		if (TempSections.Num())
-		{
-			ENQUEUE_RENDER_COMMAND(UpdateDataCommand)([this, NewVertexCount](FRHICommandListImmediate& RHICmdList) {
-				Sections = TempSections;
-				VertexCount = NewVertexCount;
-			});
-		}
-		else
-		{
+		ENQUEUE_RENDER_COMMAND(UpdateDataCommand)([this, NewSections = TempSections, NewVertexCount](FRHICommandListImmediate& RHICmdList) {
+			Sections = NewSections;
 			VertexCount = NewVertexCount;
-		}
+		});
 	}
 
-	RenderThreadDataSubmissionPending = true;
-	ENQUEUE_RENDER_COMMAND(UpdateDataCommand)([this](FRHICommandListImmediate& RHICmdList) {
-		RenderThreadDataSubmissionPending = false;
-	});
+#if WITH_EDITOR
+	SaveDerivedData(DerivedDataKey);
+#endif // WITH_EDITOR
 
 #if !WITH_EDITORONLY_DATA
 	Normals.SetNum(0, true);
@@ -1377,18 +1786,25 @@ template<EStaticMeshVertexTangentBasisType TangentBasisTypeT, EStaticMeshVertexU
 inline void FFurSkinData::BuildFur(const FSkeletalMeshLODRenderData& LodRenderData, const TArray<uint32>& InVertexSet)
 {
 	if (LodRenderData.SkinWeightVertexBuffer.GetMaxBoneInfluences() > 4)
-		BuildFur<TangentBasisTypeT, UVTypeT, true>(LodRenderData, InVertexSet);
+	{
+		if (bUseCompactVertexFormat)
+			BuildFur<TangentBasisTypeT, UVTypeT, true, true>(LodRenderData, InVertexSet);
+		else
+			BuildFur<TangentBasisTypeT, UVTypeT, true, false>(LodRenderData, InVertexSet);
+	}
 	else
-		BuildFur<TangentBasisTypeT, UVTypeT, false>(LodRenderData, InVertexSet);
+	{
+		if (bUseCompactVertexFormat)
+			BuildFur<TangentBasisTypeT, UVTypeT, false, true>(LodRenderData, InVertexSet);
+		else
+			BuildFur<TangentBasisTypeT, UVTypeT, false, false>(LodRenderData, InVertexSet);
+	}
 }
 
-template<EStaticMeshVertexTangentBasisType TangentBasisTypeT, EStaticMeshVertexUVType UVTypeT, bool bExtraBoneInfluencesT>
+template<EStaticMeshVertexTangentBasisType TangentBasisTypeT, EStaticMeshVertexUVType UVTypeT, bool bExtraBoneInfluencesT, bool bCompactT>
 inline void FFurSkinData::BuildFur(const FSkeletalMeshLODRenderData& LodRenderData, const TArray<uint32>& InVertexSet)
 {
-	typedef FFurSkinVertex<TangentBasisTypeT, UVTypeT, bExtraBoneInfluencesT> VertexType;
-
-	while (RenderThreadDataSubmissionPending)
-		;
+	typedef FFurSkinVertex<TangentBasisTypeT, UVTypeT, bExtraBoneInfluencesT, bCompactT> VertexType;
 
 	const auto& SrcSections = LodRenderData.RenderSections;
 	uint32 SectionIndex = 0;
@@ -1396,53 +1812,67 @@ inline void FFurSkinData::BuildFur(const FSkeletalMeshLODRenderData& LodRenderDa
 	uint32 SectionVertexIndexBegin = SrcSections[SectionIndex].BaseVertexIndex;
 	uint32 SectionVertexIndexEnd = SectionVertexIndexBegin + SrcSections[SectionIndex].NumVertices;
 
-	const auto& LocalSections = TempSections.Num() ? TempSections : Sections;
+	const auto& LocalSections = TempSections;
 	uint32 DstSectionVertexBegin = LocalSections[SectionIndex].MinVertexIndex;
-	uint32 DstSectionVertexCountPerLayer = (LocalSections[SectionIndex].MaxVertexIndex + 1 - DstSectionVertexBegin) / FurLayerCount;
+	const int32 VertexLayerCount = GetVertexLayerCount();
+	uint32 DstSectionVertexCountPerLayer = LocalSections[SectionIndex].LayerVertexCount;
 
 	TArray<float> FurLengths;
 	GenerateFurLengths(FurLengths);
 
-	VertexType* Vertices = VertexBuffer.Lock<VertexType>(VertexCountPerLayer * FurLayerCount);
+	FFurProfileSpan Span;
+	if (FurSplinesUsed)
+		BuildFurProfile(Span, InVertexSet.GetData(), InVertexSet.Num(), FurLengths);
+
 	bool UseRemap = VertexRemap.Num() > 0;
-	for (int32 Layer = 0; Layer < FurLayerCount; Layer++)
+	FVector4f* Profiles = bProceduralShells ? ProfileBuffer.Lock(VertexCountPerLayer * VertexLayerCount, GetProceduralProfileStride(), true) : nullptr;
+	const uint32 ProfileStride = GetProceduralProfileStride();
+	auto UpdateVertices = [&](auto* Vertices)
 	{
-		auto GenLayerData = CalcFurGenLayerData(FurLayerCount - Layer);
-		for (uint32 SrcVertexIndex : InVertexSet)
+		for (int32 Layer = 0; Layer < VertexLayerCount; Layer++)
 		{
-			uint32 checkCounter = 0;
-			while (SrcVertexIndex < SectionVertexIndexBegin || SrcVertexIndex >= SectionVertexIndexEnd)
-			{
-				SectionIndex = (SectionIndex + 1) % SectionCount;
-				SectionVertexIndexBegin = SrcSections[SectionIndex].BaseVertexIndex;
-				SectionVertexIndexEnd = SrcSections[SectionIndex].BaseVertexIndex + SrcSections[SectionIndex].NumVertices;
-				DstSectionVertexBegin = LocalSections[SectionIndex].MinVertexIndex;
-				DstSectionVertexCountPerLayer = (LocalSections[SectionIndex].MaxVertexIndex + 1 - DstSectionVertexBegin) / FurLayerCount;
-				check(checkCounter++ < SectionCount);
-			}
-			uint32 DstVertexIndex = UseRemap ? VertexRemap[SrcVertexIndex] : SrcVertexIndex - SectionVertexIndexBegin;
-			DstVertexIndex += DstSectionVertexCountPerLayer * Layer + DstSectionVertexBegin;
-			VertexType& Vertex = Vertices[DstVertexIndex];
-
+			auto GenLayerData = CalcFurGenLayerData(FurLayerCount - GetSlotLayerOffset(Layer));
 			if (FurSplinesUsed)
+				GenerateProfileLayer(Span, InVertexSet.GetData(), InVertexSet.Num(), GenLayerData);
+			for (int32 Index = 0; Index < InVertexSet.Num(); Index++)
 			{
-				int32 SplineIndex = SplineMap[SrcVertexIndex];
-				float Length = SplineIndex >= 0 ? FurLengths[SplineIndex] : FurLength;
-				GenerateFurVertex(Vertex.FurOffset, Vertex.UV1, Vertex.UV2, Vertex.UV3, FVector3f(Normals[SrcVertexIndex]), Length, GenLayerData, SplineIndex);
-			}
-			else
-			{
-				GenerateFurVertex(Vertex.FurOffset, Vertex.UV1, Vertex.UV2, Vertex.UV3, FVector3f(Normals[SrcVertexIndex]), FurLength, GenLayerData);
+				uint32 SrcVertexIndex = InVertexSet[Index];
+				uint32 checkCounter = 0;
+				while (SrcVertexIndex < SectionVertexIndexBegin || SrcVertexIndex >= SectionVertexIndexEnd)
+				{
+					SectionIndex = (SectionIndex + 1) % SectionCount;
+					SectionVertexIndexBegin = SrcSections[SectionIndex].BaseVertexIndex;
+					SectionVertexIndexEnd = SrcSections[SectionIndex].BaseVertexIndex + SrcSections[SectionIndex].NumVertices;
+					DstSectionVertexBegin = LocalSections[SectionIndex].MinVertexIndex;
+					DstSectionVertexCountPerLayer = LocalSections[SectionIndex].LayerVertexCount;
+					check(checkCounter++ < SectionCount);
+				}
+				uint32 DstVertexIndex = UseRemap ? VertexRemap[SrcVertexIndex] : SrcVertexIndex - SectionVertexIndexBegin;
+				DstVertexIndex += DstSectionVertexCountPerLayer * Layer + DstSectionVertexBegin;
+				auto& Vertex = Vertices[DstVertexIndex];
+				VertexBuffer.MarkDirty(DstVertexIndex);
+				if (Profiles && Layer == 0)
+					WriteProceduralProfile(Profiles + DstVertexIndex * ProfileStride, Span, Index, SrcVertexIndex);
+
+				if (FurSplinesUsed)
+				{
+					WriteProfileVertex(Vertex, Span, Index, GenLayerData);
+				}
+				else
+				{
+					GenerateFurLayer(Vertex.Layer, SrcVertexIndex, FVector3f(Normals[SrcVertexIndex]), FurLength, GenLayerData);
+				}
 			}
 		}
-	}
+	};
+	if (bGrowMeshFetch)
+		UpdateVertices(VertexBuffer.Lock<FFurShellVertex<bCompactT>>(VertexCountPerLayer * VertexLayerCount, true));
+	else
+		UpdateVertices(VertexBuffer.Lock<VertexType>(VertexCountPerLayer * VertexLayerCount, true));
 
 	VertexBuffer.Unlock();
-
-	RenderThreadDataSubmissionPending = true;
-	ENQUEUE_RENDER_COMMAND(UpdateDataCommand)([this](FRHICommandListImmediate& RHICmdList) {
-		RenderThreadDataSubmissionPending = false;
-	});
+	if (Profiles)
+		ProfileBuffer.Unlock();
 }
 
 /** Generate Splines */
@@ -8,8 +8,8 @@
 
 
 /** Soft Skin Vertex */
-template<EStaticMeshVertexTangentBasisType TangentBasisTypeT, EStaticMeshVertexUVType UVTypeT, bool bExtraBoneInfluencesT>
-struct FFurSkinVertex : FFurStaticVertex<TangentBasisTypeT, UVTypeT>
+template<EStaticMeshVertexTangentBasisType TangentBasisTypeT, EStaticMeshVertexUVType UVTypeT, bool bExtraBoneInfluencesT, bool bCompactT>
+struct FFurSkinVertex : FFurStaticVertex<TangentBasisTypeT, UVTypeT, bCompactT>
 {
 	enum
 	{
@@ -24,10 +24,12 @@ struct FFurSkinVertex : FFurStaticVertex<TangentBasisTypeT, UVTypeT>
 class FFurSkinData: public FFurData
 {
 public:
-	static FFurSkinData* CreateFurData(int32 InFurLayerCount, int32 InLod, class UGFurComponent* InFurComponent);
+	static FFurSkinData* CreateFurData(int32 InFurLayerCount, int32 InLod, class UGFurComponent* InFurComponent,
+		const TSharedPtr<FByteBulkData, ESPMode::ThreadSafe>& InCookedData = TSharedPtr<FByteBulkData, ESPMode::ThreadSafe>(), const class UGFurComponent* InCookedComponent = nullptr);
 	static void DestroyFurData(const TArray<FFurData*>& InFurDataArray);
+	static void GetRegistryStats(int32& OutNumData, uint64& OutBuiltSize);
 
-	virtual void CreateVertexFactories(TArray<FFurVertexFactory*>& VertexFactories, FVertexBuffer* InMorphVertexBuffer, bool InPhysics, ERHIFeatureLevel::Type InFeatureLevel) override;
+	virtual bool CreateVertexFactories(TArray<FFurVertexFactory*>& VertexFactories, FVertexBuffer* InMorphVertexBuffer, bool InPhysics, ERHIFeatureLevel::Type InFeatureLevel) override;
 
 protected:
 	USkeletalMesh* SkeletalMesh = nullptr;
@@ -45,18 +47,29 @@ protected:
 	~FFurSkinData();
 
 	void UnbindChangeDelegates();
+	const FSkeletalMeshLODRenderData* GetGrowMeshRenderData_RenderThread() const;
 	void Set(int32 InFurLayerCount, int32 InLod, class UGFurComponent* InFurComponent);
+#if WITH_EDITORONLY_DATA
+	virtual TUniqueFunction<void()> PrepareEditBuild() override;
+	virtual bool EvictIfReleased() override;
+#endif // WITH_EDITORONLY_DATA
 
-	bool Compare(int32 InFurLayerCount, int32 InLod, class UGFurComponent* InFurComponent);
+	/** Hash of every input of the fur data, components with equal keys share the data */
+	static FSHAHash CalcRegistryKey(int32 InFurLayerCount, int32 InLod, const class UGFurComponent* InFurComponent);
+	static bool HashGrowMesh(FSHA1& InOutHash, const USkeletalMesh* InSkeletalMesh, const FSkeletalMeshLODRenderData& LodRenderData);
 	bool Similar(int32 InLod, class UGFurComponent* InFurComponent);
 
+#if WITH_EDITOR
+	FString GetDerivedDataKey(const FSkeletalMeshLODRenderData& LodRenderData) const;
+#endif // WITH_EDITOR
+
 	void BuildFur(BuildType Build);
 
 	template<EStaticMeshVertexTangentBasisType TangentBasisTypeT>
 	void BuildFur(const FSkeletalMeshLODRenderData& LodRenderData, BuildType Build);
 	template<EStaticMeshVertexTangentBasisType TangentBasisTypeT, EStaticMeshVertexUVType UVTypeT>
 	void BuildFur(const FSkeletalMeshLODRenderData& LodRenderData, BuildType Build);
-	template<EStaticMeshVertexTangentBasisType TangentBasisTypeT, EStaticMeshVertexUVType UVTypeT, bool bExtraBoneInfluencesT>
+	template<EStaticMeshVertexTangentBasisType TangentBasisTypeT, EStaticMeshVertexUVType UVTypeT, bool bExtraBoneInfluencesT, bool bCompactT>
 	void BuildFur(const FSkeletalMeshLODRenderData& LodRenderData, BuildType Build);
 
 	void BuildFur(const TArray<uint32>& InVertexSet);
@@ -64,7 +77,7 @@ protected:
 	void BuildFur(const FSkeletalMeshLODRenderData& LodRenderData, const TArray<uint32>& InVertexSet);
 	template<EStaticMeshVertexTangentBasisType TangentBasisTypeT, EStaticMeshVertexUVType UVTypeT>
 	void BuildFur(const FSkeletalMeshLODRenderData& LodRenderData, const TArray<uint32>& InVertexSet);
-	template<EStaticMeshVertexTangentBasisType TangentBasisTypeT, EStaticMeshVertexUVType UVTypeT, bool bExtraBoneInfluencesT>
+	template<EStaticMeshVertexTangentBasisType TangentBasisTypeT, EStaticMeshVertexUVType UVTypeT, bool bExtraBoneInfluencesT, bool bCompactT>
 	void BuildFur(const FSkeletalMeshLODRenderData& LodRenderData, const TArray<uint32>& InVertexSet);
 };
 
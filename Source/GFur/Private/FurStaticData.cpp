@@ -4,16 +4,17 @@
 
 #include "ShaderParameterUtils.h"
 #include "FurComponent.h"
+#include "FurBuildScheduler.h"
 #include "Runtime/Renderer/Public/MeshMaterialShader.h"
 #include "Runtime\Renderer\Public\MeshDrawShaderBindings.h"
 #include "Engine/SkeletalMesh.h"
 #include "StaticMeshResources.h"
+#include "DataDrivenShaderPlatformInfo.h"
 #include "RHICommandList.h"
 
 #include "Runtime/RHI/Public/RHICommandList.h"
 
-static TArray< FFurStaticData* > FurStaticData;
-static FCriticalSection FurStaticDataCS;
+static TFurDataRegistry<FFurStaticData> FurStaticData;
 
 /** Vertex Factory Shader Parameters */
 class FFurStaticVertexFactoryShaderParameters : public FVertexFactoryShaderParameters
@@ -31,6 +32,23 @@ public:
 		PreviousFurLinearOffsetParameter.Bind(ParameterMap, TEXT("PreviousFurLinearOffset"));
 		PreviousFurPositionParameter.Bind(ParameterMap, TEXT("PreviousFurPosition"));
 		PreviousFurAngularOffsetParameter.Bind(ParameterMap, TEXT("PreviousFurAngularOffset"));
+		GrowMeshPositionsParameter.Bind(ParameterMap, TEXT("GrowMeshPositions"));
+		GrowMeshTangentsParameter.Bind(ParameterMap, TEXT("GrowMeshTangents"));
+		GrowMeshTexCoordsParameter.Bind(ParameterMap, TEXT("GrowMeshTexCoords"));
+		GrowMeshColorsParameter.Bind(ParameterMap, TEXT("GrowMeshColors"));
+		GrowMeshNumTexCoordsParameter.Bind(ParameterMap, TEXT("GrowMeshNumTexCoords"));
+		GrowMeshColorIndexMaskParameter.Bind(ParameterMap, TEXT("GrowMeshColorIndexMask"));
+		CompactVertexFormatParameter.Bind(ParameterMap, TEXT("CompactVertexFormat"));
+		FurLayerCountParameter.Bind(ParameterMap, TEXT("FurLayerCount"));
+		FurShellBiasParameter.Bind(ParameterMap, TEXT("FurShellBias"));
+		FurLengthScaleParameter.Bind(ParameterMap, TEXT("FurLengthScale"));
+		LinearShellsParameter.Bind(ParameterMap, TEXT("LinearShells"));
+		ProceduralShellsParameter.Bind(ParameterMap, TEXT("ProceduralShells"));
+		FurLayerIndexParameter.Bind(ParameterMap, TEXT("FurLayerIndex"));
+		FurNoiseStrengthParameter.Bind(ParameterMap, TEXT("FurNoiseStrength"));
+		FurNoiseSeedParameter.Bind(ParameterMap, TEXT("FurNoiseSeed"));
+		FurProfileStrideParameter.Bind(ParameterMap, TEXT("FurProfileStride"));
+		FurProfilesParameter.Bind(ParameterMap, TEXT("FurProfiles"));
 	}
 
 
@@ -45,6 +63,23 @@ public:
 		Ar << PreviousFurLinearOffsetParameter;
 		Ar << PreviousFurPositionParameter;
 		Ar << PreviousFurAngularOffsetParameter;
+		Ar << GrowMeshPositionsParameter;
+		Ar << GrowMeshTangentsParameter;
+		Ar << GrowMeshTexCoordsParameter;
+		Ar << GrowMeshColorsParameter;
+		Ar << GrowMeshNumTexCoordsParameter;
+		Ar << GrowMeshColorIndexMaskParameter;
+		Ar << CompactVertexFormatParameter;
+		Ar << FurLayerCountParameter;
+		Ar << FurShellBiasParameter;
+		Ar << FurLengthScaleParameter;
+		Ar << LinearShellsParameter;
+		Ar << ProceduralShellsParameter;
+		Ar << FurLayerIndexParameter;
+		Ar << FurNoiseStrengthParameter;
+		Ar << FurNoiseSeedParameter;
+		Ar << FurProfileStrideParameter;
+		Ar << FurProfilesParameter;
 	}
 
 
@@ -74,12 +109,29 @@ private:
 	LAYOUT_FIELD(FShaderParameter, PreviousFurLinearOffsetParameter);
 	LAYOUT_FIELD(FShaderParameter, PreviousFurPositionParameter);
 	LAYOUT_FIELD(FShaderParameter, PreviousFurAngularOffsetParameter);
+	LAYOUT_FIELD(FShaderResourceParameter, GrowMeshPositionsParameter);
+	LAYOUT_FIELD(FShaderResourceParameter, GrowMeshTangentsParameter);
+	LAYOUT_FIELD(FShaderResourceParameter, GrowMeshTexCoordsParameter);
+	LAYOUT_FIELD(FShaderResourceParameter, GrowMeshColorsParameter);
+	LAYOUT_FIELD(FShaderParameter, GrowMeshNumTexCoordsParameter);
+	LAYOUT_FIELD(FShaderParameter, GrowMeshColorIndexMaskParameter);
+	LAYOUT_FIELD(FShaderParameter, CompactVertexFormatParameter);
+	LAYOUT_FIELD(FShaderParameter, FurLayerCountParameter);
+	LAYOUT_FIELD(FShaderParameter, FurShellBiasParameter);
+	LAYOUT_FIELD(FShaderParameter, FurLengthScaleParameter);
+	LAYOUT_FIELD(FShaderParameter, LinearShellsParameter);
+	LAYOUT_FIELD(FShaderParameter, ProceduralShellsParameter);
+	LAYOUT_FIELD(FShaderParameter, FurLayerIndexParameter);
+	LAYOUT_FIELD(FShaderParameter, FurNoiseStrengthParameter);
+	LAYOUT_FIELD(FShaderParameter, FurNoiseSeedParameter);
+	LAYOUT_FIELD(FShaderParameter, FurProfileStrideParameter);
+	LAYOUT_FIELD(FShaderResourceParameter, FurProfilesParameter);
 };
 
 IMPLEMENT_TYPE_LAYOUT(FFurStaticVertexFactoryShaderParameters)
 
 /** Vertex Factory */
-template<bool Physics>
+template<bool Physics, bool GrowMeshFetch>
 class FFurStaticVertexFactoryBase : public FFurVertexFactory
 {
 public:
@@ -97,6 +149,9 @@ public:
 		FVector3f PreviousFurPosition;
 		FVector3f PreviousFurAngularOffset;
 
+		FFurGrowMeshFetchData GrowMesh;
+		FFurLayerShaderData Layers;
+
 		FShaderDataType()
 			: MeshOrigin(0, 0, 0)
 			, MeshExtension(1, 1, 1)
@@ -134,27 +189,46 @@ public:
 		TArray<FVertexStreamComponent, TFixedAllocator<MAX_TEXCOORDS>> TextureCoordinates;
 		FVertexStreamComponent ColorComponent;
 		FVertexStreamComponent FurOffset;
+		FVertexStreamComponent SourceVertexIndex;
 	};
 
-	template<EStaticMeshVertexTangentBasisType TangentBasisTypeT, EStaticMeshVertexUVType UVTypeT>
-	void Init(const FFurVertexBuffer* VertexBuffer)
+	template<EStaticMeshVertexTangentBasisType TangentBasisTypeT, EStaticMeshVertexUVType UVTypeT, bool bCompactT>
+	void Init(const FFurVertexBuffer* VertexBuffer, const FStaticMeshVertexBuffers* GrowMeshVertexBuffers, const FFurLayerShaderData& InLayers)
 	{
-		typedef FFurStaticVertex<TangentBasisTypeT, UVTypeT> VertexType;
+		typedef FFurStaticVertex<TangentBasisTypeT, UVTypeT, bCompactT> VertexType;
+		typedef FFurShellVertex<bCompactT> ShellVertexType;
+		typedef typename TFurLayerAttributesTypeSelector<bCompactT>::LayerAttributesT LayerAttributesType;
+		ShaderData.Layers = InLayers;
 		ENQUEUE_RENDER_COMMAND(InitProceduralMeshVertexFactory)(
-			[VertexBuffer, this](FRHICommandListImmediate& RHICmdList) {
+			[VertexBuffer, GrowMeshVertexBuffers, this](FRHICommandListImmediate& RHICmdList) {
 				const auto TangentElementType = TStaticMeshVertexTangentTypeSelector<TangentBasisTypeT>::VertexElementType;
 				const auto UvElementType = UVTypeT == EStaticMeshVertexUVType::HighPrecision ? VET_Float2 : VET_Half2;
 
 				// Initialize the vertex factory's stream components.
 				FDataType NewData;
+				FVertexStreamComponent Uv1Component, Uv2Component;
+				if (GrowMeshFetch)
+				{
+					// UV0 is fetched from the grow mesh, its attribute slot is only kept for the layout of the other UVs.
+					LayerAttributesType::GetStreamComponents(VertexBuffer, STRUCT_OFFSET(ShellVertexType, Layer), sizeof(ShellVertexType), NewData.FurOffset, Uv1Component, Uv2Component);
+					NewData.SourceVertexIndex = STRUCTMEMBER_VERTEXSTREAMCOMPONENT(VertexBuffer, ShellVertexType, SourceVertexIndex, VET_UInt);
+					NewData.TextureCoordinates.Add(Uv1Component);
+					NewData.TextureCoordinates.Add(Uv1Component);
+					NewData.TextureCoordinates.Add(Uv2Component);
+					ShaderData.GrowMesh.Set(*GrowMeshVertexBuffers);
+
+					SetData(NewData);
+					return;
+				}
+
+				LayerAttributesType::GetStreamComponents(VertexBuffer, STRUCT_OFFSET(VertexType, Layer), sizeof(VertexType), NewData.FurOffset, Uv1Component, Uv2Component);
 				NewData.PositionComponent = STRUCTMEMBER_VERTEXSTREAMCOMPONENT(VertexBuffer, VertexType, Position, VET_Float3);
 				NewData.TextureCoordinates.Add(FVertexStreamComponent(VertexBuffer, STRUCT_OFFSET(VertexType, UV0), sizeof(VertexType), UvElementType));
-				NewData.TextureCoordinates.Add(FVertexStreamComponent(VertexBuffer, STRUCT_OFFSET(VertexType, UV1), sizeof(VertexType), VET_Float2));
-				NewData.TextureCoordinates.Add(FVertexStreamComponent(VertexBuffer, STRUCT_OFFSET(VertexType, UV2), sizeof(VertexType), VET_Float2));
+				NewData.TextureCoordinates.Add(Uv1Component);
+				NewData.TextureCoordinates.Add(Uv2Component);
 				NewData.TangentBasisComponents[0] = STRUCTMEMBER_VERTEXSTREAMCOMPONENT(VertexBuffer, VertexType, TangentX, TangentElementType);
 				NewData.TangentBasisComponents[1] = STRUCTMEMBER_VERTEXSTREAMCOMPONENT(VertexBuffer, VertexType, TangentZ, TangentElementType);
 				NewData.ColorComponent = STRUCTMEMBER_VERTEXSTREAMCOMPONENT(VertexBuffer, VertexType, Color, VET_Color);
-				NewData.FurOffset = STRUCTMEMBER_VERTEXSTREAMCOMPONENT(VertexBuffer, VertexType, FurOffset, VET_Float3);
 
 				SetData(NewData);
 			});
@@ -176,11 +250,13 @@ public:
 //		Super::ModifyCompilationEnvironment(Platform, Material, OutEnvironment);
 		if (Physics)
 			OutEnvironment.SetDefine(TEXT("GFUR_PHYSICS"), TEXT("1"));
+		if (GrowMeshFetch)
+			OutEnvironment.SetDefine(TEXT("GFUR_GROW_MESH_FETCH"), TEXT("1"));
 	}
 
 	static bool ShouldCompilePermutation(const FVertexFactoryShaderPermutationParameters& Parameters)
 	{
-		return true;
+		return GrowMeshFetch ? RHISupportsManualVertexFetch(Parameters.Platform) : true;
 	}
 
 	void SetData(const FDataType& InData)
@@ -193,10 +269,17 @@ public:
 
 	void AddVertexElements(FDataType& InData, FVertexDeclarationElementList& OutElements)
 	{
-		OutElements.Add(AccessStreamComponent(InData.PositionComponent, 0));
+		if (GrowMeshFetch)
+		{
+			OutElements.Add(AccessStreamComponent(InData.SourceVertexIndex, 0));
+		}
+		else
+		{
+			OutElements.Add(AccessStreamComponent(InData.PositionComponent, 0));
 
-		OutElements.Add(AccessStreamComponent(InData.TangentBasisComponents[0], 1));
-		OutElements.Add(AccessStreamComponent(InData.TangentBasisComponents[1], 2));
+			OutElements.Add(AccessStreamComponent(InData.TangentBasisComponents[0], 1));
+			OutElements.Add(AccessStreamComponent(InData.TangentBasisComponents[1], 2));
+		}
 
 		if (InData.TextureCoordinates.Num())
 		{
@@ -215,14 +298,17 @@ public:
 			}
 		}
 
-		if (InData.ColorComponent.VertexBuffer)
-		{
-			OutElements.Add(AccessStreamComponent(InData.ColorComponent, 3));
-		}
-		else
+		if (!GrowMeshFetch)
 		{
-			FVertexStreamComponent NullColorComponent(&GNullColorVertexBuffer, 0, 0, VET_Color);
-			OutElements.Add(AccessStreamComponent(NullColorComponent, 3));
+			if (InData.ColorComponent.VertexBuffer)
+			{
+				OutElements.Add(AccessStreamComponent(InData.ColorComponent, 3));
+			}
+			else
+			{
+				FVertexStreamComponent NullColorComponent(&GNullColorVertexBuffer, 0, 0, VET_Color);
+				OutElements.Add(AccessStreamComponent(NullColorComponent, 3));
+			}
 		}
 		OutElements.Add(AccessStreamComponent(InData.FurOffset, 12));
 	}
@@ -257,32 +343,58 @@ public:
 	FShaderDataType ShaderData;
 };
 
-class FPhysicsFurStaticVertexFactory : public FFurStaticVertexFactoryBase<true>
+class FPhysicsFurStaticVertexFactory : public FFurStaticVertexFactoryBase<true, false>
 {
 	DECLARE_VERTEX_FACTORY_TYPE(FPhysicsFurStaticVertexFactory);
 public:
 	FPhysicsFurStaticVertexFactory(ERHIFeatureLevel::Type InFeatureLevel)
-		: FFurStaticVertexFactoryBase<true>(InFeatureLevel)
+		: FFurStaticVertexFactoryBase<true, false>(InFeatureLevel)
 	{
 	}
 
-	using FFurStaticVertexFactoryBase<true>::Init;
+	using FFurStaticVertexFactoryBase<true, false>::Init;
 };
 
-class FFurStaticVertexFactory : public FFurStaticVertexFactoryBase<false>
+class FFurStaticVertexFactory : public FFurStaticVertexFactoryBase<false, false>
 {
 	DECLARE_VERTEX_FACTORY_TYPE(FFurStaticVertexFactory);
 public:
 	FFurStaticVertexFactory(ERHIFeatureLevel::Type InFeatureLevel)
-		: FFurStaticVertexFactoryBase<false>(InFeatureLevel)
+		: FFurStaticVertexFactoryBase<false, false>(InFeatureLevel)
 	{
 	}
 
-	using FFurStaticVertexFactoryBase<false>::Init;
+	using FFurStaticVertexFactoryBase<false, false>::Init;
+};
+
+class FPhysicsGrowMeshFurStaticVertexFactory : public FFurStaticVertexFactoryBase<true, true>
+{
+	DECLARE_VERTEX_FACTORY_TYPE(FPhysicsGrowMeshFurStaticVertexFactory);
+public:
+	FPhysicsGrowMeshFurStaticVertexFactory(ERHIFeatureLevel::Type InFeatureLevel)
+		: FFurStaticVertexFactoryBase<true, true>(InFeatureLevel)
+	{
+	}
+
+	using FFurStaticVertexFactoryBase<true, true>::Init;
+};
+
+class FGrowMeshFurStaticVertexFactory : public FFurStaticVertexFactoryBase<false, true>
+{
+	DECLARE_VERTEX_FACTORY_TYPE(FGrowMeshFurStaticVertexFactory);
+public:
+	FGrowMeshFurStaticVertexFactory(ERHIFeatureLevel::Type InFeatureLevel)
+		: FFurStaticVertexFactoryBase<false, true>(InFeatureLevel)
+	{
+	}
+
+	using FFurStaticVertexFactoryBase<false, true>::Init;
 };
 
 IMPLEMENT_VERTEX_FACTORY_PARAMETER_TYPE(FPhysicsFurStaticVertexFactory, SF_Vertex, FFurStaticVertexFactoryShaderParameters);
 IMPLEMENT_VERTEX_FACTORY_PARAMETER_TYPE(FFurStaticVertexFactory, SF_Vertex, FFurStaticVertexFactoryShaderParameters);
+IMPLEMENT_VERTEX_FACTORY_PARAMETER_TYPE(FPhysicsGrowMeshFurStaticVertexFactory, SF_Vertex, FFurStaticVertexFactoryShaderParameters);
+IMPLEMENT_VERTEX_FACTORY_PARAMETER_TYPE(FGrowMeshFurStaticVertexFactory, SF_Vertex, FFurStaticVertexFactoryShaderParameters);
 
 IMPLEMENT_VERTEX_FACTORY_TYPE(FPhysicsFurStaticVertexFactory, "/Plugin/gFur/Private/GFurStaticFactory.ush",
 	EVertexFactoryFlags::UsedWithMaterials
@@ -292,9 +404,17 @@ IMPLEMENT_VERTEX_FACTORY_TYPE(FFurStaticVertexFactory, "/Plugin/gFur/Private/GFu
 	EVertexFactoryFlags::UsedWithMaterials
 	| EVertexFactoryFlags::SupportsDynamicLighting
 	| EVertexFactoryFlags::SupportsPrecisePrevWorldPos);
+IMPLEMENT_VERTEX_FACTORY_TYPE(FPhysicsGrowMeshFurStaticVertexFactory, "/Plugin/gFur/Private/GFurStaticFactory.ush",
+	EVertexFactoryFlags::UsedWithMaterials
+	| EVertexFactoryFlags::SupportsDynamicLighting
+	| EVertexFactoryFlags::SupportsPrecisePrevWorldPos);
+IMPLEMENT_VERTEX_FACTORY_TYPE(FGrowMeshFurStaticVertexFactory, "/Plugin/gFur/Private/GFurStaticFactory.ush",
+	EVertexFactoryFlags::UsedWithMaterials
+	| EVertexFactoryFlags::SupportsDynamicLighting
+	| EVertexFactoryFlags::SupportsPrecisePrevWorldPos);
 
-template<bool Physics>
-void FFurStaticVertexFactoryBase<Physics>::FShaderDataType::GoToNextFrame(bool InDiscontinuous)
+template<bool Physics, bool GrowMeshFetch>
+void FFurStaticVertexFactoryBase<Physics, GrowMeshFetch>::FShaderDataType::GoToNextFrame(bool InDiscontinuous)
 {
 	Discontinuous = InDiscontinuous;
 }
@@ -331,22 +451,43 @@ void FFurStaticVertexFactoryShaderParameters::GetElementShaderBindings(
 		ShaderBindings.Add(PreviousFurPositionParameter, ShaderData.FurPosition);
 		ShaderBindings.Add(PreviousFurAngularOffsetParameter, ShaderData.FurAngularOffset);
 	}
+
+	if (GrowMeshPositionsParameter.IsBound())
+	{
+		ShaderBindings.Add(GrowMeshPositionsParameter, ShaderData.GrowMesh.Positions);
+		ShaderBindings.Add(GrowMeshTangentsParameter, ShaderData.GrowMesh.Tangents);
+		ShaderBindings.Add(GrowMeshTexCoordsParameter, ShaderData.GrowMesh.TexCoords);
+		ShaderBindings.Add(GrowMeshColorsParameter, ShaderData.GrowMesh.Colors);
+		ShaderBindings.Add(GrowMeshNumTexCoordsParameter, ShaderData.GrowMesh.NumTexCoords);
+		ShaderBindings.Add(GrowMeshColorIndexMaskParameter, ShaderData.GrowMesh.ColorIndexMask);
+	}
+
+	ShaderBindings.Add(CompactVertexFormatParameter, ShaderData.Layers.CompactVertexFormat);
+	ShaderBindings.Add(FurLayerCountParameter, ShaderData.Layers.FurLayerCount);
+	// the linear shells are shared by components differing in the shell bias and the noise strength, their vertex factories hold them
+	const FFurVertexFactory* FurVertexFactory = static_cast<const FFurVertexFactory*>(VertexFactory);
+	ShaderBindings.Add(FurShellBiasParameter, ShaderData.Layers.LinearShells ? FurVertexFactory->GetFurShellBias() : ShaderData.Layers.ShellBias);
+	ShaderBindings.Add(FurLengthScaleParameter, FurVertexFactory->GetFurLengthScale());
+	ShaderBindings.Add(LinearShellsParameter, ShaderData.Layers.LinearShells);
+	ShaderBindings.Add(ProceduralShellsParameter, ShaderData.Layers.ProceduralShells);
+	// procedural shells draw every layer as its own batch, UserIndex is the layer counted from the tip
+	ShaderBindings.Add(FurLayerIndexParameter, ShaderData.Layers.ProceduralShells ? (uint32)BatchElement.UserIndex : 0u);
+	ShaderBindings.Add(FurNoiseStrengthParameter, ShaderData.Layers.LinearShells ? FurVertexFactory->GetFurNoiseStrength() : ShaderData.Layers.NoiseStrength);
+	ShaderBindings.Add(FurNoiseSeedParameter, ShaderData.Layers.NoiseSeed);
+	ShaderBindings.Add(FurProfileStrideParameter, ShaderData.Layers.GetProfileStride());
+	ShaderBindings.Add(FurProfilesParameter, ShaderData.Layers.GetProfilesSRV());
 }
 
 /** Fur Skin Data */
-FFurStaticData* FFurStaticData::CreateFurData(int32 InFurLayerCount, int32 InLod, UGFurComponent* InFurComponent)
+FFurStaticData* FFurStaticData::CreateFurData(int32 InFurLayerCount, int32 InLod, UGFurComponent* InFurComponent, const TSharedPtr<FByteBulkData, ESPMode::ThreadSafe>& InCookedData, const UGFurComponent* InCookedComponent)
 {
 	check(InFurLayerCount >= MinimalFurLayerCount && InFurLayerCount <= MaximalFurLayerCount);
 
-	FScopeLock lock(&FurStaticDataCS);
-
-	for (FFurStaticData* Data : FurStaticData)
+	const FSHAHash Key = CalcRegistryKey(InFurLayerCount, InLod, InFurComponent);
+	if (FFurStaticData* Data = FurStaticData.Find(Key))
 	{
-		if (Data->Compare(InFurLayerCount, InLod, InFurComponent))
-		{
-			Data->RefCount++;
-			return Data;
-		}
+		Data->LaunchBuild(InFurComponent, [Data]() { Data->BuildFur(BuildType::Full); });
+		return Data;
 	}
 /*	for (FFurStaticData* Data : FurStaticData)
 	{
@@ -359,58 +500,125 @@ FFurStaticData* FFurStaticData::CreateFurData(int32 InFurLayerCount, int32 InLod
 		}
 	}*/
 
-	FFurStaticData* Data = new FFurStaticData();
-	Data->Set(InFurLayerCount, InLod, InFurComponent);
-	Data->BuildFur(BuildType::Full);
-	FurStaticData.Add(Data);
+	// set outside of the registry lock, it may generate the splines of the guide meshes
+	FFurStaticData* NewData = new FFurStaticData();
+	NewData->Set(InFurLayerCount, InLod, InFurComponent);
+	// the payload of a Blueprint template is loaded only when the spawned component generates the same fur
+	if (InCookedComponent == nullptr || InCookedComponent == InFurComponent || CalcRegistryKey(InFurLayerCount, InLod, InCookedComponent) == Key)
+		NewData->CookedData = InCookedData;
+	FFurStaticData* Data = FurStaticData.Add(Key, NewData);
+	if (Data != NewData)
+		delete NewData;
+	Data->LaunchBuild(InFurComponent, [Data]() { Data->BuildFur(BuildType::Full); });
 	return Data;
 }
 
-void FFurStaticData::DestroyFurData(const TArray<FFurData*>& InFurDataArray)
+static void DeleteEvictedData(const TArray<FFurStaticData*>& InEvictedData)
 {
-	FScopeLock lock(&FurStaticDataCS);
-
-	for (auto* Data : InFurDataArray)
-		((FFurStaticData*)Data)->RefCount--;
+	if (InEvictedData.Num() == 0)
+		return;
 
-	StartFurDataCleanupTask([]() {
-
-		FScopeLock lock(&FurStaticDataCS);
-
-		for (int32 i = FurStaticData.Num() - 1; i >= 0; i--)
+#if WITH_EDITORONLY_DATA
+	// a debounced edit must not start a build after the cleanup waited for the last one
+	for (FFurStaticData* Data : InEvictedData)
+		FFurBuildScheduler::Get().CancelEdit(Data);
+#endif // WITH_EDITORONLY_DATA
+	StartFurDataCleanupTask([InEvictedData]() {
+		// a component destroyed right after its creation may still be building
+		for (FFurStaticData* Data : InEvictedData)
 		{
-			FFurStaticData* Data = FurStaticData[i];
-			if (Data->RefCount == 0)
-			{
-				FurStaticData.RemoveAt(i);
-				ENQUEUE_RENDER_COMMAND(ReleaseDataCommand)([Data](FRHICommandListImmediate& RHICmdList) { delete Data; });
-			}
+			Data->WaitForBuild();
+			ENQUEUE_RENDER_COMMAND(ReleaseDataCommand)([Data](FRHICommandListImmediate& RHICmdList) { delete Data; });
 		}
 	});
 }
 
-void FFurStaticData::CreateVertexFactories(TArray<FFurVertexFactory*>& VertexFactories, FVertexBuffer* InMorphVertexBuffer, bool InPhysics, ERHIFeatureLevel::Type InFeatureLevel)
+void FFurStaticData::DestroyFurData(const TArray<FFurData*>& InFurDataArray)
+{
+	FurStaticData.Release(InFurDataArray, [](FFurData* Data) { FFurBuildScheduler::Get().Cancel(Data); });
+
+	TArray<FFurStaticData*> EvictedData;
+	FurStaticData.Trim(GetRetentionBudget(), GetRetentionMaxEntries(), EvictedData);
+	DeleteEvictedData(EvictedData);
+}
+
+void FFurStaticData::GetRegistryStats(int32& OutNumData, uint64& OutBuiltSize)
 {
+	FurStaticData.GetStats(OutNumData, OutBuiltSize);
+}
+
+const FStaticMeshVertexBuffers* FFurStaticData::GetGrowMeshVertexBuffers_RenderThread() const
+{
+	const FStaticMeshRenderData* RenderData = StaticMesh->GetRenderData();
+	if (RenderData == nullptr || !RenderData->LODResources.IsValidIndex(Lod))
+		return nullptr;
+	const FStaticMeshVertexBuffers& VertexBuffers = RenderData->LODResources[Lod].VertexBuffers;
+	if (!VertexBuffers.PositionVertexBuffer.IsInitialized() || VertexBuffers.PositionVertexBuffer.GetNumVertices() != GrowMeshVertexCount)
+		return nullptr;
+	return &VertexBuffers;
+}
+
+bool FFurStaticData::CreateVertexFactories(TArray<FFurVertexFactory*>& VertexFactories, FVertexBuffer* InMorphVertexBuffer, bool InPhysics, ERHIFeatureLevel::Type InFeatureLevel)
+{
+	const FStaticMeshVertexBuffers* GrowMeshVertexBuffers = nullptr;
+	if (bGrowMeshFetch)
+	{
+		GrowMeshVertexBuffers = GetGrowMeshVertexBuffers_RenderThread();
+		if (GrowMeshVertexBuffers == nullptr)
+			return false;
+	}
+
+	const FFurLayerShaderData Layers = GetLayerShaderData();
 	auto CreateVertexFactory = [&](const FFurData::FSection& s, auto* vf) {
 		if (bUseHighPrecisionTangentBasis)
 		{
 			if (bUseFullPrecisionUVs)
-				vf->template Init<EStaticMeshVertexTangentBasisType::HighPrecision, EStaticMeshVertexUVType::HighPrecision>(&VertexBuffer);
+			{
+				if (bUseCompactVertexFormat)
+					vf->template Init<EStaticMeshVertexTangentBasisType::HighPrecision, EStaticMeshVertexUVType::HighPrecision, true>(&VertexBuffer, GrowMeshVertexBuffers, Layers);
+				else
+					vf->template Init<EStaticMeshVertexTangentBasisType::HighPrecision, EStaticMeshVertexUVType::HighPrecision, false>(&VertexBuffer, GrowMeshVertexBuffers, Layers);
+			}
 			else
-				vf->template Init<EStaticMeshVertexTangentBasisType::HighPrecision, EStaticMeshVertexUVType::Default>(&VertexBuffer);
+			{
+				if (bUseCompactVertexFormat)
+					vf->template Init<EStaticMeshVertexTangentBasisType::HighPrecision, EStaticMeshVertexUVType::Default, true>(&VertexBuffer, GrowMeshVertexBuffers, Layers);
+				else
+					vf->template Init<EStaticMeshVertexTangentBasisType::HighPrecision, EStaticMeshVertexUVType::Default, false>(&VertexBuffer, GrowMeshVertexBuffers, Layers);
+			}
 		}
 		else
 		{
 			if (bUseFullPrecisionUVs)
-				vf->template Init<EStaticMeshVertexTangentBasisType::Default, EStaticMeshVertexUVType::HighPrecision>(&VertexBuffer);
+			{
+				if (bUseCompactVertexFormat)
+					vf->template Init<EStaticMeshVertexTangentBasisType::Default, EStaticMeshVertexUVType::HighPrecision, true>(&VertexBuffer, GrowMeshVertexBuffers, Layers);
+				else
+					vf->template Init<EStaticMeshVertexTangentBasisType::Default, EStaticMeshVertexUVType::HighPrecision, false>(&VertexBuffer, GrowMeshVertexBuffers, Layers);
+			}
 			else
-				vf->template Init<EStaticMeshVertexTangentBasisType::Default, EStaticMeshVertexUVType::Default>(&VertexBuffer);
+			{
+				if (bUseCompactVertexFormat)
+					vf->template Init<EStaticMeshVertexTangentBasisType::Default, EStaticMeshVertexUVType::Default, true>(&VertexBuffer, GrowMeshVertexBuffers, Layers);
+				else
+					vf->template Init<EStaticMeshVertexTangentBasisType::Default, EStaticMeshVertexUVType::Default, false>(&VertexBuffer, GrowMeshVertexBuffers, Layers);
+			}
 		}
 		BeginInitResource(vf);
 		VertexFactories.Add(vf);
 	};
 
-	if (InPhysics)
+	if (bGrowMeshFetch)
+	{
+		for (auto& s : Sections)
+		{
+			if (InPhysics)
+				CreateVertexFactory(s, new FPhysicsGrowMeshFurStaticVertexFactory(InFeatureLevel));
+			else
+				CreateVertexFactory(s, new FGrowMeshFurStaticVertexFactory(InFeatureLevel));
+		}
+	}
+	else if (InPhysics)
 	{
 		for (auto& s : Sections)
 		{
@@ -424,6 +632,7 @@ void FFurStaticData::CreateVertexFactories(TArray<FFurVertexFactory*>& VertexFac
 			CreateVertexFactory(s, new FFurStaticVertexFactory(InFeatureLevel));
 		}
 	}
+	return true;
 }
 
 FFurStaticData::~FFurStaticData()
@@ -462,6 +671,7 @@ void FFurStaticData::UnbindChangeDelegates()
 			GuideMeshes[i]->OnMeshChanged.Remove(GuideMeshesChangeHandles[i]);
 	}
 	GuideMeshesChangeHandles.Reset();
+	FFurBuildScheduler::Get().CancelEdit(this);
 #endif // WITH_EDITORONLY_DATA
 }
 
@@ -479,10 +689,12 @@ void FFurStaticData::Set(int32 InFurLayerCount, int32 InLod, class UGFurComponen
 
 	StaticMesh = InFurComponent->StaticGrowMesh;
 	GuideMeshes = InFurComponent->StaticGuideMeshes;
+	if (StaticMesh)
+		ReferencedAssets.Emplace(StaticMesh);
 #if WITH_EDITORONLY_DATA
 	if (StaticMesh)
 		StaticMesh->AddToRoot();
-	for (USkeletalMesh* Mesh : InFurComponent->SkeletalGuideMeshes)
+	for (UStaticMesh* Mesh : GuideMeshes)
 		Mesh->AddToRoot();
 #endif // WITH_EDITORONLY_DATA
 
@@ -495,11 +707,11 @@ void FFurStaticData::Set(int32 InFurLayerCount, int32 InLod, class UGFurComponen
 		FurSplinesUsed = FurSplinesGenerated;
 	}
 #if WITH_EDITORONLY_DATA
-	StaticMeshChangeHandle = StaticMesh->OnMeshChanged.AddLambda([this]() { BuildFur(BuildType::Full); });
+	StaticMeshChangeHandle = StaticMesh->OnMeshChanged.AddLambda([this]() { RequestEditBuild(BuildType::Full); });
 	if (FurSplinesAssigned)
 	{
-		FurSplinesChangeHandle = FurSplinesAssigned->OnSplinesChanged.AddLambda([this]() { BuildFur(BuildType::Splines); });
-		FurSplinesCombHandle = FurSplinesAssigned->OnSplinesCombed.AddLambda([this](const TArray<uint32>& VertexSet) { BuildFur(VertexSet); });
+		FurSplinesChangeHandle = FurSplinesAssigned->OnSplinesChanged.AddLambda([this]() { RequestEditBuild(BuildType::Splines); });
+		FurSplinesCombHandle = FurSplinesAssigned->OnSplinesCombed.AddLambda([this](const TArray<uint32>& VertexSet) { RequestEditBuild(VertexSet); });
 	}
 	else if (GuideMeshes.Num() > 0)
 	{
@@ -507,14 +719,7 @@ void FFurStaticData::Set(int32 InFurLayerCount, int32 InLod, class UGFurComponen
 		{
 			if (GuideMesh)
 			{
-				auto Handle = GuideMesh->OnMeshChanged.AddLambda([this, InLod]() {
-					if (FurSplinesGenerated)
-						FurSplinesGenerated->ConditionalBeginDestroy();
-					FurSplinesGenerated = NewObject<UFurSplines>();
-					GenerateSplines(FurSplinesGenerated, StaticMesh, InLod, GuideMeshes);
-					FurSplinesUsed = FurSplinesGenerated;
-					BuildFur(BuildType::Splines);
-				});
+				auto Handle = GuideMesh->OnMeshChanged.AddLambda([this]() { RequestEditBuild(BuildType::Splines, true); });
 				GuideMeshesChangeHandles.Add(Handle);
 			}
 			else
@@ -526,9 +731,74 @@ void FFurStaticData::Set(int32 InFurLayerCount, int32 InLod, class UGFurComponen
 #endif // WITH_EDITORONLY_DATA
 }
 
-bool FFurStaticData::Compare(int32 InFurLayerCount, int32 InLod, class UGFurComponent* InFurComponent)
+#if WITH_EDITORONLY_DATA
+bool FFurStaticData::EvictIfReleased()
+{
+	if (!FurStaticData.Evict(this))
+		return false;
+	DeleteEvictedData({ this });
+	return true;
+}
+
+TUniqueFunction<void()> FFurStaticData::PrepareEditBuild()
+{
+	FEditBuild Edit = MoveTemp(PendingEditBuild);
+	PendingEditBuild = FEditBuild();
+
+	InvalidateIntermediates();
+	if (Edit.bRegenerateSplines)
+	{
+		if (FurSplinesGenerated)
+			FurSplinesGenerated->ConditionalBeginDestroy();
+		FurSplinesGenerated = NewObject<UFurSplines>();
+		GenerateSplines(FurSplinesGenerated, StaticMesh, Lod, GuideMeshes);
+		FurSplinesUsed = FurSplinesGenerated;
+	}
+
+	if (Edit.Build.IsSet())
+		return [this, Build = Edit.Build.GetValue()]() { BuildFur(Build); };
+	return [this, VertexSet = Edit.CombedVertices.Array()]() { BuildFur(VertexSet); };
+}
+#endif // WITH_EDITORONLY_DATA
+
+FSHAHash FFurStaticData::CalcRegistryKey(int32 InFurLayerCount, int32 InLod, const UGFurComponent* InFurComponent)
 {
-	return FFurData::Compare(InFurLayerCount, InLod, InFurComponent) && StaticMesh == InFurComponent->StaticGrowMesh && GuideMeshes == InFurComponent->StaticGuideMeshes;
+	FSHA1 Hash;
+	HashParameters(Hash, InFurLayerCount, InLod, InFurComponent);
+
+	auto HashMesh = [&Hash, InLod](const UStaticMesh* Mesh) {
+		HashAsset(Hash, Mesh, InLod, [Mesh, InLod](FSHA1& InOutContentHash) {
+			const FStaticMeshRenderData* RenderData = Mesh->GetRenderData();
+			return RenderData && RenderData->LODResources.IsValidIndex(InLod) && HashGrowMesh(InOutContentHash, RenderData->LODResources[InLod]);
+		});
+	};
+	HashMesh(InFurComponent->StaticGrowMesh);
+	const int32 NumGuideMeshes = InFurComponent->StaticGuideMeshes.Num();
+	Hash.Update((const uint8*)&NumGuideMeshes, sizeof(NumGuideMeshes));
+	for (const UStaticMesh* GuideMesh : InFurComponent->StaticGuideMeshes)
+		HashMesh(GuideMesh);
+
+	Hash.Final();
+	FSHAHash Key;
+	Hash.GetHash(Key.Hash);
+	return Key;
+}
+
+bool FFurStaticData::HashGrowMesh(FSHA1& InOutHash, const FStaticMeshLODResources& LodRenderData)
+{
+	if (!HashGrowMeshVertices(InOutHash, LodRenderData.VertexBuffers))
+		return false;
+
+	TArray<uint32> SourceIndices;
+	LodRenderData.IndexBuffer.GetCopy(SourceIndices);
+	InOutHash.Update((const uint8*)SourceIndices.GetData(), SourceIndices.Num() * sizeof(uint32));
+	for (const auto& Section : LodRenderData.Sections)
+	{
+		InOutHash.Update((const uint8*)&Section.MaterialIndex, sizeof(Section.MaterialIndex));
+		InOutHash.Update((const uint8*)&Section.FirstIndex, sizeof(Section.FirstIndex));
+		InOutHash.Update((const uint8*)&Section.NumTriangles, sizeof(Section.NumTriangles));
+	}
+	return true;
 }
 
 bool FFurStaticData::Similar(int32 InLod, class UGFurComponent* InFurComponent)
@@ -536,6 +806,15 @@ bool FFurStaticData::Similar(int32 InLod, class UGFurComponent* InFurComponent)
 	return FFurData::Similar(InLod, InFurComponent) && StaticMesh == InFurComponent->StaticGrowMesh && GuideMeshes == InFurComponent->StaticGuideMeshes;
 }
 
+#if WITH_EDITOR
+FString FFurStaticData::GetDerivedDataKey(const FStaticMeshLODResources& LodRenderData) const
+{
+	FSHA1 Hash;
+	HashGrowMesh(Hash, LodRenderData);
+	return BuildDerivedDataKey(Hash);
+}
+#endif // WITH_EDITOR
+
 void FFurStaticData::BuildFur(BuildType Build)
 {
 	auto* StaticMeshResource = StaticMesh->GetRenderData();
@@ -560,10 +839,24 @@ inline void FFurStaticData::BuildFur(const FStaticMeshLODResources& LodRenderDat
 template<EStaticMeshVertexTangentBasisType TangentBasisTypeT, EStaticMeshVertexUVType UVTypeT>
 inline void FFurStaticData::BuildFur(const FStaticMeshLODResources& LodRenderData, BuildType Build)
 {
-	typedef FFurStaticVertex<TangentBasisTypeT, UVTypeT> VertexType;
+	if (CompactVertexFormat)
+		BuildFur<TangentBasisTypeT, UVTypeT, true>(LodRenderData, Build);
+	else
+		BuildFur<TangentBasisTypeT, UVTypeT, false>(LodRenderData, Build);
+}
+
+template<EStaticMeshVertexTangentBasisType TangentBasisTypeT, EStaticMeshVertexUVType UVTypeT, bool bCompactT>
+inline void FFurStaticData::BuildFur(const FStaticMeshLODResources& LodRenderData, BuildType Build)
+{
+	typedef FFurStaticVertex<TangentBasisTypeT, UVTypeT, bCompactT> VertexType;
+	typedef FFurShellVertex<bCompactT> ShellVertexType;
 
 	bUseHighPrecisionTangentBasis = TangentBasisTypeT == EStaticMeshVertexTangentBasisType::HighPrecision;
 	bUseFullPrecisionUVs = UVTypeT == EStaticMeshVertexUVType::HighPrecision;
+	bUseCompactVertexFormat = bCompactT;
+	bGrowMeshFetch = CanReferenceGrowMeshVertices();
+	bProceduralShells = CanUseProceduralShells();
+	GrowMeshVertexCount = LodRenderData.VertexBuffers.PositionVertexBuffer.GetNumVertices();
 
 	const auto& SourcePositions = LodRenderData.VertexBuffers.PositionVertexBuffer;
 	const auto& SourceVertices = LodRenderData.VertexBuffers.StaticMeshVertexBuffer;
@@ -575,54 +868,69 @@ inline void FFurStaticData::BuildFur(const FStaticMeshLODResources& LodRenderDat
 	bool HasVertexColor = SourceColors.GetNumVertices() > 0;
 	check(!HasVertexColor || SourceVertexCount == SourceColors.GetNumVertices());
 
+	const uint32 BuiltVertexSize = bGrowMeshFetch ? sizeof(ShellVertexType) : sizeof(VertexType);
+	if (Build == BuildType::Full && LoadCookedData(BuiltVertexSize))
+		return;
+
+	if (Build >= BuildType::Splines)
+		AcquireIntermediates(StaticMesh, [&](TArray<FVector>& OutNormals) { UnpackNormals<TangentBasisTypeT>(OutNormals, SourceVertices); });
+#if WITH_EDITOR
+	FString DerivedDataKey;
 	if (Build == BuildType::Full)
 	{
-		UnpackNormals<TangentBasisTypeT>(SourceVertices);
+		DerivedDataKey = GetDerivedDataKey(LodRenderData);
+		if (LoadDerivedData(DerivedDataKey, BuiltVertexSize))
+			return;
 	}
+#endif // WITH_EDITOR
 	if (Build >= BuildType::Splines)
-		GenerateSplineMap(SourcePositions);
+	{
+		GenerateSplineMap(SourcePositions, [&](TArray<float>& OutVertexDistSquared) {
+			OutVertexDistSquared.SetNumUninitialized(SourceVertexCount);
+			for (uint32 i = 0; i < SourceVertexCount; i++)
+				OutVertexDistSquared[i] = SourcePositions.VertexPosition(i).SizeSquared();
+		});
+	}
 
-	uint32 NewVertexCount = VertexCountPerLayer * FurLayerCount;
+	const int32 VertexLayerCount = GetVertexLayerCount();
+	uint32 NewVertexCount = VertexCountPerLayer * VertexLayerCount;
 
 	FFurStaticVertexBlitter<TangentBasisTypeT, UVTypeT> VertexBlitter(SourcePositions, SourceVertices, SourceColors);
 
-	while (RenderThreadDataSubmissionPending)
-		;
-
-	VertexType* Vertices = VertexBuffer.Lock<VertexType>(NewVertexCount);
+	FVector4f* Profiles = bProceduralShells ? ProfileBuffer.Lock(NewVertexCount, GetProceduralProfileStride()) : nullptr;
+	if (bGrowMeshFetch)
 	{
-		uint32 VertexCount2 = GenerateFurVertices(0, SourceVertexCount, Vertices, VertexBlitter);
-		if (Build == BuildType::Full)
-		{
-			float MaxDistSq = 0;
-			for (uint32 i = 0; i < VertexCount2; i++)
-			{
-				const auto& Position = Vertices[i].Position;
-				float d = Position.SizeSquared();
-				if (d > MaxDistSq)
-					MaxDistSq = d;
-			}
-			MaxVertexBoneDistance = sqrtf(MaxDistSq);
-		}
+		ShellVertexType* Vertices = VertexBuffer.Lock<ShellVertexType>(NewVertexCount);
+		GenerateFurVertices(0, SourceVertexCount, Vertices, FFurShellVertexBlitter(), Profiles);
+	}
+	else
+	{
+		VertexType* Vertices = VertexBuffer.Lock<VertexType>(NewVertexCount);
+		GenerateFurVertices(0, SourceVertexCount, Vertices, VertexBlitter, Profiles);
 	}
 	VertexBuffer.Unlock();
+	if (Profiles)
+		ProfileBuffer.Unlock();
 
-	if (Build >= BuildType::Splines || FurLayerCount != OldFurLayerCount || RemoveFacesWithoutSplines != OldRemoveFacesWithoutSplines)
+	if (Build >= BuildType::Splines || VertexLayerCount != OldFurLayerCount || RemoveFacesWithoutSplines != OldRemoveFacesWithoutSplines)
 	{
-		OldFurLayerCount = FurLayerCount;
+		OldFurLayerCount = VertexLayerCount;
 		OldRemoveFacesWithoutSplines = RemoveFacesWithoutSplines;
 
 		// indices
 		TArray<uint32> SourceIndices;
 		LodRenderData.IndexBuffer.GetCopy(SourceIndices);
 
-		TArray<FSection>& LocalSections = Sections.Num() ? TempSections : Sections;
+		TArray<FSection>& LocalSections = TempSections;
 		LocalSections.SetNum(LodRenderData.Sections.Num());
 
 		auto& Indices = IndexBuffer.Lock();
 		Indices.Reset();
-		Indices.AddUninitialized(SourceIndices.Num() * FurLayerCount);
+		Indices.AddUninitialized(SourceIndices.Num());
 		uint32 Idx = 0;
+		const bool UseRemap = FurSplinesUsed && RemoveFacesWithoutSplines;
+		FFurTriangleOrderStats OrderStats;
+		TArray<uint32> SectionIndices;
 		for (int32 SectionIndex = 0; SectionIndex < LodRenderData.Sections.Num(); SectionIndex++)
 		{
 			const auto& SourceSection = LodRenderData.Sections[SectionIndex];
@@ -631,58 +939,32 @@ inline void FFurStaticData::BuildFur(const FStaticMeshLODResources& LodRenderDat
 			FurSection.MaterialIndex = SourceSection.MaterialIndex;
 			FurSection.MinVertexIndex = 0;
 			FurSection.MaxVertexIndex = NewVertexCount - 1;
+			FurSection.LayerVertexCount = VertexCountPerLayer;
 			FurSection.BaseIndex = Idx;
 
-			for (int32 Layer = 0; Layer < FurLayerCount; ++Layer)
-			{
-				int32 VertexIndexOffset = Layer * VertexCountPerLayer;
-				check(VertexIndexOffset >= 0);
-				if (FurSplinesUsed && RemoveFacesWithoutSplines)
-				{
-					for (uint32 t = 0; t < SourceSection.NumTriangles; ++t)
-					{
-						uint32 Idx0 = SourceIndices[SourceSection.FirstIndex + t * 3];
-						uint32 Idx1 = SourceIndices[SourceSection.FirstIndex + t * 3 + 1];
-						uint32 Idx2 = SourceIndices[SourceSection.FirstIndex + t * 3 + 2];
-						if (SplineMap[Idx0] >= 0 && SplineMap[Idx1] >= 0 && SplineMap[Idx2] >= 0)
-						{
-							Indices[Idx++] = VertexRemap[Idx0] + VertexIndexOffset;
-							Indices[Idx++] = VertexRemap[Idx1] + VertexIndexOffset;
-							Indices[Idx++] = VertexRemap[Idx2] + VertexIndexOffset;
-						}
-					}
-				}
-				else
-				{
-					for (uint32 i = 0; i < SourceSection.NumTriangles * 3; ++i)
-						Indices[Idx++] = SourceIndices[SourceSection.FirstIndex + i] + VertexIndexOffset;
-				}
-			}
+			GatherSectionIndices(SectionIndices, SourceIndices, SourceSection.FirstIndex, SourceSection.NumTriangles);
+			OptimizeTriangleOrder(SectionIndices, SourcePositions, OrderStats);
+			for (uint32 SrcVertexIndex : SectionIndices)
+				Indices[Idx++] = UseRemap ? VertexRemap[SrcVertexIndex] : SrcVertexIndex;
 			FurSection.NumTriangles = (Idx - FurSection.BaseIndex) / 3;
+			RebaseSectionIndices(Indices, FurSection, Idx);
 			FurSection.NumBones = 0;
 		}
 		check(Idx <= (uint32)Indices.Num());
 		Indices.RemoveAt(Idx, Indices.Num() - Idx, EAllowShrinking::No);
-
-		if (TempSections.Num())
-		{
-			ENQUEUE_RENDER_COMMAND(UpdateDataCommand)([this, NewVertexCount](FRHICommandListImmediate& RHICmdList) {
-				Sections = TempSections;
-				VertexCount = NewVertexCount;
-			});
-		}
-		else
-		{
-			VertexCount = NewVertexCount;
-		}
+		ReportTriangleOrder(OrderStats);
 
 		IndexBuffer.Unlock();
+
+		ENQUEUE_RENDER_COMMAND(UpdateDataCommand)([this, NewSections = TempSections, NewVertexCount](FRHICommandListImmediate& RHICmdList) {
+			Sections = NewSections;
+			VertexCount = NewVertexCount;
+		});
 	}
 
-	RenderThreadDataSubmissionPending = true;
-	ENQUEUE_RENDER_COMMAND(UpdateDataCommand)([this](FRHICommandListImmediate& RHICmdList) {
-		RenderThreadDataSubmissionPending = false;
-	});
+#if WITH_EDITOR
+	SaveDerivedData(DerivedDataKey);
+#endif // WITH_EDITOR
 
 #if !WITH_EDITORONLY_DATA
 	Normals.SetNum(0, true);
@@ -715,42 +997,69 @@ void FFurStaticData::BuildFur(const FStaticMeshLODResources& LodRenderData, cons
 template<EStaticMeshVertexTangentBasisType TangentBasisTypeT, EStaticMeshVertexUVType UVTypeT>
 void FFurStaticData::BuildFur(const TArray<uint32>& InVertexSet)
 {
-	typedef FFurStaticVertex<TangentBasisTypeT, UVTypeT> VertexType;
+	if (bUseCompactVertexFormat)
+		BuildFur<TangentBasisTypeT, UVTypeT, true>(InVertexSet);
+	else
+		BuildFur<TangentBasisTypeT, UVTypeT, false>(InVertexSet);
+}
 
-	while (RenderThreadDataSubmissionPending)
-		;
+template<EStaticMeshVertexTangentBasisType TangentBasisTypeT, EStaticMeshVertexUVType UVTypeT, bool bCompactT>
+void FFurStaticData::BuildFur(const TArray<uint32>& InVertexSet)
+{
+	typedef FFurStaticVertex<TangentBasisTypeT, UVTypeT, bCompactT> VertexType;
 
 	TArray<float> FurLengths;
 	GenerateFurLengths(FurLengths);
 
-	VertexType* Vertices = VertexBuffer.Lock<VertexType>(VertexCountPerLayer * FurLayerCount);
+	FFurProfileSpan Span;
+	if (FurSplinesUsed)
+		BuildFurProfile(Span, InVertexSet.GetData(), InVertexSet.Num(), FurLengths);
+
 	bool UseRemap = VertexRemap.Num() > 0;
-	for (int32 Layer = 0; Layer < FurLayerCount; Layer++)
+	const int32 VertexLayerCount = GetVertexLayerCount();
+	FVector4f* Profiles = bProceduralShells ? ProfileBuffer.Lock(VertexCountPerLayer * VertexLayerCount, GetProceduralProfileStride(), true) : nullptr;
+	if (Profiles)
 	{
-		auto GenLayerData = CalcFurGenLayerData(FurLayerCount - Layer);
-		for (uint32 SrcVertexIndex : InVertexSet)
+		const uint32 ProfileStride = GetProceduralProfileStride();
+		for (int32 Index = 0; Index < InVertexSet.Num(); Index++)
 		{
-			VertexType& Vertex = Vertices[(UseRemap ? VertexRemap[SrcVertexIndex] : SrcVertexIndex) + Layer * VertexCountPerLayer];
-
+			uint32 SrcVertexIndex = InVertexSet[Index];
+			WriteProceduralProfile(Profiles + (UseRemap ? VertexRemap[SrcVertexIndex] : SrcVertexIndex) * ProfileStride, Span, Index, SrcVertexIndex);
+		}
+	}
+	auto UpdateVertices = [&](auto* Vertices)
+	{
+		for (int32 Layer = 0; Layer < VertexLayerCount; Layer++)
+		{
+			auto GenLayerData = CalcFurGenLayerData(FurLayerCount - GetSlotLayerOffset(Layer));
 			if (FurSplinesUsed)
+				GenerateProfileLayer(Span, InVertexSet.GetData(), InVertexSet.Num(), GenLayerData);
+			for (int32 Index = 0; Index < InVertexSet.Num(); Index++)
 			{
-				int32 SplineIndex = SplineMap[SrcVertexIndex];
-				float Length = SplineIndex >= 0 ? FurLengths[SplineIndex] : FurLength;
-				GenerateFurVertex(Vertex.FurOffset, Vertex.UV1, Vertex.UV2, Vertex.UV3, FVector3f(Normals[SrcVertexIndex]), Length, GenLayerData, SplineIndex);
-			}
-			else
-			{
-				GenerateFurVertex(Vertex.FurOffset, Vertex.UV1, Vertex.UV2, Vertex.UV3, FVector3f(Normals[SrcVertexIndex]), FurLength, GenLayerData);
+				uint32 SrcVertexIndex = InVertexSet[Index];
+				uint32 DstVertexIndex = (UseRemap ? VertexRemap[SrcVertexIndex] : SrcVertexIndex) + Layer * VertexCountPerLayer;
+				auto& Vertex = Vertices[DstVertexIndex];
+				VertexBuffer.MarkDirty(DstVertexIndex);
+
+				if (FurSplinesUsed)
+				{
+					WriteProfileVertex(Vertex, Span, Index, GenLayerData);
+				}
+				else
+				{
+					GenerateFurLayer(Vertex.Layer, SrcVertexIndex, FVector3f(Normals[SrcVertexIndex]), FurLength, GenLayerData);
+				}
 			}
 		}
-	}
+	};
+	if (bGrowMeshFetch)
+		UpdateVertices(VertexBuffer.Lock<FFurShellVertex<bCompactT>>(VertexCountPerLayer * VertexLayerCount, true));
+	else
+		UpdateVertices(VertexBuffer.Lock<VertexType>(VertexCountPerLayer * VertexLayerCount, true));
 
 	VertexBuffer.Unlock();
-
-	RenderThreadDataSubmissionPending = true;
-	ENQUEUE_RENDER_COMMAND(UpdateDataCommand)([this](FRHICommandListImmediate& RHICmdList) {
-		RenderThreadDataSubmissionPending = false;
-	});
+	if (Profiles)
+		ProfileBuffer.Unlock();
 }
 
 /** Generate Splines */
@@ -9,10 +9,12 @@
 class FFurStaticData: public FFurData
 {
 public:
-	static FFurStaticData* CreateFurData(int32 InFurLayerCount, int32 InLod, class UGFurComponent* InFurComponent);
+	static FFurStaticData* CreateFurData(int32 InFurLayerCount, int32 InLod, class UGFurComponent* InFurComponent,
+		const TSharedPtr<FByteBulkData, ESPMode::ThreadSafe>& InCookedData = TSharedPtr<FByteBulkData, ESPMode::ThreadSafe>(), const class UGFurComponent* InCookedComponent = nullptr);
 	static void DestroyFurData(const TArray<FFurData*>& InFurDataArray);
+	static void GetRegistryStats(int32& OutNumData, uint64& OutBuiltSize);
 
-	virtual void CreateVertexFactories(TArray<FFurVertexFactory*>& VertexFactories, FVertexBuffer* InMorphVertexBuffer, bool InPhysics, ERHIFeatureLevel::Type InFeatureLevel) override;
+	virtual bool CreateVertexFactories(TArray<FFurVertexFactory*>& VertexFactories, FVertexBuffer* InMorphVertexBuffer, bool InPhysics, ERHIFeatureLevel::Type InFeatureLevel) override;
 protected:
 	UStaticMesh* StaticMesh;
 	TArray<UStaticMesh*> GuideMeshes;
@@ -31,23 +33,38 @@ protected:
 	~FFurStaticData();
 
 	void UnbindChangeDelegates();
+	const FStaticMeshVertexBuffers* GetGrowMeshVertexBuffers_RenderThread() const;
 	void Set(int32 InFurLayerCount, int32 InLod, class UGFurComponent* InFurComponent);
+#if WITH_EDITORONLY_DATA
+	virtual TUniqueFunction<void()> PrepareEditBuild() override;
+	virtual bool EvictIfReleased() override;
+#endif // WITH_EDITORONLY_DATA
 
-	bool Compare(int32 InFurLayerCount, int32 InLod, class UGFurComponent* InFurComponent);
+	/** Hash of every input of the fur data, components with equal keys share the data */
+	static FSHAHash CalcRegistryKey(int32 InFurLayerCount, int32 InLod, const class UGFurComponent* InFurComponent);
+	static bool HashGrowMesh(FSHA1& InOutHash, const FStaticMeshLODResources& LodRenderData);
 	bool Similar(int32 InLod, class UGFurComponent* InFurComponent);
 
+#if WITH_EDITOR
+	FString GetDerivedDataKey(const FStaticMeshLODResources& LodRenderData) const;
+#endif // WITH_EDITOR
+
 	void BuildFur(BuildType Build);
 
 	template<EStaticMeshVertexTangentBasisType TangentBasisTypeT>
 	void BuildFur(const FStaticMeshLODResources& LodRenderData, BuildType Build);
 	template<EStaticMeshVertexTangentBasisType TangentBasisTypeT, EStaticMeshVertexUVType UVTypeT>
 	void BuildFur(const FStaticMeshLODResources& LodRenderData, BuildType Build);
+	template<EStaticMeshVertexTangentBasisType TangentBasisTypeT, EStaticMeshVertexUVType UVTypeT, bool bCompactT>
+	void BuildFur(const FStaticMeshLODResources& LodRenderData, BuildType Build);
 
 	void BuildFur(const TArray<uint32>& InVertexSet);
 	template<EStaticMeshVertexTangentBasisType TangentBasisTypeT>
 	void BuildFur(const FStaticMeshLODResources& LodRenderData, const TArray<uint32>& InVertexSet);
 	template<EStaticMeshVertexTangentBasisType TangentBasisTypeT, EStaticMeshVertexUVType UVTypeT>
 	void BuildFur(const TArray<uint32>& InVertexSet);
+	template<EStaticMeshVertexTangentBasisType TangentBasisTypeT, EStaticMeshVertexUVType UVTypeT, bool bCompactT>
+	void BuildFur(const TArray<uint32>& InVertexSet);
 };
 
 /** Generate Splines */
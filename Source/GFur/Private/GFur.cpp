@@ -1,7 +1,11 @@
 // Copyright 2023 GiM s.r.o. All Rights Reserved.
 
 #include "GFur.h"
+#include "FurBuildScheduler.h"
+#include "FurMemoryBudget.h"
 #include "Interfaces/IPluginManager.h"
+#include "Misc/App.h"
+#include "Misc/CommandLine.h"
 #include "Misc/Paths.h"
 #include "ShaderCore.h"
 
@@ -12,12 +16,21 @@ void FGFurModule::StartupModule()
 	// This code will execute after your module is loaded into memory; the exact timing is specified in the .uplugin file per-module
 	FString PluginShaderDir = FPaths::Combine(IPluginManager::Get().FindPlugin(TEXT("gFur"))->GetBaseDir(), TEXT("Shaders"));
 	AddShaderSourceDirectoryMapping(TEXT("/Plugin/gFur"), PluginShaderDir);
+
+	// nothing is drawn on dedicated servers and with -nullrhi, the RHI isn't initialized yet so the command line tells
+	if (FApp::CanEverRender() && !FParse::Param(FCommandLine::Get(), TEXT("nullrhi")))
+	{
+		FFurBuildScheduler::Get().Startup();
+		FFurMemoryBudget::Get().Startup();
+	}
 }
 
 void FGFurModule::ShutdownModule()
 {
 	// This function may be called during shutdown to clean up your module.  For modules that support dynamic reloading,
 	// we call this function before unloading the module.
+	FFurMemoryBudget::Get().Shutdown();
+	FFurBuildScheduler::Get().Shutdown();
 }
 
 #undef LOCTEXT_NAMESPACE
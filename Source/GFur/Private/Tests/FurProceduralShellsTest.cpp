@@ -0,0 +1,31 @@
+// Copyright 2023 GiM s.r.o. All Rights Reserved.
+
+#include "Misc/AutomationTest.h"
+
+#if WITH_DEV_AUTOMATION_TESTS
+
+#include "FurData.h"
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FFurProceduralShellsTest, "GFur.ProceduralShells.MatchGeneratedLayers",
+	EAutomationTestFlags_ApplicationContextMask | EAutomationTestFlags::EngineFilter)
+
+bool FFurProceduralShellsTest::RunTest(const FString& Parameters)
+{
+	// the fur is built for the length 1.0, float rounding of the two paths stays far below this
+	const float Epsilon = 1e-3f;
+	const float ShellBiases[] = { 0.0f, 1.0f, 4.0f };
+	for (float ShellBias : ShellBiases)
+	{
+		for (bool bSplines : { true, false })
+		{
+			float MaxOffsetError, MaxUvError;
+			FFurData::CompareProceduralShells(4096, 4, 32, ShellBias, bSplines, MaxOffsetError, MaxUvError);
+			const FString Context = FString::Printf(TEXT("shell bias %g, %s"), ShellBias, bSplines ? TEXT("splines") : TEXT("no splines"));
+			TestTrue(FString::Printf(TEXT("Offset difference %g within %g (%s)"), MaxOffsetError, Epsilon, *Context), MaxOffsetError <= Epsilon);
+			TestTrue(FString::Printf(TEXT("UV difference %g within %g (%s)"), MaxUvError, Epsilon, *Context), MaxUvError <= Epsilon);
+		}
+	}
+	return true;
+}
+
+#endif // WITH_DEV_AUTOMATION_TESTS
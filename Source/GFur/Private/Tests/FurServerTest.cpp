@@ -0,0 +1,63 @@
+// Copyright 2023 GiM s.r.o. All Rights Reserved.
+
+#include "Misc/AutomationTest.h"
+
+#if WITH_DEV_AUTOMATION_TESTS && WITH_EDITOR
+
+#include "FurComponent.h"
+#include "FurSkinData.h"
+#include "FurStaticData.h"
+#include "Engine/StaticMesh.h"
+#include "Engine/World.h"
+#include "GameFramework/Actor.h"
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FFurDedicatedServerTest, "GFur.DedicatedServer.SkipsFur",
+	EAutomationTestFlags::EditorContext | EAutomationTestFlags::EngineFilter)
+
+bool FFurDedicatedServerTest::RunTest(const FString& Parameters)
+{
+	auto GetRegistryStats = [](int32& OutNumData, uint64& OutBuiltSize) {
+		int32 NumSkinData, NumStaticData;
+		uint64 SkinSize, StaticSize;
+		FFurSkinData::GetRegistryStats(NumSkinData, SkinSize);
+		FFurStaticData::GetRegistryStats(NumStaticData, StaticSize);
+		OutNumData = NumSkinData + NumStaticData;
+		OutBuiltSize = SkinSize + StaticSize;
+	};
+
+	UStaticMesh* GrowMesh = LoadObject<UStaticMesh>(nullptr, TEXT("/Engine/BasicShapes/Cube.Cube"));
+	if (!TestNotNull(TEXT("Grow mesh"), GrowMesh))
+		return false;
+
+	int32 NumDataBefore;
+	uint64 BuiltSizeBefore;
+	GetRegistryStats(NumDataBefore, BuiltSizeBefore);
+
+	// a world without a net driver takes the PIE net mode
+	UWorld* World = UWorld::CreateWorld(EWorldType::PIE, false, TEXT("GFurServerTest"));
+	World->SetPlayInEditorInitialNetMode(NM_DedicatedServer);
+	TestTrue(TEXT("World runs as a dedicated server"), World->IsNetMode(NM_DedicatedServer));
+
+	AActor* Actor = World->SpawnActor<AActor>();
+	UGFurComponent* FurComponent = NewObject<UGFurComponent>(Actor);
+	FurComponent->StaticGrowMesh = GrowMesh;
+	FurComponent->RegisterComponent();
+	// begin play registers the tick functions
+	FurComponent->RegisterAllComponentTickFunctions(true);
+
+	TestFalse(TEXT("Render state created"), FurComponent->IsRenderStateCreated());
+	TestNull(TEXT("Scene proxy"), FurComponent->SceneProxy);
+	TestFalse(TEXT("Tick registered"), FurComponent->PrimaryComponentTick.IsTickFunctionRegistered());
+
+	int32 NumDataAfter;
+	uint64 BuiltSizeAfter;
+	GetRegistryStats(NumDataAfter, BuiltSizeAfter);
+	TestEqual(TEXT("Registered fur data"), NumDataAfter, NumDataBefore);
+	TestEqual(TEXT("Built fur size"), BuiltSizeAfter, BuiltSizeBefore);
+
+	World->DestroyWorld(false);
+	World->RemoveFromRoot();
+	return true;
+}
+
+#endif // WITH_DEV_AUTOMATION_TESTS && WITH_EDITOR
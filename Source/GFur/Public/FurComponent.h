@@ -4,6 +4,8 @@
 
 #include "Runtime/Engine/Classes/Components/MeshComponent.h"
 #include "Runtime/Engine/Classes/Components/SkinnedMeshComponent.h"
+#include "Serialization/BulkData.h"
+#include "Misc/SecureHash.h"
 #include "FurComponent.generated.h"
 
 USTRUCT(BlueprintType)
@@ -119,6 +121,42 @@ public:
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "gFur Shell settings")
 	bool RemoveFacesWithoutSplines;
 
+	/**
+	* Shells reference the position, tangents, UVs, color and skin weights of the grow mesh instead of storing a copy per layer.
+	* Greatly reduces fur memory with many layers. Requires manual vertex fetch support, falls back to copies otherwise.
+	*/
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "gFur Shell settings")
+	bool ReferenceGrowMeshVertices;
+
+	/**
+	* Stores the per layer fur offset and UVs in half precision and moves the layer constants to shader parameters.
+	* Reduces vertex bandwidth of the shells, the fur offset precision drops to about 0.1% of its length.
+	*/
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "gFur Shell settings")
+	bool CompactVertexFormat;
+
+	/**
+	* Stores a single layer and derives every other layer in the vertex shader from a per vertex fur profile, drawing each layer separately.
+	* Fur memory no longer grows with the layer count. Requires manual vertex fetch support, falls back to stored layers otherwise.
+	*/
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "gFur Shell settings")
+	bool ProceduralShells;
+
+	/**
+	* Orders the shells so that their first layers approximate the fur with fewer layers. LODs using the same LOD of the Grow Mesh
+	* draw a part of a single set of shells instead of generating their own, and the layer count blends smoothly towards the next LOD.
+	*/
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "gFur Shell settings")
+	bool ProgressiveLayers;
+
+	/**
+	* Stores the generated shells of every LOD in the cooked package, packaged games load them instead of generating the fur.
+	* Components spawned from a Blueprint load the fur cooked for its template as long as their fur settings match it.
+	* Increases the package size by the size of the fur buffers, the verbose cook log reports it per LOD.
+	*/
+	UPROPERTY(EditAnywhere, AdvancedDisplay, BlueprintReadWrite, Category = "gFur Shell settings")
+	bool CookFurData;
+
 	/**
 	* If fur should react to forces and movement.
 	*/
@@ -185,6 +223,12 @@ public:
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "gFur Shell settings")
 	float NoiseStrength;
 
+	/**
+	* Seed of the shell noise. The same seed always produces the same fur.
+	*/
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "gFur Shell settings")
+	int32 NoiseSeed;
+
 	/**
 	* Turns off support for Morph Targets
 	*/
@@ -223,20 +267,28 @@ public:
 	virtual class UBodySetup* GetBodySetup() override;
 	// End UPrimitiveComponent interface.
 
+	// Begin UObject interface.
+	virtual void Serialize(FArchive& Ar) override;
+	// End UObject interface.
+
 	const TArray<class UMaterialInstanceDynamic*>& GetFurMaterials() const { return FurMaterials; }
 
 	TWeakObjectPtr< class USkinnedMeshComponent > GetMasterPoseComponent() const { return MasterPoseComponent; }
 
 protected:
 	//~ Begin UActorComponent Interface
+	virtual bool ShouldCreateRenderState() const override;
 	virtual void CreateRenderState_Concurrent(FRegisterComponentContext* Context) override;
 	virtual void SendRenderDynamicData_Concurrent() override;
 	virtual void DestroyRenderState_Concurrent() override;
 
+	virtual void RegisterComponentTickFunctions(bool bRegister) override;
 	void TickComponent(float DeltaTime, enum ELevelTick TickType, FActorComponentTickFunction *ThisTickFunction) override;
 	//~ End UActorComponent Interface
 
 private:
+	friend class FFurMemoryBudget;
+
 	TWeakObjectPtr< class USkinnedMeshComponent > MasterPoseComponent;
 	TArray<TArray<int32>> MasterBoneMap;
 	TArray<FMatrix> ReferenceToLocal;
@@ -248,6 +300,11 @@ private:
 	TArray< class UMaterialInstanceDynamic* > FurMaterials;
 	TArray< class FFurData* > FurData;
 	TArray< TArray< int32 > > MorphRemapTables;
+	// Cooked fur of the base LOD followed by LODs, see CookFurData. Empty payloads were cooked once by another LOD or component of the package with the same key.
+	TArray< TSharedPtr< FByteBulkData, ESPMode::ThreadSafe > > CookedFurData;
+	TArray< FSHAHash > CookedFurKeys;
+	// package the payloads were loaded with, the keys of the cook are unique within it
+	FName CookedFurPackage;
 
 	FVector StaticLinearOffset;
 	FVector StaticAngularOffset;
@@ -256,6 +313,8 @@ private:
 	FMatrix StaticTransformation;
 	bool OldPositionValid = false;
 	int32 LastLOD = -1;
+	// Set by the fur memory budget, every level halves the layer counts and evicts the most detailed LOD
+	int32 BudgetDemotion = 0;
 
 	float LastDeltaTime;
 
@@ -265,8 +324,21 @@ private:
 	virtual FBoxSphereBounds CalcBounds(const FTransform & LocalToWorld) const override;
 	// Begin USceneComponent interface.
 
+	/** False where the fur is never drawn, the component skips the generation, the materials, the physics and the tick there */
+	bool ShouldGenerateFur() const;
 	void updateFur();
 	void UpdateFur_RenderThread(FRHICommandListImmediate& RHICmdList, bool Discontinuous, const FMorphTargetWeightMap & ActiveMorphTargets, const TArray<float> & MorphTargetWeights);
 	void UpdateMasterBoneMap();
 	void CreateMorphRemapTable(int32 InLod);
+	/** Cooked payload of the fur data of a LOD and the component it was cooked for, the Blueprint template of a spawned component */
+	TSharedPtr< FByteBulkData, ESPMode::ThreadSafe > GetCookedFurData(int32 InFurDataIndex, const UGFurComponent*& OutCookedComponent) const;
+	TSharedPtr< FByteBulkData, ESPMode::ThreadSafe > FindCookedFurData(int32 InFurDataIndex) const;
+	/** LOD whose fur is drawn for InFurLod, the memory budget replaces evicted LODs with the first one kept */
+	int32 GetBudgetFurLod(int32 InFurLod) const;
+	int32 GetBudgetLayerCount(int32 InFurLod) const;
+	/** Layer counts of the fur data of the LODs, progressive layers generate the most layers of a grow mesh LOD once and the LODs draw a part of them */
+	void GetFurDataLayerCounts(TArray<int32>& OutLayerCounts, const TArray<int32>& InDrawLayerCounts, const TArray<int32>& InMeshLods) const;
+#if WITH_EDITOR
+	void CookFurPayloads(TArray< TArray< uint8 > >& OutPayloads, TArray< FSHAHash >& OutKeys, const class ITargetPlatform* InTargetPlatform);
+#endif // WITH_EDITOR
 };